@@ -242,7 +242,6 @@ int main() {
         rg.add_compute_pass("buffer fill pass", "buffer-fill")
             .read(const_buffer)
             .write(storage_buffer)
-            .group_size(16, 16)
             .work_size(win_w, win_h);
 
         /* Test Rasterisation Pass */
@@ -260,7 +259,6 @@ int main() {
             .read(const_buffer)
             .read(attachment_img)
             .read(linear_sampler)
-            .group_size(16, 8)
             .work_size(win_w, win_h);
 
         /* Add the immediate mode GUI to the render graph */
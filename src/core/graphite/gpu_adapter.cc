@@ -52,3 +52,6 @@ u32 AgnGPUAdapter::get_max_buffers() const { return max_buffers; }
 u32 AgnGPUAdapter::get_max_textures() const { return max_textures; }
 u32 AgnGPUAdapter::get_max_images() const { return max_images; }
 u32 AgnGPUAdapter::get_max_samplers() const { return max_samplers; }
+
+void AgnGPUAdapter::set_async_compute(const bool enable) { async_compute = enable; }
+bool AgnGPUAdapter::get_async_compute() const { return async_compute; }
@@ -34,6 +34,9 @@ protected:
     u32 max_textures = 8u;
     u32 max_images = 8u;
     u32 max_samplers = 8u;
+
+    /* Whether resources are shared with the async compute queue. */
+    bool async_compute = false;
     
     /* Log a message using the active debug logger. */
     void log(DebugSeverity severity, const char* msg);
@@ -70,6 +73,13 @@ public:
     u32 get_max_textures() const;
     u32 get_max_images() const;
     u32 get_max_samplers() const;
+
+    /**
+     * @brief Share buffers & textures with the async compute queue, so render graphs can run compute nodes on it.
+     * Shared resources can be slower to access on some GPUs, so this is off by default. (should be set before `init()`)
+     */
+    void set_async_compute(const bool enable);
+    bool get_async_compute() const;
 };
 
 #include PLATFORM_INCLUDE(gpu_adapter)
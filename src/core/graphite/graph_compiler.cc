@@ -0,0 +1,572 @@
+#include "graph_compiler.hh"
+
+#include <algorithm>
+
+#include "gpu_adapter.hh"
+#include "nodes/node.hh"
+#include "nodes/compute_node.hh"
+#include "nodes/raster_node.hh"
+
+void GraphCompiler::init(const GPUAdapter& gpu) {
+    /* Resource capacity of each type, indices start at 1 so index 0 is kept as a spare entry */
+    const u32 capacities[6] = {
+        0u, /* Invalid */
+        gpu.get_max_render_targets(),
+        gpu.get_max_buffers(),
+        gpu.get_max_textures(),
+        gpu.get_max_images(),
+        gpu.get_max_samplers(),
+    };
+
+    resource_table.clear();
+    for (u32 i = 0u; i < 6u; ++i) type_sizes[i] = 0u;
+    resize_table(capacities);
+    generation = 0u;
+}
+
+void GraphCompiler::resize_table(const u32 capacities[6]) {
+    /* Lay out the resource type sections back to back */
+    u32 offsets[6] {};
+    u32 table_size = 0u;
+    for (u32 i = 0u; i < 6u; ++i) {
+        offsets[i] = table_size;
+        table_size += capacities[i] + 1u;
+    }
+
+    /* Move the entries of each section to its new offset */
+    std::vector<ResourceEntry> table(table_size);
+    for (u32 i = 0u; i < 6u; ++i) {
+        const u32 count = std::min(type_sizes[i], capacities[i] + 1u);
+        std::copy_n(resource_table.begin() + type_offsets[i], count, table.begin() + offsets[i]);
+        type_offsets[i] = offsets[i];
+        type_sizes[i] = capacities[i] + 1u;
+    }
+    resource_table.swap(table);
+}
+
+void GraphCompiler::grow_table(u32 type, u32 index) {
+    /* Handles beyond the resource limits of the GPU adapter, at least double the section so growing stays rare */
+    u32 capacities[6] {};
+    for (u32 i = 0u; i < 6u; ++i) capacities[i] = type_sizes[i] > 0u ? type_sizes[i] - 1u : 0u;
+    capacities[type] = std::max(index, capacities[type] * 2u);
+    resize_table(capacities);
+}
+
+Result<void> GraphCompiler::compile(
+    const std::vector<Node*>& nodes, u64 structure_hash, const std::vector<BindHandle>& external, std::vector<WaveLane>& waves,
+    RenderTarget& target
+) {
+    const u32 node_count = (u32)nodes.size();
+    compile_index += 1u;
+
+    /* Re-use the cached schedule if this graph was compiled recently */
+    RenderTarget node_target {};
+    if (CompiledSchedule* schedule = find_schedule(structure_hash, nodes, external); schedule != nullptr) {
+        schedule->last_used = compile_index;
+        waves.assign(schedule->waves.begin(), schedule->waves.end());
+        node_target = schedule->target;
+        culled_count = schedule->culled;
+        wave_joins.assign(schedule->joins.begin(), schedule->joins.end());
+        schedule_hit = true;
+    } else {
+        /* Pick the queue of each node */
+        queues.resize(node_count);
+        for (u32 i = 0u; i < node_count; ++i) queues[i] = is_async(*nodes[i]) ? 1u : 0u;
+
+        /* Find the source of each dependency */
+        if (Result r = propagate_versions(nodes, node_target); r.is_err()) return r;
+
+        /* Connect each producer to its consumers */
+        build_edges(node_count);
+
+        /* Find the nodes which contribute to the graph output */
+        cull_nodes(nodes, external);
+
+        /* Find the raster nodes which continue the rendering scope of an earlier node */
+        find_merges(nodes);
+
+        /* Sort the nodes into waves */
+        const u32 wave_count = sort_waves(node_count, waves);
+
+        /* Find where the queues wait for each other */
+        join_queues(node_count, wave_count);
+        store_schedule(structure_hash, nodes, external, waves, node_target, culled_count, wave_joins);
+        schedule_hit = false;
+    }
+
+    /* Merge the render target of the nodes with the graph render target (ex: from immediate mode gui) */
+    if (node_target.is_null() == false) {
+        if (target.is_null() == false && target.raw() != node_target.raw()) {
+            return Err("multiple render targets are not allowed in the same graph.");
+        }
+        target = node_target;
+    }
+    return Ok();
+}
+
+CompiledSchedule* GraphCompiler::find_schedule(u64 structure_hash, const std::vector<Node*>& nodes, const std::vector<BindHandle>& external) {
+    for (CompiledSchedule& schedule : schedules) {
+        if (schedule.structure_hash != structure_hash || schedule.node_hashes.size() != nodes.size()) continue;
+        if (schedule.culling != culling || schedule.merging != merging || schedule.async != async) continue;
+
+        /* External resources only change the schedule when culling */
+        if (culling && schedule.external.size() != external.size()) continue;
+        bool same = true;
+        for (u32 i = 0u; culling && same && i < external.size(); ++i) same = schedule.external[i].raw() == external[i].raw();
+
+        /* The graph hash matched, make sure it wasn't a collision (one compare per node) */
+        for (u32 i = 0u; same && i < nodes.size(); ++i) same = schedule.node_hashes[i] == nodes[i]->structure_hash;
+        if (same) return &schedule;
+    }
+    return nullptr;
+}
+
+void GraphCompiler::store_schedule(
+    u64 structure_hash, const std::vector<Node*>& nodes, const std::vector<BindHandle>& external, const std::vector<WaveLane>& waves,
+    RenderTarget node_target, u32 culled, const std::vector<WaveJoin>& joins
+) {
+    if (max_schedules == 0u) return;
+
+    /* Pick a free entry, or the least recently used one */
+    CompiledSchedule* entry = nullptr;
+    if (schedules.size() < max_schedules) {
+        entry = &schedules.emplace_back();
+    } else {
+        entry = &schedules[0];
+        for (CompiledSchedule& schedule : schedules) {
+            if (schedule.last_used < entry->last_used) entry = &schedule;
+        }
+    }
+
+    entry->structure_hash = structure_hash;
+    entry->node_hashes.resize(nodes.size());
+    for (u32 i = 0u; i < nodes.size(); ++i) entry->node_hashes[i] = nodes[i]->structure_hash;
+    entry->external.assign(external.begin(), external.end());
+    entry->culling = culling;
+    entry->merging = merging;
+    entry->async = async;
+    entry->last_used = compile_index;
+    entry->waves.assign(waves.begin(), waves.end());
+    entry->target = node_target;
+    entry->culled = culled;
+    entry->joins.assign(joins.begin(), joins.end());
+}
+
+bool GraphCompiler::is_async(const Node& node) const {
+    if (async == AsyncCompute::Disabled || node.type != NodeType::Compute) return false;
+    if (async == AsyncCompute::Hinted && ((const ComputeNode&)node).async_hint == false) return false;
+
+    /* The render target is only used on the combined queue */
+    for (const Dependency& dep : node.dependencies) {
+        if (dep.resource.get_type() == ResourceType::RenderTarget) return false;
+    }
+    return true;
+}
+
+Result<void> GraphCompiler::propagate_versions(const std::vector<Node*>& nodes, RenderTarget& node_target) {
+    const u32 node_count = (u32)nodes.size();
+
+    /* Invalidate all resource table entries by moving on to the next generation */
+    next_generation();
+
+    /* Find the offset of each node in the flat dependency arrays */
+    dep_offsets.resize(node_count + 1u);
+    dep_offsets[0] = 0u;
+    for (u32 i = 0u; i < node_count; ++i) {
+        dep_offsets[i + 1u] = dep_offsets[i] + (u32)nodes[i]->dependencies.size();
+    }
+    dep_versions.resize(dep_offsets[node_count]);
+    dep_sources.resize(dep_offsets[node_count]);
+    reader_links.clear();
+    order_pairs.clear();
+
+    for (u32 i = 0u; i < node_count; ++i) {
+        const Node* node = nodes[i];
+        const u32 offset = dep_offsets[i];
+
+        for (u32 j = 0u; j < node->dependencies.size(); ++j) {
+            /* Get the dependency and its version */
+            const Dependency& dep = node->dependencies[j];
+            ResourceEntry& entry = resource_entry(dep.resource);
+            if (entry.generation != generation) {
+                /* First time this resource is used in this graph */
+                entry.generation = generation;
+                entry.version = 0u;
+                entry.source = UINT32_MAX;
+                entry.external = false;
+                entry.transient = UINT32_MAX;
+                entry.readers = UINT32_MAX;
+            }
+            dep_versions[offset + j] = entry.version;
+
+            /* Record which pass this dependency comes from, UINT32_MAX if first time used */
+            dep_sources[offset + j] = entry.source;
+
+            if (has_flag(dep.flags, DependencyFlags::Readonly)) {
+                /* Textures read on both queues are read in order, each queue transitions their layout */
+                if (async != AsyncCompute::Disabled && dep.resource.get_type() == ResourceType::Image) {
+                    for (u32 r = entry.readers; r != UINT32_MAX; r = reader_links[r].next) {
+                        if (queues[reader_links[r].node] == queues[i]) continue;
+                        order_pairs.push_back(reader_links[r].node);
+                        order_pairs.push_back(i);
+                    }
+                }
+
+                /* Add this node to the readers of the current version */
+                reader_links.push_back(ReaderLink { i, entry.readers });
+                entry.readers = (u32)reader_links.size() - 1u;
+            } else {
+                /* Writes wait for the earlier reads of the version they overwrite */
+                for (u32 r = entry.readers; r != UINT32_MAX; r = reader_links[r].next) {
+                    if (reader_links[r].node == i) continue; /* <- a node never waits on itself */
+                    order_pairs.push_back(reader_links[r].node);
+                    order_pairs.push_back(i);
+                }
+                entry.readers = UINT32_MAX;
+
+                /* Update the version and source */
+                entry.version += 1u; /* <- increment version */
+                entry.source = i; /* <- store source node index */
+
+                /* Save this resource if it is a render target */
+                if (dep.resource.get_type() == ResourceType::RenderTarget) {
+                    if (node_target.is_null() == false && node_target.raw() != dep.resource.raw()) {
+                        return Err("multiple render targets are not allowed in the same graph.");
+                    }
+                    node_target = (RenderTarget&)dep.resource;
+                }
+            }
+        }
+    }
+    return Ok();
+}
+
+void GraphCompiler::next_generation() {
+    if (++generation == 0u) {
+        /* Generation counter wrapped around, so stale entries could look valid again */
+        resource_table.assign(resource_table.size(), ResourceEntry {});
+        generation = 1u;
+    }
+}
+
+void GraphCompiler::build_edges(u32 node_count) {
+    /* Count the number of consumers & producers of each node */
+    edge_offsets.assign(node_count + 1u, 0u);
+    in_degree.assign(node_count, 0u);
+    for (u32 i = 0u; i < node_count; ++i) {
+        for (u32 d = dep_offsets[i]; d < dep_offsets[i + 1u]; ++d) {
+            const u32 src = dep_sources[d];
+            if (src == UINT32_MAX || src == i) continue; /* <- a node never waits on itself */
+            edge_offsets[src + 1u] += 1u;
+            in_degree[i] += 1u;
+        }
+    }
+    for (u32 p = 0u; p < order_pairs.size(); p += 2u) {
+        edge_offsets[order_pairs[p] + 1u] += 1u;
+        in_degree[order_pairs[p + 1u]] += 1u;
+    }
+
+    /* Turn the consumer counts into offsets (prefix sum) */
+    for (u32 i = 0u; i < node_count; ++i) edge_offsets[i + 1u] += edge_offsets[i];
+    edges.resize(edge_offsets[node_count]);
+    edge_order.resize(edge_offsets[node_count]);
+
+    /* Fill in the consumers of each node, using the scratch list as write cursors */
+    scratch.assign(edge_offsets.begin(), edge_offsets.end() - 1);
+    for (u32 i = 0u; i < node_count; ++i) {
+        for (u32 d = dep_offsets[i]; d < dep_offsets[i + 1u]; ++d) {
+            const u32 src = dep_sources[d];
+            if (src == UINT32_MAX || src == i) continue; /* <- a node never waits on itself */
+            const u32 e = scratch[src]++;
+            edges[e] = i;
+            edge_order[e] = 0u;
+        }
+    }
+    for (u32 p = 0u; p < order_pairs.size(); p += 2u) {
+        const u32 e = scratch[order_pairs[p]]++;
+        edges[e] = order_pairs[p + 1u];
+        edge_order[e] = 1u;
+    }
+}
+
+void GraphCompiler::cull_nodes(const std::vector<Node*>& nodes, const std::vector<BindHandle>& external) {
+    const u32 node_count = (u32)nodes.size();
+    live.assign(node_count, 1u);
+    culled_count = 0u;
+    if (culling == false) return;
+
+    /* Mark the external resources used in this graph */
+    for (const BindHandle resource : external) {
+        ResourceEntry& entry = resource_entry(resource);
+        if (entry.generation == generation) entry.external = true;
+    }
+
+    /* Consumers always come after their producers, so walking backwards visits all consumers first */
+    for (u32 i = node_count; i-- > 0u;) {
+        const Node* node = nodes[i];
+        bool is_live = node->pinned;
+
+        /* Nodes writing to a root resource are live */
+        for (u32 j = 0u; is_live == false && j < node->dependencies.size(); ++j) {
+            const Dependency& dep = node->dependencies[j];
+            if (has_flag(dep.flags, DependencyFlags::Readonly)) continue;
+            if (dep.resource.get_type() == ResourceType::RenderTarget) is_live = true;
+            else if (resource_entry(dep.resource).external) is_live = true;
+        }
+
+        /* Nodes with a live consumer are live, nodes which are only ordered after this one don't count */
+        for (u32 e = edge_offsets[i]; is_live == false && e < edge_offsets[i + 1u]; ++e) {
+            if (edge_order[e] == 0u && live[edges[e]] != 0u) is_live = true;
+        }
+
+        live[i] = is_live ? 1u : 0u;
+        if (is_live == false) culled_count += 1u;
+    }
+}
+
+void GraphCompiler::find_merges(const std::vector<Node*>& nodes) {
+    const u32 node_count = (u32)nodes.size();
+    merged_into.assign(node_count, UINT32_MAX);
+    merged_next.assign(node_count, UINT32_MAX);
+    if (merging == false) return;
+
+    /* Check whether a dependency is a rendering attachment */
+    const auto is_attachment = [](const Dependency& dep) { return has_flag(dep.flags, DependencyFlags::Attachment); };
+
+    for (u32 i = 0u; i < node_count; ++i) {
+        if (live[i] == 0u || nodes[i]->type != NodeType::Raster) continue;
+        const RasterNode& node = (const RasterNode&)*nodes[i];
+        if (node.pixel_load_op == LoadOp::Clear) continue; /* <- clearing needs a new rendering scope */
+
+        /* All attachments must have been written last by the same node */
+        u32 head = UINT32_MAX, attachments = 0u;
+        bool mergeable = true;
+        for (u32 j = 0u; j < node.dependencies.size(); ++j) {
+            if (is_attachment(node.dependencies[j]) == false) continue;
+            const u32 src = source(i, j);
+            if (attachments++ == 0u) head = src;
+            else if (src != head) mergeable = false;
+        }
+        if (mergeable == false || head == UINT32_MAX || live[head] == 0u || merged_next[head] != UINT32_MAX) continue;
+        if (nodes[head]->type != NodeType::Raster) continue;
+        const RasterNode& prev = (const RasterNode&)*nodes[head];
+
+        /* It must render into the same attachments in the same order, with the same area */
+        if (node.raster_x != prev.raster_x || node.raster_y != prev.raster_y || node.raster_w != prev.raster_w || node.raster_h != prev.raster_h) continue;
+        u32 prev_dep = 0u;
+        for (const Dependency& dep : node.dependencies) {
+            if (is_attachment(dep) == false) continue;
+            while (prev_dep < prev.dependencies.size() && is_attachment(prev.dependencies[prev_dep]) == false) prev_dep++;
+            if (prev_dep == prev.dependencies.size() || prev.dependencies[prev_dep++].resource.raw() != dep.resource.raw()) mergeable = false;
+        }
+        while (prev_dep < prev.dependencies.size()) {
+            if (is_attachment(prev.dependencies[prev_dep++])) mergeable = false;
+        }
+
+        /* It may only depend on the previous node through the attachments, and may not access them otherwise */
+        for (u32 j = 0u; mergeable && j < node.dependencies.size(); ++j) {
+            const Dependency& dep = node.dependencies[j];
+            if (is_attachment(dep)) continue;
+            if (source(i, j) == head) mergeable = false;
+            for (const Dependency& other : node.dependencies) {
+                if (is_attachment(other) && other.resource.raw() == dep.resource.raw()) mergeable = false;
+            }
+        }
+        for (u32 e = edge_offsets[head]; mergeable && e < edge_offsets[head + 1u]; ++e) {
+            if (edges[e] == i && edge_order[e] != 0u) mergeable = false;
+        }
+        if (mergeable == false) continue;
+
+        merged_into[i] = head;
+        merged_next[head] = i;
+    }
+}
+
+u32 GraphCompiler::sort_waves(u32 node_count, std::vector<WaveLane>& waves) {
+    /* Culled nodes are never resolved, so release the live nodes which are only ordered after them */
+    for (u32 i = 0u; i < node_count; ++i) {
+        if (live[i] != 0u) continue;
+        for (const u32 consumer : consumers(i)) in_degree[consumer] -= 1u;
+    }
+
+    /* Start with all live nodes which have no producers */
+    levels.assign(node_count, 0u);
+    scratch.clear();
+    for (u32 i = 0u; i < node_count; ++i) {
+        if (in_degree[i] == 0u && live[i] != 0u) scratch.push_back(i);
+    }
+
+    /* Resolve the producers of each node, the wave of a node is the longest path to it */
+    u32 wave_count = node_count > 0u ? 1u : 0u;
+    for (u32 head = 0u; head < scratch.size(); ++head) {
+        const u32 producer = scratch[head];
+
+        for (const u32 consumer : consumers(producer)) {
+            /* Merged raster nodes try to stay in the wave of the node they continue */
+            const u32 next_level = merged_into[consumer] == producer ? levels[producer] : levels[producer] + 1u;
+            if (next_level > levels[consumer]) levels[consumer] = next_level;
+            if (--in_degree[consumer] == 0u && live[consumer] != 0u) {
+                scratch.push_back(consumer);
+                if (levels[consumer] + 1u > wave_count) wave_count = levels[consumer] + 1u;
+            }
+        }
+    }
+
+    /* Raster nodes which had to move to a later wave start a new rendering scope */
+    for (u32 i = 0u; i < node_count; ++i) {
+        const u32 head = merged_into[i];
+        if (head == UINT32_MAX || levels[i] == levels[head]) continue;
+        merged_into[i] = UINT32_MAX;
+        merged_next[head] = UINT32_MAX;
+    }
+
+    /* Bucket the live nodes by wave, keeping them sorted by node index within each wave */
+    scratch.assign(wave_count + 1u, 0u);
+    for (u32 i = 0u; i < node_count; ++i) {
+        if (live[i] != 0u) scratch[levels[i] + 1u] += 1u;
+    }
+    for (u32 w = 0u; w < wave_count; ++w) scratch[w + 1u] += scratch[w];
+
+    /* Re-use the in-degree list to store the sorted node indices, combined queue lanes come first in each wave */
+    const u32 live_count = node_count - culled_count;
+    for (u8 queue = 0u; queue < 2u; ++queue) {
+        for (u32 i = 0u; i < node_count; ++i) {
+            if (live[i] == 0u || queues[i] != queue || merged_into[i] != UINT32_MAX) continue;
+
+            /* Merged raster nodes follow the node they continue */
+            for (u32 n = i; n != UINT32_MAX; n = merged_next[n]) in_degree[scratch[levels[n]]++] = n;
+        }
+    }
+
+    waves.clear();
+    for (u32 i = 0u; i < live_count; ++i) {
+        const u32 lane = in_degree[i];
+        waves.emplace_back(levels[lane], lane, queues[lane] != 0u, merged_into[lane] != UINT32_MAX);
+    }
+    return wave_count;
+}
+
+void GraphCompiler::join_queues(u32 node_count, u32 wave_count) {
+    wave_joins.clear();
+
+    /* Without async compute nodes there is nothing to synchronize */
+    bool has_async = false;
+    for (u32 i = 0u; i < node_count && has_async == false; ++i) {
+        has_async = live[i] != 0u && queues[i] != 0u;
+    }
+    if (has_async == false) return;
+
+    /* Wait for the latest producer on the other queue */
+    wave_joins.assign(wave_count, WaveJoin {});
+    for (u32 producer = 0u; producer < node_count; ++producer) {
+        if (live[producer] == 0u) continue;
+
+        for (const u32 consumer : consumers(producer)) {
+            if (live[consumer] == 0u || queues[consumer] == queues[producer]) continue;
+            WaveJoin& join = wave_joins[levels[consumer]];
+            u32& wait = queues[consumer] != 0u ? join.wait_combined : join.wait_async;
+            if (wait == UINT32_MAX || levels[producer] > wait) wait = levels[producer];
+        }
+    }
+
+    /* Skip the waits which an earlier wave of the same queue already did, and mark the waves which are waited for */
+    u32 waited_async = UINT32_MAX, waited_combined = UINT32_MAX;
+    for (WaveJoin& join : wave_joins) {
+        if (join.wait_async != UINT32_MAX && waited_async != UINT32_MAX && join.wait_async <= waited_async) join.wait_async = UINT32_MAX;
+        if (join.wait_async != UINT32_MAX) {
+            waited_async = join.wait_async;
+            wave_joins[waited_async].signal_async = true;
+        }
+
+        if (join.wait_combined != UINT32_MAX && waited_combined != UINT32_MAX && join.wait_combined <= waited_combined) join.wait_combined = UINT32_MAX;
+        if (join.wait_combined != UINT32_MAX) {
+            waited_combined = join.wait_combined;
+            wave_joins[waited_combined].signal_combined = true;
+        }
+    }
+}
+
+void GraphCompiler::transient_lifetimes(const std::vector<Node*>& nodes, const std::vector<WaveLane>& waves, std::vector<TransientResource>& transients) {
+    if (transients.empty()) return;
+
+    /* Mark the transient resources in a fresh generation of the resource table */
+    next_generation();
+    for (u32 i = 0u; i < transients.size(); ++i) {
+        ResourceEntry& entry = resource_entry(transients[i].resource);
+        entry.generation = generation;
+        entry.transient = i;
+        transients[i].first = UINT32_MAX;
+        transients[i].last = 0u;
+    }
+
+    /* Extend the lifetime of a transient resource to include a wave */
+    const u32 last_wave = waves.empty() ? 0u : waves.back().wave;
+    const auto use = [&](OpaqueHandle resource, const WaveLane& lane) {
+        const ResourceEntry& entry = resource_entry(resource);
+        if (entry.generation != generation || entry.transient == UINT32_MAX) return;
+        TransientResource& transient = transients[entry.transient];
+
+        /* The combined queue doesn't wait for the async compute queue before re-using memory, so never share it */
+        if (lane.async) {
+            transient.first = 0u;
+            transient.last = last_wave;
+        }
+        if (transient.first == UINT32_MAX) transient.first = lane.wave;
+        transient.last = std::max(transient.last, lane.wave);
+    };
+
+    for (const WaveLane& lane : waves) {
+        const Node* node = nodes[lane.lane];
+        for (const Dependency& dep : node->dependencies) use(dep.resource, lane);
+
+        /* Indirect argument buffers are not a dependency of the node */
+        if (node->type == NodeType::Compute) {
+            const Buffer indirect_buffer = ((const ComputeNode*)node)->indirect_buffer;
+            if (indirect_buffer.is_null() == false) use(indirect_buffer, lane);
+        } else if (node->type == NodeType::Raster) {
+            for (const DrawCall& draw_call : ((const RasterNode*)node)->draws) {
+                if (draw_call.indirect_buffer.is_null() == false) use(draw_call.indirect_buffer, lane);
+            }
+        }
+    }
+}
+
+void GraphCompiler::place_transients(std::vector<TransientResource>& transients, std::vector<u64>& heap_sizes) {
+    heap_sizes.clear();
+
+    /* Place the largest resources first, they are the hardest to fit in between others */
+    scratch.clear();
+    for (u32 i = 0u; i < transients.size(); ++i) {
+        if (transients[i].is_used()) scratch.push_back(i);
+        else transients[i].offset = 0u;
+    }
+    std::sort(scratch.begin(), scratch.end(), [&](u32 a, u32 b) {
+        if (transients[a].size != transients[b].size) return transients[a].size > transients[b].size;
+        return a < b;
+    });
+
+    placed.clear();
+    for (const u32 i : scratch) {
+        TransientResource& transient = transients[i];
+        if (transient.heap >= heap_sizes.size()) heap_sizes.resize(transient.heap + 1u, 0u);
+
+        /* Find the lowest gap in between the placed resources which are alive at the same time */
+        u64 offset = 0u;
+        for (const u32 p : placed) {
+            const TransientResource& other = transients[p];
+            if (other.heap != transient.heap || other.overlaps(transient) == false) continue;
+
+            const u64 aligned = (offset + transient.align - 1u) / transient.align * transient.align;
+            if (aligned + transient.size <= other.offset) break; /* <- fits in front of this resource */
+            offset = std::max(offset, other.offset + other.size);
+        }
+        transient.offset = (offset + transient.align - 1u) / transient.align * transient.align;
+        heap_sizes[transient.heap] = std::max(heap_sizes[transient.heap], transient.offset + transient.size);
+
+        /* Keep the placed resources sorted by offset */
+        const auto at = std::upper_bound(placed.begin(), placed.end(), transient.offset, [&](u64 value, u32 p) {
+            return value < transients[p].offset;
+        });
+        placed.insert(at, i);
+    }
+}
@@ -0,0 +1,302 @@
+#pragma once
+
+#include <vector>
+
+#include "resources/handle.hh"
+#include "utils/result.hh"
+#include "utils/types.hh"
+
+class GPUAdapter;
+class Node;
+
+/* Which compute nodes run on the async compute queue. */
+enum class AsyncCompute : u32 {
+    Disabled = 0u, /* All nodes run on the combined queue. */
+    Hinted = 1u,   /* Compute nodes with the `async()` hint run on the async compute queue. */
+    All = 2u,      /* All compute nodes run on the async compute queue. */
+};
+
+/* Graph wave lane pair. */
+struct WaveLane {
+    u32 wave = 0u; /* Index of the wave. */
+    u32 lane = 0u; /* Index of the node. */
+    bool async = false; /* Whether the node runs on the async compute queue. */
+    bool merged = false; /* Whether the node continues the rendering scope of the previous lane. (raster nodes only) */
+    WaveLane(u32 wave, u32 lane, bool async = false, bool merged = false) : wave(wave), lane(lane), async(async), merged(merged) {}
+};
+
+/* Cross queue synchronization of a wave. */
+struct WaveJoin {
+    u32 wait_async = UINT32_MAX; /* Async compute wave the combined queue waits for before this wave, UINT32_MAX if none. */
+    u32 wait_combined = UINT32_MAX; /* Combined wave the async compute queue waits for before this wave, UINT32_MAX if none. */
+    bool signal_async = false; /* Whether the combined queue waits for the async compute part of this wave. */
+    bool signal_combined = false; /* Whether the async compute queue waits for the combined part of this wave. */
+};
+
+/* Range of node indices inside the flat edge array. */
+struct EdgeRange {
+    const u32* first = nullptr;
+    const u32* last = nullptr;
+
+    inline const u32* begin() const { return first; }
+    inline const u32* end() const { return last; }
+    inline u32 size() const { return (u32)(last - first); }
+};
+
+/* Resource version & source table entry. */
+struct ResourceEntry {
+    u32 generation = 0u; /* Generation in which this entry was last written, stale entries are treated as unused. */
+    u32 version = 0u; /* Number of times the resource was written to. */
+    u32 source = UINT32_MAX; /* Index of the last node which wrote to the resource. */
+    bool external = false; /* Whether the resource is visible outside of the graph. (culling root) */
+    u32 transient = UINT32_MAX; /* Index of the transient resource, UINT32_MAX if the resource is not transient. */
+    u32 readers = UINT32_MAX; /* Head of the list of nodes reading the current version, UINT32_MAX if there are none. */
+};
+
+/* Node reading a resource version, linked list stored in a flat array. */
+struct ReaderLink {
+    u32 node = UINT32_MAX;
+    u32 next = UINT32_MAX;
+};
+
+/* Transient graph resource, its memory is shared with other transient resources. */
+struct TransientResource {
+    BindHandle resource {}; /* Image or Buffer handle. */
+    u32 first = UINT32_MAX; /* First wave which uses the resource, UINT32_MAX if it is unused. */
+    u32 last = 0u; /* Last wave which uses the resource. */
+
+    /* Memory requirements. (filled in by the platform) */
+    u64 size = 0u;
+    u64 align = 1u;
+    u32 heap = 0u; /* Memory heap the resource must be placed in. */
+
+    /* Offset of the resource in its heap. (output of placement) */
+    u64 offset = 0u;
+
+    TransientResource(BindHandle resource) : resource(resource) {}
+
+    /* Returns true if the resource is used by any wave. */
+    inline bool is_used() const { return first != UINT32_MAX; }
+    /* Returns true if the lifetimes of two resources overlap. */
+    inline bool overlaps(const TransientResource& other) const { return first <= other.last && other.first <= last; }
+};
+
+/* Compiled graph schedule, cached by graph structure hash. */
+struct CompiledSchedule {
+    u64 structure_hash = 0u;
+    /* Structure hash of each node, compared on a hit so a colliding graph hash never re-uses the wrong schedule. */
+    std::vector<u64> node_hashes {};
+    /* External resources & settings the schedule was compiled with. (also compared on a hit) */
+    std::vector<BindHandle> external {};
+    bool culling = false, merging = true;
+    AsyncCompute async = AsyncCompute::Disabled;
+    /* Compile index in which this schedule was last used. (for eviction) */
+    u64 last_used = 0u;
+    /* Flattened list of waves and their lanes. */
+    std::vector<WaveLane> waves {};
+    /* Render target written to by the nodes, if any. */
+    RenderTarget target {};
+    /* Number of culled nodes. */
+    u32 culled = 0u;
+    /* Cross queue synchronization of each wave. (empty without async compute) */
+    std::vector<WaveJoin> joins {};
+};
+
+/**
+ * Render Graph Compiler.
+ * Turns a list of nodes into a list of waves, in time linear to the number of nodes + dependencies.
+ */
+class GraphCompiler {
+    /* Resource version & source table, indexed by handle. (one section per resource type) */
+    std::vector<ResourceEntry> resource_table {};
+    /* Offset & size of each resource type section in the resource table. */
+    u32 type_offsets[6] {};
+    u32 type_sizes[6] {};
+    /* Current generation of the resource table, incremented every compile. */
+    u32 generation = 0u;
+
+    /* Offset of the first dependency of each node in the flat dependency arrays. (size: nodes + 1) */
+    std::vector<u32> dep_offsets {};
+    /* Version of each dependency, when its node was queued. */
+    std::vector<u32> dep_versions {};
+    /* Source node of each dependency, UINT32_MAX if it has no source. */
+    std::vector<u32> dep_sources {};
+
+    /* Readers of each resource version, linked through the resource table. */
+    std::vector<ReaderLink> reader_links {};
+    /* Flat list of (before, after) node pairs, which are ordered without passing data. (ex: a write after a read) */
+    std::vector<u32> order_pairs {};
+
+    /* Offset of the first consumer of each node in the edge array. (size: nodes + 1) */
+    std::vector<u32> edge_offsets {};
+    /* Flat producer -> consumer adjacency array. (CSR) */
+    std::vector<u32> edges {};
+    /* Whether each edge only orders two nodes, these edges don't keep producers alive. */
+    std::vector<u8> edge_order {};
+
+    /* Number of unresolved producers per node. (used during sorting) */
+    std::vector<u32> in_degree {};
+    /* Wave index of each node. */
+    std::vector<u32> levels {};
+    /* Scratch list of nodes, used as the sorting queue and for bucketing waves. */
+    std::vector<u32> scratch {};
+    /* Scratch list of placed transient resources, sorted by offset. */
+    std::vector<u32> placed {};
+
+    /* Whether dead nodes should be culled. */
+    bool culling = false;
+    /* Whether each node is live, nodes which aren't live are culled. */
+    std::vector<u8> live {};
+    /* Number of culled nodes in the last compile. */
+    u32 culled_count = 0u;
+
+    /* Which compute nodes run on the async compute queue. */
+    AsyncCompute async = AsyncCompute::Disabled;
+    /* Queue of each node, 1 for the async compute queue. */
+    std::vector<u8> queues {};
+    /* Cross queue synchronization of each wave. (empty without async compute) */
+    std::vector<WaveJoin> wave_joins {};
+
+    /* Whether consecutive raster nodes with the same attachments are merged into one rendering scope. */
+    bool merging = true;
+    /* Raster node whose rendering scope each node continues, and the node which continues each node. (UINT32_MAX if none) */
+    std::vector<u32> merged_into {};
+    std::vector<u32> merged_next {};
+
+    /* Cache of recently compiled schedules. */
+    std::vector<CompiledSchedule> schedules {};
+    u32 max_schedules = 4u;
+    /* Number of compiles so far. */
+    u64 compile_index = 0u;
+    /* Whether the last compile re-used a cached schedule. */
+    bool schedule_hit = false;
+
+    /**
+     * @brief Find a cached schedule, returns nullptr if there is none.
+     * Schedules with the same structure hash must also have the same node hashes, external resources & settings.
+     */
+    CompiledSchedule* find_schedule(u64 structure_hash, const std::vector<Node*>& nodes, const std::vector<BindHandle>& external);
+
+    /* Store a compiled schedule in the cache, evicting the least recently used one if it is full. */
+    void store_schedule(
+        u64 structure_hash, const std::vector<Node*>& nodes, const std::vector<BindHandle>& external, const std::vector<WaveLane>& waves,
+        RenderTarget node_target, u32 culled, const std::vector<WaveJoin>& joins
+    );
+
+    /* Returns true if a node should run on the async compute queue. */
+    bool is_async(const Node& node) const;
+
+    /* Lay out the resource table with a capacity for each resource type, keeping the existing entries. */
+    void resize_table(const u32 capacities[6]);
+
+    /* Grow the section of a resource type in the resource table, so it fits a resource index. */
+    void grow_table(u32 type, u32 index);
+
+    /* Get the resource table entry of a resource handle, growing the table if the handle is outside of it. */
+    inline ResourceEntry& resource_entry(OpaqueHandle handle) {
+        const u32 type = (u32)handle.get_type();
+        if (handle.get_index() >= type_sizes[type]) grow_table(type, handle.get_index());
+        return resource_table[type_offsets[type] + handle.get_index()];
+    }
+
+    /**
+     * @brief Propagate dependency versions through the graph, and find the source of each dependency.
+     * Also finds the readers which must finish before a node, writes wait for earlier reads of the same version,
+     * and textures read on both queues are read in order because each queue transitions their layout.
+     */
+    Result<void> propagate_versions(const std::vector<Node*>& nodes, RenderTarget& node_target);
+
+    /* Build the flat producer -> consumer adjacency array. */
+    void build_edges(u32 node_count);
+
+    /* Find the live nodes, walking backwards from the root resources & pinned nodes. */
+    void cull_nodes(const std::vector<Node*>& nodes, const std::vector<BindHandle>& external);
+
+    /**
+     * @brief Find the raster nodes which can continue the rendering scope of the node which last wrote their attachments.
+     * They must render into the same attachments with the same area, without clearing them,
+     * and may not depend on that node through any other resource.
+     */
+    void find_merges(const std::vector<Node*>& nodes);
+
+    /* Sort the live nodes into waves using in-degree counting, returns the number of waves. */
+    u32 sort_waves(u32 node_count, std::vector<WaveLane>& waves);
+
+    /* Find the waves where the queues have to wait for each other. */
+    void join_queues(u32 node_count, u32 wave_count);
+
+    /* Move on to the next generation, invalidating all resource table entries. */
+    void next_generation();
+
+public:
+    /* Initialize the compiler, sizes the resource table to the resource limits of the GPU adapter. */
+    void init(const GPUAdapter& gpu);
+
+    /* Set the maximum number of cached schedules, 0 disables the cache. (default: `4`) */
+    void set_max_schedules(u32 count) { max_schedules = count; };
+    /* Enable or disable dead node culling. (default: `false`) */
+    void set_culling(bool enable) { culling = enable; };
+    /* Enable or disable merging raster nodes into one rendering scope. (default: `true`) */
+    void set_merging(bool enable) { merging = enable; };
+    /* Set which compute nodes run on the async compute queue. (default: `Disabled`) */
+    void set_async(AsyncCompute policy) { async = policy; };
+
+    /**
+     * @brief Compile a list of nodes into a flattened list of waves and their lanes.
+     * If a schedule with the same structure hash was compiled recently, it is re-used instead.
+     * (after checking the structure hash of each node, so a hash collision is compiled like any other graph)
+     * When culling is enabled, nodes which don't contribute to a root are left out of the waves.
+     * Roots are writes to render targets or external resources, and pinned nodes.
+     * Compute nodes are placed on the async compute queue following the async compute policy.
+     * Raster nodes which continue rendering into the attachments of the previous raster node are merged with it,
+     * they are placed in the same wave right after the node they continue.
+     *
+     * @param nodes Nodes in the order in which they were queued.
+     * @param structure_hash Combined structure hash of all the nodes, external resources & culling state.
+     * @param external Resources which are visible outside of the graph.
+     * @param waves Output list of waves, lanes within a wave are sorted by node index, combined queue lanes first. (merged lanes follow the lane they continue)
+     * @param target Output render target, if any node writes to one.
+     */
+    Result<void> compile(
+        const std::vector<Node*>& nodes, u64 structure_hash, const std::vector<BindHandle>& external, std::vector<WaveLane>& waves,
+        RenderTarget& target
+    );
+
+    /* Returns true if the last compile re-used a cached schedule. */
+    inline bool was_cached() const { return schedule_hit; }
+
+    /* Get the number of nodes culled in the last compile. */
+    inline u32 culled() const { return culled_count; }
+
+    /* Get the cross queue synchronization of each wave in the last compile. (empty without async compute) */
+    inline const std::vector<WaveJoin>& joins() const { return wave_joins; }
+
+    /* Returns true if a node was culled. (valid until the next uncached compile) */
+    inline bool is_culled(u32 node) const { return live[node] == 0u; }
+
+    /* Get the consumers of a node, including the nodes which are only ordered after it. (valid until the next uncached compile) */
+    inline EdgeRange consumers(u32 node) const {
+        return EdgeRange { edges.data() + edge_offsets[node], edges.data() + edge_offsets[node + 1u] };
+    }
+
+    /* Get the source node of a dependency of a node, UINT32_MAX if it has no source. (valid until the next uncached compile) */
+    inline u32 source(u32 node, u32 dep) const { return dep_sources[dep_offsets[node] + dep]; }
+
+    /* Get the version of a dependency of a node. (valid until the next uncached compile) */
+    inline u32 version(u32 node, u32 dep) const { return dep_versions[dep_offsets[node] + dep]; }
+
+    /**
+     * @brief Find the first & last wave which uses each transient resource.
+     * Should be called after `compile(...)`, culled nodes don't extend the lifetime of a resource.
+     */
+    void transient_lifetimes(const std::vector<Node*>& nodes, const std::vector<WaveLane>& waves, std::vector<TransientResource>& transients);
+
+    /**
+     * @brief Place the transient resources in their heaps, resources with overlapping lifetimes never share memory.
+     * Larger resources are placed first, each at the lowest offset which doesn't overlap a live resource.
+     *
+     * @param transients Transient resources with their lifetimes & memory requirements.
+     * @param heap_sizes Output size of each heap. (indexed by heap)
+     */
+    void place_transients(std::vector<TransientResource>& transients, std::vector<u64>& heap_sizes);
+};
@@ -1,15 +1,30 @@
 #include "compute_node.hh"
 
-ComputeNode::ComputeNode(std::string_view label, std::string_view shader_path) : Node(label, NodeType::Compute), compute_path(shader_path) {}
+#include "graphite/utils/hash.hh"
+
+ComputeNode::ComputeNode(std::string_view label, std::string_view shader_path, FrameArena& arena)
+    : Node(label, NodeType::Compute, arena), compute_path(shader_path) {
+    structure_hash = hash_combine(structure_hash, hash_string(shader_path));
+    pipeline_hash = hash_combine(pipeline_hash, hash_string(shader_path));
+}
 
 ComputeNode& ComputeNode::write(BindHandle resource) {
     /* Insert the write dependency */
-    dependencies.emplace_back(resource, DependencyFlags::None, DependencyStages::Compute);
+    add_dependency(resource, DependencyFlags::None, DependencyStages::Compute);
     return *this;
 }
 
 ComputeNode& ComputeNode::read(BindHandle resource) {
     /* Insert the read dependency */
-    dependencies.emplace_back(resource, DependencyFlags::Readonly, DependencyStages::Compute);
+    add_dependency(resource, DependencyFlags::Readonly, DependencyStages::Compute);
+    return *this;
+}
+
+ComputeNode& ComputeNode::async() {
+    if (async_hint) return *this;
+    async_hint = true;
+
+    /* Update the structure hash */
+    structure_hash = hash_combine(structure_hash, 2u);
     return *this;
 }
@@ -11,19 +11,22 @@
 class ComputeNode : public Node {
     /* Can only be constructed by the RenderGraph */
     ComputeNode() = default;
-    ComputeNode(std::string_view label, std::string_view shader_path);
+    ComputeNode(std::string_view label, std::string_view shader_path, FrameArena& arena);
 
 public:
     /* Compute shader file path */
     std::string_view compute_path {};
 
-    u32 group_x = 1u, group_y = 1u, group_z = 1u; /* Thread group size */
+    u32 group_x = 0u, group_y = 0u, group_z = 0u; /* Thread group size, 0 uses the size declared by the shader. */
     u32 work_x = 1u, work_y = 1u, work_z = 1u; /* Work size */
     
     /* Indirect Dispatch. */
     Buffer indirect_buffer {};
     uint32_t indirect_offset = 0u;
 
+    /* Whether this node should run on the async compute queue. */
+    bool async_hint = false;
+
     /* No copies allowed */
     ComputeNode(const ComputeNode&) = delete;
     ComputeNode& operator=(const ComputeNode&) = delete;
@@ -34,7 +37,7 @@ public:
     /* Add a bindable resource as an input for this node. */
     ComputeNode& read(BindHandle resource);
 
-    /* Set the thread group size for this node. */
+    /* Set the thread group size for this node, overriding the size declared by the shader. (ex: for multiple items per thread) */
     inline ComputeNode& group_size(u32 x, u32 y = 1u, u32 z = 1u) { group_x = x; group_y = y; group_z = z; return *this; }
 
     /* Set the work size for this node. (this will be divided by the `group_size` to get the dispatch size) */
@@ -43,6 +46,30 @@ public:
     /* Set the indirect_buffer which will be used to get the dispatch args buffer for the vkCmdDispatchIndirect call. */
     inline ComputeNode& indirect_size(Buffer buffer) { indirect_buffer = buffer; return *this; }
 
+    /**
+     * @brief Set the value of a specialization constant in the shaders of this node.
+     * Each value compiles a separate pipeline, constant ids which the shaders don't declare are ignored.
+     */
+    inline ComputeNode& specialize(u32 id, u32 value) { add_constant(id, value); return *this; }
+    inline ComputeNode& specialize(u32 id, i32 value) { add_constant(id, (u32)value); return *this; }
+    inline ComputeNode& specialize(u32 id, f32 value) { add_constant(id, constant_bits(value)); return *this; }
+    inline ComputeNode& specialize(u32 id, bool value) { add_constant(id, value ? 1u : 0u); return *this; }
+
+    /* Pin this node, pinned nodes are never culled. (ex: for side effects outside of the graph) */
+    inline ComputeNode& pin() { set_pinned(); return *this; }
+
+    /**
+     * @brief Set what to do when the pipeline of this node isn't compiled yet. (default: `Block`)
+     * Skipped nodes don't write their outputs, so only skip nodes whose outputs may be stale for a few frames.
+     */
+    inline ComputeNode& on_pipeline_miss(PipelineMiss policy) { miss_policy = policy; return *this; }
+
+    /**
+     * @brief Hint that this node can run on the async compute queue, overlapping with raster work.
+     * Only used if the graph async compute policy is `Hinted`, and ignored for nodes which use the render target.
+     */
+    ComputeNode& async();
+
     /* To access constructors */
     friend class AgnRenderGraph;
 };
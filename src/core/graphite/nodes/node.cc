@@ -1,9 +1,46 @@
 #include "node.hh"
 
+#include "graphite/utils/hash.hh"
+
 Dependency::Dependency(BindHandle resource, DependencyFlags flags, DependencyStages stages)
     : resource(resource), flags(flags), stages(stages) {}
 
-Node::Node(std::string_view label, NodeType type) : label(label), type(type) {
+Node::Node(std::string_view label, NodeType type, FrameArena& arena)
+    : label(label), type(type), dependencies(ArenaAllocator<Dependency>(arena)), structure_hash(hash_mix((u64)type)), pipeline_hash(hash_mix((u64)type)), constants(ArenaAllocator<SpecConstant>(arena)) {
     /* Reserve space for at least 12 dependencies */
     dependencies.reserve(12);
 }
+
+void Node::add_dependency(BindHandle resource, DependencyFlags flags, DependencyStages stages) {
+    dependencies.emplace_back(resource, flags, stages);
+
+    /* Update the structure hash */
+    const u64 packed = (u64)resource.raw() | ((u64)flags << 32u) | ((u64)stages << 48u);
+    structure_hash = hash_combine(structure_hash, packed);
+
+    /* Update the pipeline hash (vertex buffers are not part of the pipeline) */
+    if (has_flag(flags, DependencyFlags::Unbound) && has_flag(flags, DependencyFlags::Attachment) == false) return;
+    const u64 signature = (u64)resource.get_type() | ((u64)flags << 32u) | ((u64)stages << 48u);
+    pipeline_hash = hash_combine(pipeline_hash, signature);
+}
+
+void Node::add_constant(u32 id, u32 value) {
+    /* Find where the constant goes, keeping the constants sorted by id */
+    u32 i = 0u;
+    while (i < constants.size() && constants[i].id < id) ++i;
+
+    /* Overwrite the constant if it was already set */
+    if (i < constants.size() && constants[i].id == id) {
+        constants[i].value = value;
+        return;
+    }
+    constants.insert(constants.begin() + i, SpecConstant { id, value });
+}
+
+void Node::set_pinned() {
+    if (pinned) return;
+    pinned = true;
+
+    /* Update the structure hash */
+    structure_hash = hash_combine(structure_hash, 1u);
+}
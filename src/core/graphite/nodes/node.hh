@@ -1,10 +1,12 @@
 #pragma once
 
 #include <vector>
+#include <cstring>
 #include <string_view>
 #include <variant>
 
 #include "graphite/resources/handle.hh"
+#include "graphite/utils/arena.hh"
 #include "graphite/utils/enum_flags.hh"
 #include "graphite/utils/types.hh"
 
@@ -36,6 +38,25 @@ struct Dependency {
     Dependency(BindHandle resource, DependencyFlags flags, DependencyStages stages);
 };
 
+/* Specialization constant of a node, applied to all of its shader stages. */
+struct SpecConstant {
+    u32 id = 0u; /* Constant id in the shaders. (`constant_id` / `[[vk::constant_id(...)]]`) */
+    u32 value = 0u; /* Raw bits of the constant value. (booleans are 0 or 1) */
+};
+
+/* Get the raw bits of a floating point specialization constant value. */
+inline u32 constant_bits(f32 value) {
+    u32 bits = 0u;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+/* What a node does when its pipeline isn't compiled yet. */
+enum class PipelineMiss : u32 {
+    Block = 0u, /* Wait for the pipeline to compile. */
+    Skip = 1u,  /* Skip the node until its pipeline is compiled in the background. */
+};
+
 /* Render Graph node type. */
 enum class NodeType : u32 {
     Invalid = 0u,
@@ -55,10 +76,38 @@ public:
     /* Node type. */
     NodeType type = NodeType::Invalid;
 
-    /* List of node resource dependencies. */
-    std::vector<Dependency> dependencies {};
+    /* List of node resource dependencies. (allocated from the graph node arena) */
+    ArenaVector<Dependency> dependencies {};
+
+    /* Hash of the node structure. (type, shader paths & dependencies) */
+    u64 structure_hash = 0u;
+
+    /**
+     * Hash of the pipeline state. (type, shader paths & binding signature)
+     * Resource specific state (descriptor types & attachment formats), specialization constants and raster state
+     * which the platform can't set while recording (ex: vertex input) are added by the pipeline cache.
+     */
+    u64 pipeline_hash = 0u;
+
+    /* List of specialization constants, sorted by id. (allocated from the graph node arena) */
+    ArenaVector<SpecConstant> constants {};
+
+    /* Pinned nodes are never culled. */
+    bool pinned = false;
+
+    /* What to do when the pipeline of this node isn't compiled yet. */
+    PipelineMiss miss_policy = PipelineMiss::Block;
 
     Node() = delete;
-    Node(std::string_view label, NodeType type);
+    Node(std::string_view label, NodeType type, FrameArena& arena);
     virtual ~Node() = default;
+
+    /* Add a resource dependency to the node, and fold it into the structure hash. */
+    void add_dependency(BindHandle resource, DependencyFlags flags, DependencyStages stages);
+
+    /* Set the value of a specialization constant, overwriting its earlier value. */
+    void add_constant(u32 id, u32 value);
+
+    /* Pin the node so it is never culled, and fold it into the structure hash. */
+    void set_pinned();
 };
@@ -1,22 +1,33 @@
 #include "raster_node.hh"
 
-RasterNode::RasterNode(std::string_view label, std::string_view vx_path, std::string_view px_path)
-    : Node(label, NodeType::Raster), vertex_path(vx_path), pixel_path(px_path) {}
+#include "graphite/utils/hash.hh"
+
+RasterNode::RasterNode(std::string_view label, std::string_view vx_path, std::string_view px_path, FrameArena& arena)
+    : Node(label, NodeType::Raster, arena),
+      vertex_path(vx_path),
+      pixel_path(px_path),
+      attributes(ArenaAllocator<AttrFormat>(arena)),
+      draws(ArenaAllocator<DrawCall>(arena)) {
+    structure_hash = hash_combine(structure_hash, hash_string(vx_path));
+    structure_hash = hash_combine(structure_hash, hash_string(px_path));
+    pipeline_hash = hash_combine(pipeline_hash, hash_string(vx_path));
+    pipeline_hash = hash_combine(pipeline_hash, hash_string(px_path));
+}
 
 RasterNode& RasterNode::write(BindHandle resource, ShaderStages stages) {
     /* Insert the write dependency */
-    dependencies.emplace_back(resource, DependencyFlags::None, stages);
+    add_dependency(resource, DependencyFlags::None, stages);
     return *this;
 }
 
 RasterNode& RasterNode::read(BindHandle resource, ShaderStages stages) {
     /* Insert the read dependency */
-    dependencies.emplace_back(resource, DependencyFlags::Readonly, stages);
+    add_dependency(resource, DependencyFlags::Readonly, stages);
     return *this;
 }
 
 RasterNode& RasterNode::attach(BindHandle resource) {
-    dependencies.emplace_back(resource, DependencyFlags::Attachment | DependencyFlags::Unbound, DependencyStages::Pixel);
+    add_dependency(resource, DependencyFlags::Attachment | DependencyFlags::Unbound, DependencyStages::Pixel);
     return *this;
 }
 
@@ -25,6 +36,15 @@ RasterNode& RasterNode::raster_extent(const u32 w, const u32 h, const u32 x, con
     raster_h = h;
     raster_x = x;
     raster_y = y;
+
+    /* Update the structure hash (raster nodes are only merged if their extents match) */
+    structure_hash = hash_combine(structure_hash, ((u64)w << 32u) | h);
+    structure_hash = hash_combine(structure_hash, ((u64)x << 32u) | y);
+    return *this;
+}
+
+RasterNode& RasterNode::pin() {
+    set_pinned();
     return *this;
 }
 
@@ -51,6 +71,9 @@ RasterNode& RasterNode::topology(const Topology type) {
 
 RasterNode& RasterNode::load_op(const LoadOp op) {
     pixel_load_op = op;
+
+    /* Update the structure hash (clearing raster nodes are never merged) */
+    structure_hash = hash_combine(structure_hash, (u64)op);
     return *this;
 }
 
@@ -64,14 +87,14 @@ DrawCall::DrawCall(
       vertex_offset(vertex_offset),
       instance_count(instance_count),
       instance_offset(instance_offset) {
-    parent_pass.dependencies.emplace_back(
+    parent_pass.add_dependency(
         vertex_buffer, DependencyFlags::Readonly | DependencyFlags::Unbound, DependencyStages::Vertex
     );
 }
 
 DrawCall::DrawCall(RasterNode& parent_pass, const Buffer vertex_buffer, const Buffer indirect_buffer)
     : parent_pass(parent_pass), vertex_buffer(vertex_buffer), indirect_buffer(indirect_buffer) {
-    parent_pass.dependencies.emplace_back(
+    parent_pass.add_dependency(
         vertex_buffer, DependencyFlags::Readonly | DependencyFlags::Unbound, DependencyStages::Vertex
     );
 }
\ No newline at end of file
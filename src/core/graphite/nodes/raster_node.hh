@@ -37,7 +37,7 @@ enum class LoadOp : u32 {
 class RasterNode : public Node {
     /* Can only be constructed by the RenderGraph */
     RasterNode() = default;
-    RasterNode(std::string_view label, std::string_view vx_path, std::string_view fg_path);
+    RasterNode(std::string_view label, std::string_view vx_path, std::string_view fg_path, FrameArena& arena);
 
    public:
     /* Shader file paths */
@@ -45,15 +45,15 @@ class RasterNode : public Node {
     std::string_view pixel_path {};
 
     /* Vertex shader attributes */
-    std::vector<AttrFormat> attributes {};
+    ArenaVector<AttrFormat> attributes {};
     Topology prim_topology = Topology::Invalid;
     LoadOp pixel_load_op = LoadOp::Load;
 
     /* Extents */
     u32 raster_w = 0u, raster_h = 0u, raster_x = 0u, raster_y = 0u;
 
-    /* Draw calls */
-    std::vector<DrawCall> draws {};
+    /* Draw calls (allocated from the graph node arena) */
+    ArenaVector<DrawCall> draws {};
 
     /* No copies allowed */
     RasterNode(const RasterNode&) = delete;
@@ -80,6 +80,24 @@ class RasterNode : public Node {
     /* Set the raster extent of the raster pass. (the extent of the attachments to rasterize into) */
     RasterNode& raster_extent(const u32 w, const u32 h, const u32 x = 0u, const u32 y = 0u);
 
+    /**
+     * @brief Set the value of a specialization constant in the shaders of this node.
+     * Each value compiles a separate pipeline, constant ids which the shaders don't declare are ignored.
+     */
+    inline RasterNode& specialize(u32 id, u32 value) { add_constant(id, value); return *this; }
+    inline RasterNode& specialize(u32 id, i32 value) { add_constant(id, (u32)value); return *this; }
+    inline RasterNode& specialize(u32 id, f32 value) { add_constant(id, constant_bits(value)); return *this; }
+    inline RasterNode& specialize(u32 id, bool value) { add_constant(id, value ? 1u : 0u); return *this; }
+
+    /* Pin this node, pinned nodes are never culled. (ex: for side effects outside of the graph) */
+    RasterNode& pin();
+
+    /**
+     * @brief Set what to do when the pipeline of this node isn't compiled yet. (default: `Block`)
+     * Skipped nodes don't draw anything, so only skip nodes whose outputs may be stale for a few frames.
+     */
+    inline RasterNode& on_pipeline_miss(PipelineMiss policy) { miss_policy = policy; return *this; }
+
     /* Create a draw call for this raster pass. */
     DrawCall& draw(
         const Buffer vertex_buffer, const u32 vertex_count, const u32 vertex_offset = 0u, const u32 instance_count = 1u,
@@ -1,13 +1,26 @@
 #include "render_graph.hh"
 
-#include <unordered_map>
+#include <new>
+#include <utility>
 
 #include "vram_bank.hh"
+#include "utils/hash.hh"
 #include "nodes/compute_node.hh"
 #include "nodes/raster_node.hh"
 
 #define DEBUG_LOGGING 0
 
+/* Returns true if the dependencies of the nodes are exactly the resources in a list, in the same order. */
+static bool same_resources(const std::vector<Node*>& nodes, const std::vector<BindHandle>& resources) {
+    u32 index = 0u;
+    for (const Node* node : nodes) {
+        for (const Dependency& dep : node->dependencies) {
+            if (index >= resources.size() || resources[index++].raw() != dep.resource.raw()) return false;
+        }
+    }
+    return index == resources.size();
+}
+
 const GraphExecution &AgnRenderGraph::active_graph() const { return graphs[active_graph_index]; }
 
 GraphExecution &AgnRenderGraph::active_graph() { return graphs[active_graph_index]; }
@@ -26,16 +39,19 @@ Result<void> AgnRenderGraph::new_graph(u32 node_count) {
     VRAMBank& bank = gpu->get_vram_bank();
     if (Result r = wait_until_safe(); r.is_err()) return r;
 
-    /* Decrement reference counters for all resources used in the graph */
+    /* Destroy the nodes, and release their memory all at once */
     for (Node* old_node : nodes) {
-        delete old_node;
+        old_node->~Node();
     }
+    node_arena.reset();
     
     /* Remove immediate mode gui & render target */
     imgui = nullptr;
     target = RenderTarget();
 
-    /* Reset the nodes & waves */
+    /* Reset the nodes, waves, external & transient resources */
+    external_resources.clear();
+    transients.clear();
     nodes.clear();
     nodes.reserve(node_count);
     waves.clear();
@@ -43,114 +59,107 @@ Result<void> AgnRenderGraph::new_graph(u32 node_count) {
     return Ok();
 }
 
-/* Collection of metadata for a graph node. (used during graph compilation) */
-struct NodeMeta {
-    /* List of versions, one for each dependency. */
-    std::vector<u32> versions {};
-    /* List of sources (node indices), one for each dependency. */
-    std::vector<u32> sources {};
-    /* Number of input & output nodes. */
-    u32 input_nodes = 0u, output_nodes = 0u;
-};
-
-/* Dependency hashmap key. */
-inline u32 dependency_key(const Dependency& dep) {
-    return dep.resource.raw();
-}
-
 Result<void> AgnRenderGraph::end_graph() {
-    /* Resource version hashmap (key: handle, value: version) */
-    std::unordered_map<u32, u32> version_map {};
-    /* Resource source hashmap (key: handle, value: source_node_index) */
-    std::unordered_map<u32, u32> source_map {};
-
     /* Reset the current render target to NULL */
     VRAMBank& bank = gpu->get_vram_bank();
 
-    /* Increment reference counters for all resources used in the graph */
-    std::vector<BindHandle> prev_resources = resources[active_graph_index];
-    resources[active_graph_index].clear();
-    for (Node* node : nodes) {
-        for (const Dependency& dep : node->dependencies) {
-            resources[active_graph_index].push_back(dep.resource);
-            bank.add_reference(dep.resource);
-            if (dep.resource.get_type() == ResourceType::Image) {
-                /* For images, we also need to add a reference to the underlying texture */
-                bank.add_reference(bank.get_texture((Image&)dep.resource));
-            }
-        }
+    /* Combine the structure hashes of all nodes */
+    u64 structure_hash = hash_mix((u64)nodes.size());
+    for (const Node* node : nodes) {
+        structure_hash = hash_combine(structure_hash, node->structure_hash);
     }
-
-    /* Decrement reference counters for all resources previously used in the graph */
-    for (BindHandle resource : prev_resources) {
-        bank.remove_reference(resource);
-        if (resource.get_type() == ResourceType::Image) {
-            /* For images, we also need to add a reference to the underlying texture */
-            bank.remove_reference(bank.get_texture((Image&)resource));
+    const u64 resources_hash = structure_hash;
+
+    /* External resources, culling, merging & async compute only affect the schedule */
+    const AsyncCompute async_policy = async_supported ? async_compute : AsyncCompute::Disabled;
+    compiler.set_async(async_policy);
+    structure_hash = hash_combine(structure_hash, pass_culling ? 1u : 0u);
+    structure_hash = hash_combine(structure_hash, pass_merging ? 1u : 0u);
+    structure_hash = hash_combine(structure_hash, (u64)async_policy);
+    if (pass_culling) {
+        for (const BindHandle resource : external_resources) {
+            structure_hash = hash_combine(structure_hash, resource.raw());
         }
     }
 
-    /* Propegate dependency versions through the graph */
-    std::vector<NodeMeta> node_meta(nodes.size());
-    for (u32 i = 0u; i < nodes.size(); ++i) {
-        /* Get the node and its metadata */
-        const Node* node = nodes[i];
-        NodeMeta& meta = node_meta[i];
-
-        /* Initialize the node metadata */
-        meta.versions.resize(node->dependencies.size());
-        meta.sources.resize(node->dependencies.size());
-
-        for (u32 j = 0u; j < node->dependencies.size(); ++j) {
-            /* Get the dependency and its version */
-            const Dependency& dep = node->dependencies[j];
-            const u32 key = dependency_key(dep);
-            u32& dep_version = meta.versions[j];
-
-            /* Set the version of the dependency from the hashmap */
-            dep_version = version_map[key];
-            
-            /* Record which pass this dependency comes from, UINT32_MAX if first time used */
-            if (dep_version == 0u) {
-                meta.sources[j] = UINT32_MAX;
-            } else {
-                meta.sources[j] = source_map[key];
-                node_meta[meta.sources[j]].output_nodes += 1u;
-                meta.input_nodes += 1u; /* <- increment input node count */
+    /* Reference counts only change if this graph execution last held different resources (the hash can collide, so check them) */
+    if (resource_hashes[active_graph_index] != resources_hash || same_resources(nodes, resources[active_graph_index]) == false) {
+        resource_hashes[active_graph_index] = resources_hash;
+
+        /* Increment reference counters for all resources used in the graph */
+        std::swap(retired_resources, resources[active_graph_index]);
+        resources[active_graph_index].clear();
+        for (Node* node : nodes) {
+            for (const Dependency& dep : node->dependencies) {
+                resources[active_graph_index].push_back(dep.resource);
+                bank.add_reference(dep.resource);
+                if (dep.resource.get_type() == ResourceType::Image) {
+                    /* For images, we also need to add a reference to the underlying texture */
+                    bank.add_reference(bank.get_texture((Image&)dep.resource));
+                }
             }
+        }
 
-            /* Update the version and source hashmaps in case this resource is written to */
-            if (has_flag(dep.flags, DependencyFlags::Readonly) == false) {
-                version_map[key] += 1u; /* <- increment version */
-                source_map[key] = i; /* <- store source node index */
-
-                /* Save this resource if it is a render target */
-                if (dep.resource.get_type() == ResourceType::RenderTarget) {
-                    if (target.is_null() == false && target.raw() != dep.resource.raw()) { 
-                        return Err("multiple render targets are not allowed in the same graph.");
-                    }
-                    target = (RenderTarget&)dep.resource;
-                }
+        /* Decrement reference counters for all resources previously used in the graph */
+        for (BindHandle resource : retired_resources) {
+            bank.remove_reference(resource);
+            if (resource.get_type() == ResourceType::Image) {
+                /* For images, we also need to add a reference to the underlying texture */
+                bank.remove_reference(bank.get_texture((Image&)resource));
             }
         }
     }
 
+    /* Compile the nodes into waves using topology sorting */
+    if (Result r = compiler.compile(nodes, structure_hash, external_resources, waves, target); r.is_err()) return r;
+
+    /* Find the lifetime of each transient resource, and place them in memory */
+    compiler.transient_lifetimes(nodes, waves, transients);
+    if (Result r = alloc_transients(); r.is_err()) return r;
+
+    /* Update the graph statistics */
+    stats.transients = (u32)transients.size();
+    stats.transient_naive = 0u;
+    stats.transient_peak = 0u;
+    for (const TransientResource& transient : transients) {
+        if (transient.is_used()) stats.transient_naive += transient.size;
+    }
+    for (const u64 heap_size : transient_heap_sizes) stats.transient_peak += heap_size;
+    stats.nodes = (u32)nodes.size();
+    stats.waves = waves.empty() ? 0u : waves.back().wave + 1u;
+    stats.culled = compiler.culled();
+    stats.async_nodes = 0u;
+    stats.merged_nodes = 0u;
+    for (const WaveLane& lane : waves) {
+        if (lane.async) stats.async_nodes += 1u;
+        if (lane.merged) stats.merged_nodes += 1u;
+    }
+    stats.queue_joins = 0u;
+    for (const WaveJoin& join : compiler.joins()) {
+        if (join.wait_async != UINT32_MAX) stats.queue_joins += 1u;
+        if (join.wait_combined != UINT32_MAX) stats.queue_joins += 1u;
+    }
+    stats.schedule_cached = compiler.was_cached();
+    if (stats.schedule_cached) stats.schedule_hits += 1u;
+    else stats.schedule_misses += 1u;
+
 #if DEBUG_LOGGING
-    /* Debug logging */
-    for (u32 i = 0u; i < nodes.size(); ++i) {
-        /* Get the node and its metadata */
+    /* Debug logging (compiler data is only available for uncached schedules) */
+    for (u32 i = 0u; compiler.was_cached() == false && i < nodes.size(); ++i) {
+        /* Get the node */
         const Node* node = nodes[i];
-        const NodeMeta& meta = node_meta[i];
+        u32 input_nodes = 0u;
 
-        printf("node '%s'\n", node->label.data());
+        if (compiler.is_culled(i)) printf("node '%s' [culled]\n", node->label.data());
+        else printf("node '%s'\n", node->label.data());
         printf("~ dependencies: [\n");
 
         for (u32 j = 0u; j < node->dependencies.size(); ++j) {
             /* Get the dependency and its version */
             const Dependency& dep = node->dependencies[j];
-            const u32 id = dependency_key(dep);
-            const u32 dep_version = meta.versions[j];
-            const u32 dep_source = meta.sources[j];
+            const u32 id = dep.resource.raw();
+            const u32 dep_version = compiler.version(i, j);
+            const u32 dep_source = compiler.source(i, j);
 
             /* Log the resource key and version */
             const bool readonly = has_flag(dep.flags, DependencyFlags::Readonly);
@@ -162,67 +171,18 @@ Result<void> AgnRenderGraph::end_graph() {
             if (is_rt) printf(", [RT]");
 
             /* Log the source of this resource */
-            if (dep_source < nodes.size()) printf(" <- '%s'", nodes[dep_source]->label.data());
+            if (dep_source < nodes.size()) {
+                printf(" <- '%s'", nodes[dep_source]->label.data());
+                input_nodes += 1u;
+            }
             
             printf("\n");
         }
         printf("]");
-        printf(" %u -> %u", meta.input_nodes, meta.output_nodes);
+        printf(" %u -> %u", input_nodes, compiler.consumers(i).size());
         printf("\n");
     }
-#endif
-
-    /* Re-use the resource version hashmap */
-    version_map.clear();
-
-    /* Compile the nodes into waves using topology sorting */
-    for (u32 wave = 0u;; ++wave) {
-        /* Find lanes with no unresolved dependencies */
-        std::vector<u32> next_wave {};
-        for (u32 lane = 0u; lane < nodes.size(); ++lane) {
-            /* Get the node and its metadata */
-            const Node* node = nodes[lane];
-            const NodeMeta& meta = node_meta[lane];
-
-            /* Look for unresolved dependencies in this node */
-            bool has_deps = false; 
-            for (u32 i = 0u; i < node->dependencies.size(); ++i) {
-                const Dependency& dep = node->dependencies[i];
-
-                if (meta.versions[i] == version_map[dependency_key(dep)]) continue;
-                has_deps = true;
-                break;
-            }
 
-            /* Found a node with no unresolved dependencies */
-            if (has_deps == false) next_wave.emplace_back(lane);
-        }
-
-        if (next_wave.empty()) break; /* No more waves left */
-
-        /* Update the outputs of this new wave for the next wave */
-        for (const u32 lane : next_wave) {
-            waves.emplace_back(wave, lane);
-
-            /* Get the node and its metadata */
-            const Node* node = nodes[lane];
-            NodeMeta& meta = node_meta[lane];
-
-            /* Make sure this node won't be included again */
-            for (u32& version : meta.versions) version = UINT32_MAX;
-
-            /* Update the resource versions */
-            for (u32 i = 0u; i < node->dependencies.size(); ++i) {
-                const Dependency& dep = node->dependencies[i];
-
-                if (has_flag(dep.flags, DependencyFlags::Readonly) == false) { 
-                    version_map[dependency_key(dep)] += 1;
-                }
-            }
-        }
-    }
-
-#if DEBUG_LOGGING
     /* Debug logging */
     for (u32 lane = 0u, wave = UINT32_MAX; lane < waves.size(); ++lane) {
         if (waves[lane].wave != wave) {
@@ -230,7 +190,8 @@ Result<void> AgnRenderGraph::end_graph() {
             printf("wave %u:\n", wave);
         }
         const Node* node = nodes[waves[lane].lane];
-        printf("[%u] node '%s'\n", wave, node->label.data());
+        if (waves[lane].async) printf("[%u] node '%s' [async]\n", wave, node->label.data());
+        else printf("[%u] node '%s'\n", wave, node->label.data());
     }
 #endif
     
@@ -239,14 +200,16 @@ Result<void> AgnRenderGraph::end_graph() {
 
 ComputeNode& AgnRenderGraph::add_compute_pass(std::string_view label, std::string_view shader_path) {
     /* Create the new compute node, and insert it into the nodes list. */
-    ComputeNode* new_node = new ComputeNode(label, shader_path);
+    void* memory = node_arena.alloc(sizeof(ComputeNode), alignof(ComputeNode));
+    ComputeNode* new_node = new (memory) ComputeNode(label, shader_path, node_arena);
     nodes.emplace_back((Node*)new_node);
     return *new_node;
 }
 
 RasterNode& AgnRenderGraph::add_raster_pass(std::string_view label, std::string_view vx_path, std::string_view px_path) {
     /* Create the new raster node, and insert it into the nodes list. */
-    RasterNode* new_node = new RasterNode(label, vx_path, px_path);
+    void* memory = node_arena.alloc(sizeof(RasterNode), alignof(RasterNode));
+    RasterNode* new_node = new (memory) RasterNode(label, vx_path, px_path, node_arena);
     nodes.emplace_back((Node*)new_node);
     return *new_node;
 }
@@ -5,17 +5,14 @@
 
 #include "platform/platform.hh"
 
+#include "graph_compiler.hh"
+#include "utils/arena.hh"
 #include "resources/handle.hh"
+#include "resources/buffer.hh"
+#include "resources/texture.hh"
 #include "utils/result.hh"
 #include "utils/types.hh"
 
-/* Graph wave lane pair. */
-struct WaveLane {
-    u32 wave = 0u; /* Index of the wave. */
-    u32 lane = 0u; /* Index of the node. */
-    WaveLane(u32 wave, u32 lane) : wave(wave), lane(lane) {}
-};
-
 class GPUAdapter;
 class ImGUI;
 
@@ -27,6 +24,58 @@ class Node;
 class ComputeNode;
 class RasterNode;
 
+/* How the nodes of a graph wait for the resources written by earlier nodes. */
+enum class SyncMode : u32 {
+    Waves = 0u, /* One barrier before each wave, waiting for all earlier writes at once. */
+    Events = 1u, /* Split barriers, each node waits for an event set right after the last node it depends on. */
+};
+
+/* How nodes bind their shaders & fixed function state. */
+enum class ShaderBackend : u32 {
+    Pipelines = 0u, /* Pipelines, compiled & cached for the state of each node. */
+    ShaderObjects = 1u, /* Shader objects & dynamic state, cached per shader. (no pipelines) */
+};
+
+/* Render graph statistics. (of the last compiled graph) */
+struct GraphStats {
+    u32 nodes = 0u; /* Number of nodes in the graph. */
+    u32 waves = 0u; /* Number of waves in the graph. */
+    u32 culled = 0u; /* Number of nodes culled from the graph. */
+    bool schedule_cached = false; /* Whether the schedule was re-used from the schedule cache. */
+    u64 schedule_hits = 0u; /* Total number of schedules re-used from the schedule cache. */
+    u64 schedule_misses = 0u; /* Total number of schedules compiled from scratch. */
+    u32 transients = 0u; /* Number of transient resources in the graph. */
+    u64 transient_peak = 0u; /* Bytes of memory used by the transient resources, with aliasing. */
+    u64 transient_naive = 0u; /* Bytes of memory the transient resources would use without aliasing. */
+    u32 async_nodes = 0u; /* Number of nodes running on the async compute queue. */
+    u32 merged_nodes = 0u; /* Number of raster nodes merged into the rendering scope of an earlier node. */
+    u32 queue_joins = 0u; /* Number of times a queue waits for the other queue. */
+    u32 barriers = 0u; /* Number of resource barriers recorded by the last dispatch. */
+    u32 naive_barriers = 0u; /* Number of resource barriers the last dispatch would record with one per dependency. */
+    u32 split_barriers = 0u; /* Number of split barriers (events) recorded by the last dispatch. */
+    f64 gpu_ms = 0.0; /* GPU time of the last finished dispatch of the active graph execution, 0 if unknown. */
+    u64 pipeline_hits = 0u; /* Total number of pipelines found in the in-memory pipeline cache. */
+    u64 pipeline_misses = 0u; /* Total number of pipelines not found in the in-memory pipeline cache. */
+    u64 pipeline_evictions = 0u; /* Total number of pipelines evicted from the in-memory pipeline cache. */
+    u32 pipelines_cached = 0u; /* Number of pipelines in the in-memory pipeline cache. */
+    u64 pipeline_bytes = 0u; /* Estimated driver memory used by the pipelines in the in-memory pipeline cache. */
+    u32 pipeline_layouts = 0u; /* Number of pipeline layouts, shared by the cached pipelines with the same bindings. */
+    u32 pipeline_libraries = 0u; /* Number of separately compiled raster pipeline parts. (if enabled, and the device supports it) */
+    u64 pipeline_library_hits = 0u; /* Number of times a raster pipeline re-used a part compiled for another pipeline. */
+    u32 shader_objects = 0u; /* Number of shader objects in use. (when using `ShaderBackend::ShaderObjects`) */
+    u64 shader_object_compiles = 0u; /* Total number of shader objects created, instead of `pipeline_compiles`. */
+    f64 shader_object_compile_ms = 0.0; /* Total CPU time spent creating shader objects, to compare with `pipeline_compile_ms`. */
+    u64 pipeline_compiles = 0u; /* Total number of pipelines created. */
+    u64 pipeline_disk_hits = 0u; /* Total number of created pipelines found in the persistent pipeline cache. (if reported by the driver) */
+    f64 pipeline_compile_ms = 0.0; /* Total CPU time spent creating pipelines. */
+    f64 pipeline_compile_max_ms = 0.0; /* Longest CPU time spent creating a single pipeline. */
+    u32 pipelines_pending = 0u; /* Number of pipelines compiling in the background after the last dispatch. */
+    u64 pipeline_skips = 0u; /* Total number of times a node was skipped because its pipeline was still compiling. */
+    f64 pipeline_latency_ms = 0.0; /* Total time from requesting to finishing the pipelines compiled in the background. */
+    f64 pipeline_latency_max_ms = 0.0; /* Longest time from requesting to finishing a pipeline compiled in the background. */
+    u64 pipelines_prewarmed = 0u; /* Total number of pipelines compiled by `prewarm(...)`. */
+};
+
 /**
  * @warning Never use this class directly!
  * This is an interface for the platform-specific class.
@@ -38,22 +87,63 @@ protected:
 
     /* List of nodes in the order in which they were queued. */
     std::vector<Node*> nodes {};
+    /* Arena backing the nodes, their dependencies & draw calls. (reset every new graph) */
+    FrameArena node_arena {};
+    /* Resources which are visible outside of the graph. (culling roots) */
+    std::vector<BindHandle> external_resources {};
+    /* Whether dead nodes are culled. */
+    bool pass_culling = false;
+    /* Whether consecutive raster nodes with the same attachments share a rendering scope. */
+    bool pass_merging = true;
+    /* Which compute nodes run on the async compute queue. */
+    AsyncCompute async_compute = AsyncCompute::Hinted;
+    /* Whether the platform can run nodes on the async compute queue. (set during init) */
+    bool async_supported = false;
+    /* How nodes wait for the resources written by earlier nodes. */
+    SyncMode sync_mode = SyncMode::Waves;
+    /* How nodes bind their shaders, the platform falls back to pipelines if it doesn't support the backend. */
+    ShaderBackend shader_backend = ShaderBackend::Pipelines;
+    /* Whether raster pipelines are linked from separately compiled parts, if the platform supports it. */
+    bool pipeline_libraries = false;
     /* Flattened list of waves and their lanes. (output of topology sorting) */
     std::vector<WaveLane> waves {};
     /* Each graph can have up to 1 render target. */
     RenderTarget target {};
+    /* Compiler used to sort the nodes into waves. */
+    GraphCompiler compiler {};
+    /* Statistics of the last compiled graph. */
+    GraphStats stats {};
+    /* Transient resources created for the current graph, in creation order. */
+    std::vector<TransientResource> transients {};
+    /* Size of each transient memory heap needed by the current graph. */
+    std::vector<u64> transient_heap_sizes {};
 
     /* Path to load shaders from. */
     std::string shader_path = ".";
+    /* Packed shader archive to load shaders from, empty if shaders are only loaded as loose files. */
+    std::string shader_archive_path {};
+    /* File to load the pipeline cache from & save it to, empty if it isn't persistent. */
+    std::string pipeline_cache_path {};
 
     /* Maximum number of graphs in flight. */
     u32 max_graphs_in_flight = 1u;
     /* Staging memory limit per graph in flight. */
     u64 graph_staging_limit = 65536u;
+    /* Number of worker threads used to record commands. */
+    u32 record_threads = 0u;
+    /* Number of worker threads used to compile pipelines in the background. */
+    u32 compile_threads = 1u;
+    /* Maximum number of cached pipelines, and their maximum estimated memory use. (0 for no limit) */
+    u32 max_pipelines = 1024u;
+    u64 max_pipeline_bytes = 0u;
 
     /* List of graph executions */
     GraphExecution* graphs = nullptr;
     std::vector<BindHandle>* resources = nullptr;
+    /* Structure hash of the graph which referenced the resources of each graph execution. */
+    u64* resource_hashes = nullptr;
+    /* Resources used by the previous graph in this slot, re-used every frame to avoid allocating. */
+    std::vector<BindHandle> retired_resources {};
     u32 active_graph_index = 0u;
     
     /* Get a reference to the active graph execution. */
@@ -68,17 +158,82 @@ protected:
     /* Wait until it's safe to create a new graph. */
     PLATFORM_SPECIFIC Result<void> wait_until_safe() = 0;
 
+    /* Place the transient resources of the graph in memory, using their lifetimes. */
+    PLATFORM_SPECIFIC Result<void> alloc_transients() = 0;
+
 public:
     /* Set the path from which to load shader files. (default: `"."`) */
     void set_shader_path(std::string path) { shader_path = path; };
+    /**
+     * @brief Set the packed shader archive to load shaders from, written by the `pack_shaders` tool. (default: `""`)
+     * Shaders which aren't in the archive are loaded from the shader path. An empty path only loads loose shader files.
+     */
+    void set_shader_archive(std::string path) { shader_archive_path = path; };
+    /**
+     * @brief Set the file to load the pipeline cache from during init, and save it to during deinit. (default: `""`)
+     * The file is ignored if it was saved by a different GPU or driver version. An empty path disables persistence.
+     */
+    void set_pipeline_cache_path(std::string path) { pipeline_cache_path = path; };
     /* Set the maximum number of graphs in flight. (default: `1`) */
     void set_max_graphs_in_flight(u32 max) { max_graphs_in_flight = max; };
     /* Set the staging memory limit per graph in flight. (default: `65536`) */
     void set_staging_limit(u64 bytes) { graph_staging_limit = bytes; };
+    /* Set the number of worker threads used to record commands, 0 records on the calling thread. (default: `0`) */
+    void set_record_threads(u32 count) { record_threads = count; };
+    /**
+     * @brief Set the number of worker threads compiling pipelines in the background. (default: `1`)
+     * Only nodes which skip on a pipeline miss use them, 0 compiles every pipeline while recording.
+     */
+    void set_compile_threads(u32 count) { compile_threads = count; };
+    /**
+     * @brief Set the budget of the pipeline cache, 0 for no limit. (default: `1024` pipelines, no byte limit)
+     * The least recently used pipelines are evicted once the number of pipelines or their estimated memory use exceeds it.
+     */
+    void set_pipeline_budget(u32 count, u64 bytes = 0u) { max_pipelines = count; max_pipeline_bytes = bytes; };
+    /* Enable culling of nodes whose outputs are never used. (default: `false`) */
+    void set_pass_culling(bool enable) { pass_culling = enable; compiler.set_culling(enable); };
+    /**
+     * @brief Enable merging consecutive raster nodes into one rendering scope. (default: `true`)
+     * Only nodes which render into the same attachments as the previous node, without clearing or otherwise using them, are merged.
+     */
+    void set_pass_merging(bool enable) { pass_merging = enable; compiler.set_merging(enable); };
+    /* Set the number of compiled graph schedules to keep cached, 0 disables the cache. (default: `4`) */
+    void set_schedule_cache_size(u32 count) { compiler.set_max_schedules(count); };
+    /**
+     * @brief Set which compute nodes run on the async compute queue. (default: `Hinted`)
+     * Only has an effect if async compute was enabled on the GPU adapter, and it has a separate compute queue.
+     */
+    void set_async_compute(AsyncCompute policy) { async_compute = policy; };
+    /* Set how nodes wait for the resources written by earlier nodes. (default: `Waves`) */
+    void set_sync_mode(SyncMode mode) { sync_mode = mode; };
+    /**
+     * @brief Set how nodes bind their shaders, should be called before `init(...)`. (default: `Pipelines`)
+     * Falls back to pipelines if the GPU doesn't support shader objects.
+     */
+    void set_shader_backend(ShaderBackend backend) { shader_backend = backend; };
+    /**
+     * @brief Link raster pipelines from separately compiled parts, shared between pipelines, should be called before `init(...)`. (default: `false`)
+     * Only has an effect if the GPU supports it. (VK_EXT_graphics_pipeline_library)
+     */
+    void set_pipeline_libraries(bool enable) { pipeline_libraries = enable; };
+
+    /* Get the statistics of the last compiled graph. */
+    const GraphStats& get_stats() const { return stats; };
 
     /* Initialize the Render Graph. */
     PLATFORM_SPECIFIC Result<void> init(GPUAdapter& gpu) = 0;
 
+    /**
+     * @brief Compile the pipelines listed in a manifest on all cores, so the first graphs don't miss the pipeline cache.
+     * Should be called after `init(...)`, does nothing if the manifest doesn't exist yet. (ex: on the first run)
+     * Pipelines which fail to compile (ex: because their shader was removed) are skipped with a warning.
+     * @param manifest_path Manifest file written by `save_pipeline_manifest(...)` during a previous run.
+     */
+    PLATFORM_SPECIFIC Result<void> prewarm(std::string_view manifest_path) = 0;
+
+    /* Write a manifest of all pipelines compiled so far, to `prewarm(...)` the next run with. */
+    PLATFORM_SPECIFIC Result<void> save_pipeline_manifest(std::string_view manifest_path) = 0;
+
     /**
      * @brief Start a new graph, this clear the graph.
      * 
@@ -110,6 +265,30 @@ public:
      */
     RasterNode& add_raster_pass(std::string_view label, std::string_view vx_path, std::string_view px_path);
     
+    /**
+     * @brief Mark a resource as visible outside of the graph, for this graph only.
+     * Nodes writing to it, and the nodes they depend on, are never culled. (ex: for read back or persistent data)
+     */
+    void mark_external(BindHandle resource) { external_resources.push_back(resource); };
+
+    /**
+     * @brief Create a transient texture, which is only valid for the current graph.
+     * Its memory is shared with transient resources which aren't used at the same time,
+     * so its contents are undefined when the graph first uses it.
+     * @return An image of the whole texture, which can be bound to the nodes of this graph.
+     */
+    PLATFORM_SPECIFIC Result<Image> create_transient_texture(TextureUsage usage, TextureFormat fmt, Size3D size, TextureMeta meta = TextureMeta()) = 0;
+
+    /**
+     * @brief Create a transient buffer, which is only valid for the current graph.
+     * Its memory is shared with transient resources which aren't used at the same time,
+     * so its contents are undefined when the graph first uses it.
+     * @param count If "stride" is 0 this represents the number of bytes in the buffer,
+     * otherwise it is the number of elements in the buffer.
+     * @param stride The size in bytes of an element in the buffer, leave 0 for Constant buffers.
+     */
+    PLATFORM_SPECIFIC Result<Buffer> create_transient_buffer(BufferUsage usage, u64 count, u64 stride = 0) = 0;
+
     /* Add an immediate mode gui to this render graph. */
     void add_imgui(ImGUI& gui, RenderTarget rt) { imgui = &gui; target = rt; };
     
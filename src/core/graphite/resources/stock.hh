@@ -35,7 +35,10 @@ class Stock {
     /* Create a Stack Pool of given size. */
     Stock(const u32 size) : stack(new Handle[size] {}), pool(new Slot[size] {}), refs(new u32[size] {}), stack_size(size) {
         /* Initialize the handle stack */
-        for (u32 i = 0u; i < size; ++i) stack[i] = reinterpret_cast<Handle&>(OpaqueHandle(i + 1u, RType));
+        for (u32 i = 0u; i < size; ++i) {
+            const OpaqueHandle handle = OpaqueHandle(i + 1u, RType);
+            stack[i] = reinterpret_cast<const Handle&>(handle);
+        }
     }
 
     /* Init the Stack Pool, clears out any existing data. */
@@ -49,7 +52,10 @@ class Stock {
         stack_size = size;
 
         /* Initialize the handle stack */
-        for (u32 i = 0u; i < size; ++i) stack[i] = reinterpret_cast<Handle&>(OpaqueHandle(i + 1u, RType));
+        for (u32 i = 0u; i < size; ++i) {
+            const OpaqueHandle handle = OpaqueHandle(i + 1u, RType);
+            stack[i] = reinterpret_cast<const Handle&>(handle);
+        }
     }
 
     /* Free the Stack Pool resources. */
@@ -66,8 +72,8 @@ class Stock {
     /* Pop a new resource off the stack. */
     StockPair<Slot, Handle> pop() {
         assert(stack_ptr < stack_size && "stock overflow!");
-        refs[stack_ptr] = 1u;
         const Handle handle = stack[stack_ptr++];
+        refs[handle.index - 1u] = 1u;
         Slot& data = pool[handle.index - 1u];
         return StockPair(handle, data);
     }
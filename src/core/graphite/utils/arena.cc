@@ -0,0 +1,60 @@
+#include "arena.hh"
+
+FrameArena::~FrameArena() {
+    /* Free all blocks */
+    while (head != nullptr) {
+        Block* prev = head->prev;
+        ::operator delete(head);
+        head = prev;
+    }
+}
+
+void FrameArena::grow(u64 min_size) {
+    /* Allocate the block & its header in one go */
+    const u64 size = min_size > block_size ? min_size : block_size;
+    Block* block = static_cast<Block*>(::operator new(sizeof(Block) + size));
+    block->prev = head;
+    block->size = size;
+    block->used = 0u;
+    head = block;
+    heap_allocs += 1u;
+}
+
+void* FrameArena::alloc(u64 size, u64 align) {
+    if (head != nullptr) {
+        /* Align the offset into the head block */
+        const u64 base = reinterpret_cast<u64>(head->data());
+        const u64 offset = ((base + head->used + align - 1u) & ~(align - 1u)) - base;
+        if (offset + size <= head->size) {
+            head->used = offset + size;
+            return head->data() + offset;
+        }
+    }
+
+    /* Head block is full, move on to a new block (with space for alignment) */
+    grow(size + align);
+    const u64 base = reinterpret_cast<u64>(head->data());
+    const u64 offset = ((base + align - 1u) & ~(align - 1u)) - base;
+    head->used = offset + size;
+    return head->data() + offset;
+}
+
+void FrameArena::reset() {
+    if (head == nullptr) return;
+
+    /* Only one block was used, simply rewind it */
+    if (head->prev == nullptr) {
+        head->used = 0u;
+        return;
+    }
+
+    /* Free all blocks, and replace them with one block large enough to hold all of them */
+    u64 total_size = 0u;
+    while (head != nullptr) {
+        Block* prev = head->prev;
+        total_size += head->size;
+        ::operator delete(head);
+        head = prev;
+    }
+    grow(total_size);
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <new>
+#include <vector>
+#include <cstddef>
+
+#include "types.hh"
+
+/**
+ * Frame Linear Arena.
+ * Bump allocator for short-lived allocations, all memory is released at once using `reset()`.
+ */
+class FrameArena {
+    /* Memory block, blocks are chained together when one runs out of space. */
+    struct Block {
+        Block* prev = nullptr;
+        u64 size = 0u; /* Usable size of the block. (excluding this header) */
+        u64 used = 0u;
+        inline u8* data() { return reinterpret_cast<u8*>(this + 1); }
+    };
+
+    Block* head = nullptr; /* Block currently being allocated from. */
+    u64 block_size = 0u; /* Minimum size of new blocks. */
+    u64 heap_allocs = 0u; /* Number of blocks allocated from the heap since creation. */
+
+    /* Allocate a new block from the heap, and make it the head block. */
+    void grow(u64 min_size);
+
+public:
+    FrameArena(u64 block_size = 65536u) : block_size(block_size) {}
+    ~FrameArena();
+
+    /* No copies allowed */
+    FrameArena(const FrameArena&) = delete;
+    FrameArena& operator=(const FrameArena&) = delete;
+
+    /* Allocate uninitialized memory from the arena. */
+    void* alloc(u64 size, u64 align = alignof(std::max_align_t));
+
+    /**
+     * @brief Release all allocations at once.
+     * If more than one block was used, they are merged into one block large enough for all of them,
+     * so that steady state frames do not allocate from the heap.
+     */
+    void reset();
+
+    /* Get the number of blocks allocated from the heap since creation. */
+    inline u64 get_heap_allocs() const { return heap_allocs; }
+};
+
+/**
+ * Frame Linear Arena allocator.
+ * Standard allocator adapter for containers backed by a `FrameArena`.
+ * Containers without an arena fall back to the heap.
+ */
+template<typename T>
+struct ArenaAllocator {
+    using value_type = T;
+
+    FrameArena* arena = nullptr;
+
+    ArenaAllocator() = default;
+    ArenaAllocator(FrameArena& arena) : arena(&arena) {}
+    template<typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other) : arena(other.arena) {}
+
+    inline T* allocate(std::size_t n) {
+        if (arena == nullptr) return static_cast<T*>(::operator new(n * sizeof(T)));
+        return static_cast<T*>(arena->alloc(n * sizeof(T), alignof(T)));
+    }
+
+    /* Arena memory is only released on reset. */
+    inline void deallocate(T* ptr, std::size_t) {
+        if (arena == nullptr) ::operator delete(ptr);
+    }
+
+    template<typename U>
+    inline bool operator==(const ArenaAllocator<U>& other) const { return arena == other.arena; }
+    template<typename U>
+    inline bool operator!=(const ArenaAllocator<U>& other) const { return arena != other.arena; }
+};
+
+/* Vector backed by a `FrameArena`. */
+template<typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
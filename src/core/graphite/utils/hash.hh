@@ -0,0 +1,30 @@
+#pragma once
+
+#include <string_view>
+
+#include "types.hh"
+
+/* Mix the bits of a 64 bit value. (splitmix64 finalizer) */
+inline u64 hash_mix(u64 x) {
+    x ^= x >> 30u;
+    x *= 0xbf58476d1ce4e5b9ull;
+    x ^= x >> 27u;
+    x *= 0x94d049bb133111ebull;
+    x ^= x >> 31u;
+    return x;
+}
+
+/* Combine a value into an existing hash. (order dependent) */
+inline u64 hash_combine(u64 seed, u64 value) {
+    return hash_mix(seed ^ (hash_mix(value) + 0x9e3779b97f4a7c15ull + (seed << 6u) + (seed >> 2u)));
+}
+
+/* Hash a string. (64 bit FNV-1a) */
+inline u64 hash_string(std::string_view str) {
+    u64 hash = 0xcbf29ce484222325ull;
+    for (const char c : str) {
+        hash ^= (u8)c;
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
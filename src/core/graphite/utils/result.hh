@@ -1,6 +1,7 @@
 #pragma once
 
 #include <string>
+#include <exception>
 
 /* Container namespace for result types */
 namespace result {
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <string_view>
+
+#include "hash.hh"
+#include "types.hh"
+
+/**
+ * Packed shader archive format, written by the `pack_shaders` tool.
+ *
+ * Layout: header, entries (sorted by alias hash), alias names, shader code.
+ * Shader code is aligned to 4 bytes, so it can be used straight from a memory-mapped archive.
+ */
+
+/* "GSAR" graphite shader archive. */
+constexpr u32 SHADER_ARCHIVE_MAGIC = 0x52415347u;
+constexpr u32 SHADER_ARCHIVE_VERSION = 1u;
+constexpr u64 SHADER_ARCHIVE_ALIGN = 4u;
+
+/* Header at the start of a shader archive. */
+struct ShaderArchiveHeader {
+    u32 magic = SHADER_ARCHIVE_MAGIC;
+    u32 version = SHADER_ARCHIVE_VERSION;
+    u32 entry_count = 0u;
+    u32 names_size = 0u; /* Bytes of alias names, right after the entries. */
+};
+
+/* Index entry of a shader in a shader archive. */
+struct ShaderArchiveEntry {
+    u64 alias_hash = 0u; /* Hash of the shader alias. (ex: `"image"` for `"image.spv"`) */
+    u32 name_offset = 0u, name_size = 0u; /* Alias name, relative to the start of the names. (to resolve hash collisions) */
+    u64 offset = 0u, size = 0u; /* Shader code, relative to the start of the archive. */
+    u64 code_hash = 0u; /* Hash of the shader code, to detect corrupted archives. */
+};
+
+/* Get the hash of a shader alias in a shader archive. */
+inline u64 shader_alias_hash(std::string_view alias) { return hash_string(alias); }
+
+/* Get the hash of the code of a shader in a shader archive. */
+inline u64 shader_code_hash(const void* code, u64 size) {
+    return hash_string(std::string_view((const char*)code, (size_t)size));
+}
@@ -0,0 +1,74 @@
+#include "thread_pool.hh"
+
+void ThreadPool::init(u32 thread_count) {
+    deinit(); /* Stop existing workers. */
+
+    stopping = false;
+    workers.reserve(thread_count);
+    for (u32 i = 0u; i < thread_count; ++i) {
+        workers.emplace_back(&ThreadPool::worker_main, this, i);
+    }
+}
+
+void ThreadPool::deinit() {
+    if (workers.empty()) return;
+
+    /* Wake up all workers, and tell them to stop */
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    work_cv.notify_all();
+
+    for (std::thread& worker : workers) worker.join();
+    workers.clear();
+}
+
+void ThreadPool::run(u32 count, JobFn fn, void* ctx) {
+    if (count == 0u) return;
+
+    /* Start the job */
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        job_fn = fn;
+        job_ctx = ctx;
+        task_count = count;
+        next_task.store(0u, std::memory_order_relaxed);
+        busy_workers = (u32)workers.size();
+        job_index += 1u;
+    }
+    work_cv.notify_all();
+
+    /* Wait for all workers to finish the job */
+    std::unique_lock<std::mutex> lock(mutex);
+    done_cv.wait(lock, [this] { return busy_workers == 0u; });
+}
+
+void ThreadPool::worker_main(u32 worker) {
+    u64 seen_job = 0u;
+
+    for (;;) {
+        /* Wait for a new job */
+        JobFn fn = nullptr;
+        void* ctx = nullptr;
+        u32 count = 0u;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            work_cv.wait(lock, [&] { return stopping || job_index != seen_job; });
+            if (stopping) return;
+            seen_job = job_index;
+            fn = job_fn;
+            ctx = job_ctx;
+            count = task_count;
+        }
+
+        /* Grab tasks until there are none left */
+        for (u32 task = next_task.fetch_add(1u); task < count; task = next_task.fetch_add(1u)) {
+            fn(ctx, task, worker);
+        }
+
+        /* Let the caller know once all workers are done */
+        std::lock_guard<std::mutex> lock(mutex);
+        if (--busy_workers == 0u) done_cv.notify_one();
+    }
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <type_traits>
+#include <condition_variable>
+
+#include "types.hh"
+
+/**
+ * Worker Thread Pool.
+ * Runs parallel-for style jobs on a fixed set of worker threads.
+ */
+class ThreadPool {
+    /* Job function. (context, task index, worker index) */
+    using JobFn = void (*)(void* ctx, u32 task, u32 worker);
+
+    std::vector<std::thread> workers {};
+    std::mutex mutex {};
+    std::condition_variable work_cv {}; /* Signalled when a new job is started. */
+    std::condition_variable done_cv {}; /* Signalled when all workers finished the job. */
+
+    /* Active job. */
+    JobFn job_fn = nullptr;
+    void* job_ctx = nullptr;
+    u32 task_count = 0u;
+    std::atomic<u32> next_task { 0u };
+
+    u64 job_index = 0u; /* Incremented for every job, wakes up the workers. */
+    u32 busy_workers = 0u; /* Workers which haven't finished the active job yet. */
+    bool stopping = false;
+
+    /* Worker thread main loop. */
+    void worker_main(u32 worker);
+
+    /* Run a job on the worker threads, and wait for it to finish. */
+    void run(u32 count, JobFn fn, void* ctx);
+
+public:
+    ThreadPool() = default;
+    ~ThreadPool() { deinit(); }
+
+    /* No copies allowed */
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    /* Start the worker threads. */
+    void init(u32 thread_count);
+
+    /* Stop & join the worker threads. */
+    void deinit();
+
+    /* Get the number of worker threads. */
+    inline u32 size() const { return (u32)workers.size(); }
+
+    /**
+     * @brief Call `fn(task, worker)` for every task in `[0, count)`, and wait for all of them to finish.
+     * Runs on the calling thread (as worker 0) if the pool has no worker threads.
+     */
+    template<typename Fn>
+    void parallel_for(u32 count, Fn&& fn) {
+        if (workers.empty()) {
+            for (u32 i = 0u; i < count; ++i) fn(i, 0u);
+            return;
+        }
+        using F = std::remove_reference_t<Fn>;
+        run(count, [](void* ctx, u32 task, u32 worker) { (*static_cast<F*>(ctx))(task, worker); }, (void*)&fn);
+    }
+};
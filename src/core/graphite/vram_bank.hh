@@ -1,5 +1,7 @@
 #pragma once
 
+#include <vector>
+
 #include "platform/platform.hh"
 
 #include "gpu_adapter.hh"
@@ -70,8 +72,8 @@ public:
     PLATFORM_SPECIFIC Result<Buffer> create_buffer(BufferUsage usage, u64 count, u64 stride = 0) = 0;
     /* Create a new texture resource. */
     PLATFORM_SPECIFIC Result<Texture> create_texture(TextureUsage usage, TextureFormat fmt, Size3D size, TextureMeta meta = TextureMeta()) = 0;
-    /* Create a new image resource. */
-    PLATFORM_SPECIFIC Result<Image> create_image(Texture texture, u32 mip = 0u, u32 layer = 0u) = 0;
+    /* Create a new image resource, covering `mips` mip levels starting at `mip`. (0 covers all remaining mip levels) */
+    PLATFORM_SPECIFIC Result<Image> create_image(Texture texture, u32 mip = 0u, u32 layer = 0u, u32 mips = 0u) = 0;
     /* Create a new sampler resource. */
     PLATFORM_SPECIFIC Result<Sampler> create_sampler(Filter filter = Filter::Linear, AddressMode mode = AddressMode::Repeat, BorderColor border = BorderColor::RGB0A0_Float) = 0;
 
@@ -101,7 +103,7 @@ public:
     friend class AgnRenderGraph;
 
     /* To access the get_buffer() function. */
-    friend Result<VkDescriptorSetLayout> node_descriptor_layout(GPUAdapter& gpu, const Node& node);
+    friend Result<void> node_descriptor_bindings(GPUAdapter& gpu, const Node& node, std::vector<VkDescriptorSetLayoutBinding>& bindings);
 };
 
 #include PLATFORM_INCLUDE(vram_bank)
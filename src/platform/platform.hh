@@ -23,11 +23,10 @@
 /* Concatenation macros. */
 #define __CAT(X,Y) X##Y
 #define CAT(X,Y) __CAT(X,Y)
-#define CAT_7(A, B, C, D, E, F, G) CAT(A, CAT(B, CAT(C, CAT(D, CAT(E, CAT(F, G))))))
 
 /* Stringification macros. */
 #define __STR(X) #X
 #define STR(X) __STR(X)
 
-/* Platform-specific file include macro. */
-#define PLATFORM_INCLUDE(BASE) STR(CAT_7(platform/, PLATFORM, /, BASE, _, PLATFORM_EXT, .hh))
+/* Platform-specific file include macro. (only pastes identifiers, so it also works with conforming preprocessors) */
+#define PLATFORM_INCLUDE(BASE) STR(platform/PLATFORM/CAT(BASE, CAT(_, PLATFORM_EXT)).hh)
@@ -1,5 +1,7 @@
 #include "gpu_adapter_vk.hh"
 
+#include <vector>
+
 #include "graphite/vram_bank.hh"
 #include "wrapper/extensions_vk.hh"
 #include "wrapper/device_selection_vk.hh"
@@ -93,21 +95,22 @@ Result<void> GPUAdapter::init(bool debug_mode) {
     /* Log the selected queue families */
     this->log(DebugSeverity::Info, strfmt("selected queues: G%u C%u T%u", queue_families.queue_combined, queue_families.queue_compute, queue_families.queue_transfer).data());
     
-    /* Vulkan device queue creation info */
+    /* Vulkan device queue creation info (one per unique queue family, they fall back to the combined queue family) */
     const float priority = 0.0f;
+    const u32 families[3] = { queue_families.queue_combined, queue_families.queue_compute, queue_families.queue_transfer };
     VkDeviceQueueCreateInfo device_queues_ci[3] {};
-    device_queues_ci[0].sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-    device_queues_ci[0].queueFamilyIndex = queue_families.queue_combined;
-    device_queues_ci[0].queueCount = 1u;
-    device_queues_ci[0].pQueuePriorities = &priority;
-    device_queues_ci[1].sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-    device_queues_ci[1].queueFamilyIndex = queue_families.queue_compute;
-    device_queues_ci[1].queueCount = 1u;
-    device_queues_ci[1].pQueuePriorities = &priority;
-    device_queues_ci[2].sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-    device_queues_ci[2].queueFamilyIndex = queue_families.queue_transfer;
-    device_queues_ci[2].queueCount = 1u;
-    device_queues_ci[2].pQueuePriorities = &priority;
+    u32 device_queue_count = 0u;
+    for (u32 i = 0u; i < 3u; ++i) {
+        bool duplicate = false;
+        for (u32 j = 0u; j < device_queue_count; ++j) duplicate |= device_queues_ci[j].queueFamilyIndex == families[i];
+        if (duplicate) continue;
+
+        VkDeviceQueueCreateInfo& queue_ci = device_queues_ci[device_queue_count++];
+        queue_ci.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+        queue_ci.queueFamilyIndex = families[i];
+        queue_ci.queueCount = 1u;
+        queue_ci.pQueuePriorities = &priority;
+    }
 
     /* Enable synchronization 2.0 features */
     VkPhysicalDeviceSynchronization2Features sync_features { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SYNCHRONIZATION_2_FEATURES };
@@ -126,20 +129,101 @@ Result<void> GPUAdapter::init(bool debug_mode) {
     vulkan_features.descriptorBindingStorageBufferUpdateAfterBind = true;
     vulkan_features.descriptorBindingPartiallyBound = true;
     vulkan_features.runtimeDescriptorArray = true;
+    vulkan_features.timelineSemaphore = true; /* For queue hand-offs */
 
     /* Enable modern device features */
     VkPhysicalDeviceFeatures device_features {};
     device_features.shaderInt64 = true; /* 64-bit integer support */
 
+    /* Enable the optional device extensions which are supported, and chain their features */
+    std::vector<const char*> extensions(device_ext, device_ext + device_ext_count);
+    void* features_chain = &vulkan_features;
+    const auto query_features = [&](void* features) {
+        VkPhysicalDeviceFeatures2 supported { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2 };
+        supported.pNext = features;
+        vkGetPhysicalDeviceFeatures2(physical_device, &supported);
+    };
+    creation_feedback = query_optional_extension(physical_device, VK_EXT_PIPELINE_CREATION_FEEDBACK_EXTENSION_NAME);
+    if (creation_feedback) extensions.push_back(VK_EXT_PIPELINE_CREATION_FEEDBACK_EXTENSION_NAME);
+
+    /* Graphics pipeline libraries, to compile the parts of raster pipelines separately (also needs the device feature) */
+    VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT library_features { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_FEATURES_EXT };
+    pipeline_library = query_optional_extension(physical_device, VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME)
+                    && query_optional_extension(physical_device, VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME);
+    if (pipeline_library) {
+        query_features(&library_features);
+        pipeline_library = library_features.graphicsPipelineLibrary == VK_TRUE;
+    }
+    if (pipeline_library) {
+        extensions.push_back(VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME);
+        extensions.push_back(VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME);
+        library_features.pNext = features_chain;
+        features_chain = &library_features;
+    }
+
+    /* Shader objects, to bind shaders & dynamic state instead of pipelines (also needs the device feature) */
+    VkPhysicalDeviceShaderObjectFeaturesEXT shader_object_features { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SHADER_OBJECT_FEATURES_EXT };
+    shader_object = query_optional_extension(physical_device, VK_EXT_SHADER_OBJECT_EXTENSION_NAME);
+    if (shader_object) {
+        query_features(&shader_object_features);
+        shader_object = shader_object_features.shaderObject == VK_TRUE;
+    }
+    if (shader_object) {
+        extensions.push_back(VK_EXT_SHADER_OBJECT_EXTENSION_NAME);
+        shader_object_features.pNext = features_chain;
+        features_chain = &shader_object_features;
+    }
+
+    /* Extended dynamic state 1 & 2, to set the topology, cull mode & primitive restart while recording */
+    VkPhysicalDeviceExtendedDynamicStateFeaturesEXT dynamic_features { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_FEATURES_EXT };
+    VkPhysicalDeviceExtendedDynamicState2FeaturesEXT dynamic2_features { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_2_FEATURES_EXT };
+    extended_dynamic_state = query_optional_extension(physical_device, VK_EXT_EXTENDED_DYNAMIC_STATE_EXTENSION_NAME)
+                          && query_optional_extension(physical_device, VK_EXT_EXTENDED_DYNAMIC_STATE_2_EXTENSION_NAME);
+    if (extended_dynamic_state) {
+        dynamic_features.pNext = &dynamic2_features;
+        query_features(&dynamic_features);
+        extended_dynamic_state = dynamic_features.extendedDynamicState == VK_TRUE && dynamic2_features.extendedDynamicState2 == VK_TRUE;
+    }
+    if (extended_dynamic_state) {
+        extensions.push_back(VK_EXT_EXTENDED_DYNAMIC_STATE_EXTENSION_NAME);
+        extensions.push_back(VK_EXT_EXTENDED_DYNAMIC_STATE_2_EXTENSION_NAME);
+        dynamic2_features.pNext = features_chain; /* <- already chained after the first features */
+        features_chain = &dynamic_features;
+    }
+
+    /* Extended dynamic state 3, only used if it allows changing the topology to any other topology class */
+    unrestricted_topology = false;
+    if (extended_dynamic_state && query_optional_extension(physical_device, VK_EXT_EXTENDED_DYNAMIC_STATE_3_EXTENSION_NAME)) {
+        VkPhysicalDeviceExtendedDynamicState3PropertiesEXT dynamic3_properties { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_3_PROPERTIES_EXT };
+        VkPhysicalDeviceProperties2 properties { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2 };
+        properties.pNext = &dynamic3_properties;
+        vkGetPhysicalDeviceProperties2(physical_device, &properties);
+        unrestricted_topology = dynamic3_properties.dynamicPrimitiveTopologyUnrestricted == VK_TRUE;
+    }
+    if (unrestricted_topology) extensions.push_back(VK_EXT_EXTENDED_DYNAMIC_STATE_3_EXTENSION_NAME);
+
+    /* Vertex input dynamic state, to set the vertex attributes while recording (also needs the device feature) */
+    VkPhysicalDeviceVertexInputDynamicStateFeaturesEXT vertex_input_features { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VERTEX_INPUT_DYNAMIC_STATE_FEATURES_EXT };
+    dynamic_vertex_input = query_optional_extension(physical_device, VK_EXT_VERTEX_INPUT_DYNAMIC_STATE_EXTENSION_NAME);
+    if (dynamic_vertex_input) {
+        query_features(&vertex_input_features);
+        dynamic_vertex_input = vertex_input_features.vertexInputDynamicState == VK_TRUE;
+    }
+    if (dynamic_vertex_input) {
+        extensions.push_back(VK_EXT_VERTEX_INPUT_DYNAMIC_STATE_EXTENSION_NAME);
+        vertex_input_features.pNext = features_chain;
+        features_chain = &vertex_input_features;
+    }
+
     /* Vulkan device creation info */
     VkDeviceCreateInfo device_ci { VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO };
-    device_ci.pNext = &vulkan_features;
-    device_ci.queueCreateInfoCount = 3u;
+    device_ci.pNext = features_chain;
+    device_ci.queueCreateInfoCount = device_queue_count;
     device_ci.pQueueCreateInfos = device_queues_ci;
     device_ci.enabledLayerCount = instance_layers_count;
     device_ci.ppEnabledLayerNames = instance_layers;
-    device_ci.enabledExtensionCount = device_ext_count;
-    device_ci.ppEnabledExtensionNames = device_ext;
+    device_ci.enabledExtensionCount = (u32)extensions.size();
+    device_ci.ppEnabledExtensionNames = extensions.data();
     device_ci.pEnabledFeatures = &device_features;
 
     /* Create a Vulkan logical device */
@@ -6,6 +6,8 @@
 #include "vulkan/api_vk.hh" /* Vulkan API */
 #include "wrapper/queue_selection_vk.hh"
 
+#include <vector>
+
 class Node;
 
 /**
@@ -21,10 +23,21 @@ class GPUAdapter : public AgnGPUAdapter {
     VkQueues queues {};
     VkCommandPool cmd_pool {};
 
+    /* Optional device extensions which are enabled. */
+    bool creation_feedback = false; /* VK_EXT_pipeline_creation_feedback */
+    bool pipeline_library = false; /* VK_EXT_graphics_pipeline_library */
+    bool shader_object = false; /* VK_EXT_shader_object */
+    bool extended_dynamic_state = false; /* VK_EXT_extended_dynamic_state & VK_EXT_extended_dynamic_state2 */
+    bool unrestricted_topology = false; /* VK_EXT_extended_dynamic_state3 (dynamic topology isn't limited to one topology class) */
+    bool dynamic_vertex_input = false; /* VK_EXT_vertex_input_dynamic_state */
+
     /* Vulkan debug / validation */
     bool validation = false;
     VkDebugUtilsMessengerEXT debug_messenger {};
 
+    /* Returns true if resources are shared with a separate async compute queue. */
+    inline bool has_async_queue() const { return async_compute && queue_families.queue_compute != queue_families.queue_combined; }
+
 public:
     /* Initialize the GPU adapter. */
     PLATFORM_SPECIFIC Result<void> init(bool debug_mode = false);
@@ -39,5 +52,6 @@ public:
     friend class ImGUI;
 
     /* To access VRAM Bank and logical device */
-    friend Result<VkDescriptorSetLayout> node_descriptor_layout(GPUAdapter& gpu, const Node& node);
+    friend Result<void> node_descriptor_bindings(GPUAdapter& gpu, const Node& node, std::vector<VkDescriptorSetLayoutBinding>& bindings);
+    friend Result<VkDescriptorSetLayout> descriptor_layout(GPUAdapter& gpu, const std::vector<VkDescriptorSetLayoutBinding>& bindings);
 };
@@ -1,11 +1,13 @@
 #include "render_graph_vk.hh"
 
 #include <utility>
+#include <algorithm>
 
 #include "graphite/imgui.hh"
 #include "graphite/vram_bank.hh"
 #include "graphite/nodes/node.hh"
 #include "graphite/nodes/compute_node.hh"
+#include "graphite/utils/hash.hh"
 #include "wrapper/translate_vk.hh"
 
 Result<void> RenderGraph::init(GPUAdapter& gpu) {
@@ -14,8 +16,18 @@ Result<void> RenderGraph::init(GPUAdapter& gpu) {
     /* Allocate graph executions ring buffer */
     graphs = new GraphExecution[max_graphs_in_flight] {};
     resources = new std::vector<BindHandle>[max_graphs_in_flight] {};
+    resource_hashes = new u64[max_graphs_in_flight] {};
     active_graph_index = 0u;
 
+    /* Size the graph compiler resource table to the resource limits */
+    compiler.init(gpu);
+
+    /* Transient buffers & textures sharing memory must be this far apart */
+    VkPhysicalDeviceProperties properties {};
+    vkGetPhysicalDeviceProperties(gpu.physical_device, &properties);
+    transient_granularity = std::max<u64>(properties.limits.bufferImageGranularity, 1u);
+    timestamp_period = properties.limits.timestampComputeAndGraphics ? (f64)properties.limits.timestampPeriod : 0.0;
+
     /* Command buffer allocation info */
     VkCommandBufferAllocateInfo cmd_ai { VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO };
     cmd_ai.commandPool = gpu.cmd_pool;
@@ -29,19 +41,33 @@ Result<void> RenderGraph::init(GPUAdapter& gpu) {
     /* Semaphore creation info */
     const VkSemaphoreCreateInfo sema_ci { VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO };
 
-    /* Graph staging buffer creation info */
+    /* Timestamp query pool creation info (start & end of the graph) */
+    VkQueryPoolCreateInfo query_ci { VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO };
+    query_ci.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    query_ci.queryCount = 2u;
+
+    /* Graph staging buffer creation info (only used by the transfer queue) */
     VkBufferCreateInfo staging_buffer_ci { VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO };
     staging_buffer_ci.size = graph_staging_limit;
     staging_buffer_ci.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
     staging_buffer_ci.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
     staging_buffer_ci.queueFamilyIndexCount = 1u;
-    staging_buffer_ci.pQueueFamilyIndices = &gpu.queue_families.queue_combined;
+    staging_buffer_ci.pQueueFamilyIndices = &gpu.queue_families.queue_transfer;
 
     /* Graph staging memory allocation info */
     VmaAllocationCreateInfo alloc_ci {};
     alloc_ci.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT | VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT;
     alloc_ci.usage = VMA_MEMORY_USAGE_AUTO;
 
+    /* Recorder command pool creation info (one per worker thread & queue family, per graph execution) */
+    VkCommandPoolCreateInfo recorder_pool_ci { VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO };
+    recorder_pool_ci.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    const u32 recorder_families[2] = { gpu.queue_families.queue_combined, gpu.queue_families.queue_compute };
+
+    /* Compute nodes can only run on the async compute queue if resources are shared with it */
+    async_supported = gpu.has_async_queue();
+    const u32 queue_count = async_supported ? 2u : 1u;
+
     /* Allocate graph execution resources */
     for (u32 i = 0u; i < max_graphs_in_flight; ++i) {
         if (vkAllocateCommandBuffers(gpu.logical_device, &cmd_ai, &graphs[i].cmd) != VK_SUCCESS)
@@ -50,19 +76,82 @@ Result<void> RenderGraph::init(GPUAdapter& gpu) {
             return Err("failed to create in-flight fence for graph.");
         if (vkCreateSemaphore(gpu.logical_device, &sema_ci, nullptr, &graphs[i].start_semaphore) != VK_SUCCESS)
             return Err("failed to create start semaphore for graph.");
+        if (timestamp_period > 0.0 && vkCreateQueryPool(gpu.logical_device, &query_ci, nullptr, &graphs[i].timestamps) != VK_SUCCESS)
+            return Err("failed to create timestamp query pool for graph.");
         
         /* Create the graph staging buffer & allocate it using VMA */
         if (vmaCreateBuffer(gpu.get_vram_bank().vma_allocator, &staging_buffer_ci, &alloc_ci, &graphs[i].staging_buffer, &graphs[i].staging_alloc, nullptr) != VK_SUCCESS) { 
             return Err("failed to create staging buffer for graph.");
         }
+
+        /* Create the recorder command pools */
+        graphs[i].recorders.resize(record_threads * queue_count);
+        for (u32 r = 0u; r < graphs[i].recorders.size(); ++r) {
+            recorder_pool_ci.queueFamilyIndex = recorder_families[r / record_threads];
+            if (vkCreateCommandPool(gpu.logical_device, &recorder_pool_ci, nullptr, &graphs[i].recorders[r].pool) != VK_SUCCESS)
+                return Err("failed to create recorder command pool for graph.");
+        }
+
+        /* Create the staging command pool & buffer */
+        recorder_pool_ci.queueFamilyIndex = gpu.queue_families.queue_transfer;
+        if (vkCreateCommandPool(gpu.logical_device, &recorder_pool_ci, nullptr, &graphs[i].staging_pool) != VK_SUCCESS)
+            return Err("failed to create staging command pool for graph.");
+        VkCommandBufferAllocateInfo staging_cmd_ai { VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO };
+        staging_cmd_ai.commandPool = graphs[i].staging_pool;
+        staging_cmd_ai.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        staging_cmd_ai.commandBufferCount = 1u;
+        if (vkAllocateCommandBuffers(gpu.logical_device, &staging_cmd_ai, &graphs[i].staging_cmd) != VK_SUCCESS)
+            return Err("failed to allocate staging command buffer for graph.");
+
+        /* Create the queue batch command pools */
+        for (u32 q = 0u; async_supported && q < 2u; ++q) {
+            recorder_pool_ci.queueFamilyIndex = recorder_families[q];
+            if (vkCreateCommandPool(gpu.logical_device, &recorder_pool_ci, nullptr, &graphs[i].batch_recorders[q].pool) != VK_SUCCESS)
+                return Err("failed to create queue batch command pool for graph.");
+        }
     }
 
-    /* Initialize the pipeline cache */
-    pipeline_cache.init(gpu);
+    /* Create the queue timelines */
+    VkSemaphoreTypeCreateInfo timeline_type_ci { VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO };
+    timeline_type_ci.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+    timeline_type_ci.initialValue = 0u;
+    VkSemaphoreCreateInfo timeline_ci { VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO };
+    timeline_ci.pNext = &timeline_type_ci;
+    for (u32 q = 0u; q < 3u; ++q) {
+        if (vkCreateSemaphore(gpu.logical_device, &timeline_ci, nullptr, &timelines[q].semaphore) != VK_SUCCESS)
+            return Err("failed to create queue timeline semaphore for graph.");
+        timelines[q].value = 0u;
+    }
+
+    /* Start the recording worker threads */
+    record_pool.init(record_threads);
+
+    /* Initialize the pipeline cache, loading the persistent cache file if there is one */
+    shader_objects = shader_backend == ShaderBackend::ShaderObjects && gpu.shader_object;
+    pipeline_cache.set_shader_objects(shader_objects);
+    pipeline_cache.set_pipeline_libraries(pipeline_libraries && gpu.pipeline_library);
+    if (Result r = pipeline_cache.init(gpu, pipeline_cache_path, compile_threads); r.is_err()) return r;
+    if (!shader_archive_path.empty()) {
+        if (Result r = pipeline_cache.open_archive(shader_archive_path); r.is_err()) return r;
+    }
+    pipeline_cache.set_budget(max_pipelines, max_pipeline_bytes);
 
     return Ok();
 }
 
+Result<void> RenderGraph::prewarm(std::string_view manifest_path) {
+    if (gpu == nullptr) return Err("tried to prewarm pipelines before initializing the render graph.");
+
+    /* Compile on all cores, nothing else is running before the first graph */
+    ThreadPool compile_pool {};
+    compile_pool.init(std::max(std::thread::hardware_concurrency(), 1u));
+    return pipeline_cache.prewarm(shader_path, manifest_path, compile_pool);
+}
+
+Result<void> RenderGraph::save_pipeline_manifest(std::string_view manifest_path) {
+    return pipeline_cache.save_manifest(manifest_path);
+}
+
 void RenderGraph::upload_buffer(Buffer& buffer, const void* data, u64 dst_offset, u64 size) {
     if (size == 0u) return; /* Return early if there's no data to upload */
 
@@ -102,9 +191,149 @@ void RenderGraph::upload_buffer(Buffer& buffer, const void* data, u64 dst_offset
     cmd.dst_resource = buffer;
 }
 
+TransientSlot& RenderGraph::next_transient(GraphExecution& graph, u64 desc_hash, bool& reused) {
+    const u32 index = (u32)transients.size();
+    if (index == graph.transients.size()) graph.transients.emplace_back();
+    TransientSlot& slot = graph.transients[index];
+
+    /* Release the previous resource in this slot if it was created differently */
+    reused = slot.resource.is_null() == false && slot.desc_hash == desc_hash;
+    if (reused == false) {
+        if (slot.resource.is_null() == false) gpu->get_vram_bank().destroy_unbound(slot.resource);
+        slot = TransientSlot {};
+        slot.desc_hash = desc_hash;
+    }
+    return slot;
+}
+
+Result<Image> RenderGraph::create_transient_texture(TextureUsage usage, TextureFormat fmt, Size3D size, TextureMeta meta) {
+    /* Hash the creation parameters */
+    u64 desc_hash = hash_mix((u64)ResourceType::Texture);
+    desc_hash = hash_combine(desc_hash, (u64)usage);
+    desc_hash = hash_combine(desc_hash, (u64)fmt);
+    desc_hash = hash_combine(desc_hash, ((u64)size.x << 32u) | size.y);
+    desc_hash = hash_combine(desc_hash, size.z);
+    desc_hash = hash_combine(desc_hash, ((u64)meta.mips << 32u) | meta.arrays);
+
+    /* Re-use the texture if the previous graph of this execution created the same one */
+    bool reused = false;
+    TransientSlot& slot = next_transient(active_graph(), desc_hash, reused);
+    if (reused == false) {
+        const Result image_result = gpu->get_vram_bank().create_unbound_texture(usage, fmt, size, meta);
+        if (image_result.is_err()) return Err(image_result.unwrap_err());
+        slot.resource = image_result.unwrap();
+    }
+
+    transients.emplace_back(slot.resource);
+    return Ok((Image&)slot.resource);
+}
+
+Result<Buffer> RenderGraph::create_transient_buffer(BufferUsage usage, u64 count, u64 stride) {
+    /* Hash the creation parameters */
+    u64 desc_hash = hash_mix((u64)ResourceType::Buffer);
+    desc_hash = hash_combine(desc_hash, (u64)usage);
+    desc_hash = hash_combine(desc_hash, stride == 0 ? count : count * stride);
+
+    /* Re-use the buffer if the previous graph of this execution created the same one */
+    bool reused = false;
+    TransientSlot& slot = next_transient(active_graph(), desc_hash, reused);
+    if (reused == false) {
+        const Result buffer_result = gpu->get_vram_bank().create_unbound_buffer(usage, count, stride);
+        if (buffer_result.is_err()) return Err(buffer_result.unwrap_err());
+        slot.resource = buffer_result.unwrap();
+    }
+
+    transients.emplace_back(slot.resource);
+    return Ok((Buffer&)slot.resource);
+}
+
+Result<void> RenderGraph::alloc_transients() {
+    GraphExecution& graph = active_graph();
+    VRAMBank& bank = gpu->get_vram_bank();
+
+    /* Release the transient resources which weren't created again by this graph */
+    while (graph.transients.size() > transients.size()) {
+        bank.destroy_unbound(graph.transients.back().resource);
+        graph.transients.pop_back();
+    }
+    transient_heap_sizes.clear();
+    if (transients.empty()) return Ok();
+
+    /* Get the memory requirements of the transient resources, resources with the same memory types share a heap */
+    for (TransientResource& transient : transients) {
+        const VkMemoryRequirements requirements = bank.unbound_requirements(transient.resource);
+        transient.size = requirements.size;
+        transient.align = std::max<u64>(requirements.alignment, transient_granularity);
+
+        u32 heap = 0u;
+        while (heap < graph.transient_heaps.size() && graph.transient_heaps[heap].type_bits != requirements.memoryTypeBits) heap++;
+        if (heap == graph.transient_heaps.size()) graph.transient_heaps.emplace_back().type_bits = requirements.memoryTypeBits;
+        transient.heap = heap;
+    }
+
+    /* Place the resources, resources which are never alive at the same time share memory */
+    compiler.place_transients(transients, transient_heap_sizes);
+
+    /* Grow the heaps which are too small */
+    for (u32 h = 0u; h < transient_heap_sizes.size(); ++h) {
+        TransientHeap& heap = graph.transient_heaps[h];
+        if (transient_heap_sizes[h] <= heap.size) continue;
+
+        /* Heap memory requirements (each resource is aligned relative to the start of the heap) */
+        VkMemoryRequirements requirements {};
+        requirements.size = transient_heap_sizes[h];
+        requirements.alignment = 1u;
+        requirements.memoryTypeBits = heap.type_bits;
+        for (const TransientResource& transient : transients) {
+            if (transient.heap == h) requirements.alignment = std::max(requirements.alignment, transient.align);
+        }
+
+        /* Memory allocation info */
+        VmaAllocationCreateInfo alloc_ci {};
+        alloc_ci.requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+
+        /* Resources bound to the old memory are re-bound below, the previous graph of this execution has finished */
+        if (heap.alloc != VK_NULL_HANDLE) vmaFreeMemory(bank.vma_allocator, heap.alloc);
+        heap.alloc = VK_NULL_HANDLE;
+        heap.size = 0u;
+        heap.generation += 1u;
+        if (vmaAllocateMemory(bank.vma_allocator, &requirements, &alloc_ci, &heap.alloc, nullptr) != VK_SUCCESS) {
+            return Err("failed to allocate transient memory heap for graph.");
+        }
+        heap.size = requirements.size;
+    }
+
+    /* Bind the resources whose placement changed */
+    for (u32 i = 0u; i < transients.size(); ++i) {
+        const TransientResource& transient = transients[i];
+        TransientSlot& slot = graph.transients[i];
+        if (transient.is_used() == false) continue;
+
+        /* The contents of transient resources are undefined when first used, and their memory may have been used by any earlier command */
+        if (transient.resource.get_type() == ResourceType::Image) {
+            bank.textures.get(bank.get_texture((Image&)transient.resource)).reset_subresources();
+        } else {
+            bank.buffers.get((Buffer&)transient.resource).state = ResourceState {};
+        }
+
+        const TransientHeap& heap = graph.transient_heaps[transient.heap];
+        if (slot.heap == transient.heap && slot.heap_generation == heap.generation && slot.offset == transient.offset) continue;
+
+        const bool rebind = slot.heap != UINT32_MAX;
+        if (Result r = bank.bind_unbound(transient.resource, heap.alloc, transient.offset, rebind); r.is_err()) return r;
+        slot.heap = transient.heap;
+        slot.heap_generation = heap.generation;
+        slot.offset = transient.offset;
+    }
+    return Ok();
+}
+
 Result<void> RenderGraph::dispatch() {
+    /* Report pipelines which failed to compile in the background since the last dispatch */
+    if (Result r = pipeline_cache.compile_errors(); r.is_err()) return r;
+
     /* Get the next graph in the graph executions ring buffer */
-    const GraphExecution& graph = active_graph();
+    GraphExecution& graph = active_graph();
 
     /* In nanoseconds (one second) */
     constexpr uint64_t TIMEOUT = 1'000'000'000u;
@@ -130,8 +359,18 @@ Result<void> RenderGraph::dispatch() {
         if (swapchain_result != VK_SUCCESS) {
             return Err("failed to acquire next swapchain image for render target.");
         }
+
+        /* The acquired image was last used by the presentation engine */
+        rt->state = ResourceState {};
     }
 
+    /* Evict pipelines over the cache budget, and destroy evicted pipelines which are no longer in flight */
+    pipeline_cache.next_frame(max_graphs_in_flight);
+
+    stats.barriers = 0u;
+    stats.naive_barriers = 0u;
+    stats.split_barriers = 0u;
+
     /* Begin recording commands to the graphs command buffer */
     VkCommandBufferBeginInfo cmd_begin { VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO };
     cmd_begin.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
@@ -139,63 +378,92 @@ Result<void> RenderGraph::dispatch() {
         return Err("failed to begin recording command buffer for graph.");
     }
 
-    /* Queue staging copy commands */
-    queue_staging(graph);
+    /* Read the GPU time of the previous graph of this execution (it has finished), and time this graph */
+    stats.gpu_ms = 0.0;
+    if (graph.timestamps != VK_NULL_HANDLE) {
+        u64 ticks[2] {};
+        if (graph.timed && vkGetQueryPoolResults(gpu->logical_device, graph.timestamps, 0u, 2u, sizeof(ticks), ticks, sizeof(u64), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS) {
+            stats.gpu_ms = (f64)(ticks[1] - ticks[0]) * timestamp_period / 1'000'000.0;
+        }
+        vkCmdResetQueryPool(graph.cmd, graph.timestamps, 0u, 2u);
+        vkCmdWriteTimestamp2KHR(graph.cmd, VK_PIPELINE_STAGE_2_TOP_OF_PIPE_BIT, graph.timestamps, 0u);
+        graph.timed = true;
+    }
 
-    /* Process all waves in the render graph */
-    for (u32 s = 0u, w = 0u, e = 0u; e <= waves.size(); ++e) {
-        /* If this lane is the start of a new wave */
-        if (e == waves.size() || waves[e].wave != w) {
-            w++;
-            const Result wave_result = queue_wave(graph, s, e);
-            if (wave_result.is_err()) return Err(wave_result.unwrap_err());
-            s = e;
+    /* Reset the queue batch command pools, the previous commands of this graph execution have finished */
+    for (CommandRecorder& recorder : graph.batch_recorders) {
+        if (recorder.pool == VK_NULL_HANDLE) continue;
+        if (vkResetCommandPool(gpu->logical_device, recorder.pool, 0u) != VK_SUCCESS) {
+            return Err("failed to reset queue batch command pool for graph.");
         }
+        recorder.used = 0u;
     }
 
+    /* The graphs command buffer is the first batch on the combined queue */
+    batches.clear();
+    batches.push_back(QueueBatch { false, graph.cmd, 0u, 0u, 0u });
+    open_batches[0] = 0u;
+    open_batches[1] = UINT32_MAX;
+    target_batch = UINT32_MAX;
+
+    /* Record the staging copies, they run on the transfer queue once the previous graphs are done with the buffers */
+    staging_start_value = timelines[0].value;
+    if (Result r = queue_staging(graph); r.is_err()) return r;
+
+    /* The async compute queue waits for the previous graphs on the combined queue */
+    async_start_value = timelines[0].value;
+
+    /* Process all waves in the render graph */
+    if (Result r = queue_waves(graph); r.is_err()) return r;
+    pipeline_cache.write_stats(stats);
+
+    /* The combined queue finishes the graph, so it waits for the async compute queue */
+    u64 async_waited = 0u, async_signalled = 0u;
+    for (const QueueBatch& batch : batches) {
+        if (batch.async == false) async_waited = std::max(async_waited, batch.wait_value);
+    }
+    if (open_batches[1] != UINT32_MAX) close_batch(true);
+    for (const QueueBatch& batch : batches) {
+        if (batch.async) async_signalled = std::max(async_signalled, batch.signal_value);
+    }
+    /* It also waits for the staging copies, the staging buffer is re-used once the graph is out of flight */
+    const u64 async_wait = async_signalled > async_waited ? async_signalled : 0u;
+    const u64 staging_wait = staging_waited[0] ? 0u : staging_value;
+    if (async_wait != 0u || staging_wait != 0u) {
+        if (open_batches[0] != UINT32_MAX) close_batch(false);
+        if (Result r = open_batch(graph, false, async_wait, staging_wait); r.is_err()) return r;
+    } else if (open_batches[0] == UINT32_MAX) {
+        if (Result r = open_batch(graph, false, 0u); r.is_err()) return r;
+    }
+    const VkCommandBuffer final_cmd = batches[open_batches[0]].cmd;
+
+    /* If no wave used the render target, the final batch waits for it to be acquired */
+    if (target_batch == UINT32_MAX) target_batch = open_batches[0];
+
     /* Queue immediate mode GUI render commands */
-    queue_imgui(graph);
+    queue_imgui(final_cmd);
 
-    /* Insert render target pipeline barrier at the end of the command buffer */
+    /* Insert render target pipeline barrier at the end of the command buffer (the render signal waits for it) */
     if (has_target) {
-        VkImageMemoryBarrier rt_barrier { VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER };
-        rt_barrier.oldLayout = rt->old_layout();
-        rt_barrier.newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
-        rt->old_layout() = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
-        rt_barrier.image = rt->image();
-        rt_barrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0u, 1u, 0u, 1u };
-        vkCmdPipelineBarrier(graph.cmd, 
-            VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
-            VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
-            0u, 0u, nullptr, 0u, nullptr, 1u, &rt_barrier
-        );
-    }
-
-    /* Finish recording commands to the graphs command buffer */
-    vkEndCommandBuffer(graph.cmd);
+        const ResourceAccess present { VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, VK_ACCESS_2_NONE, false };
+        target_barrier(final_cmd, *rt, present, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+    }
+
+    /* The graph ends once the final batch finished, it waited for all other batches */
+    if (graph.timestamps != VK_NULL_HANDLE) {
+        vkCmdWriteTimestamp2KHR(final_cmd, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, graph.timestamps, 1u);
+    }
+
+    /* Finish recording commands to the last combined batch */
+    close_batch(false);
 
     /* Reset the in-flight fence */
     if (vkResetFences(gpu->logical_device, 1u, &graph.flight_fence) != VK_SUCCESS) {
         return Err("failed to reset graph in-flight fence.");
     }
 
-    /* Graph submission info */
-    const VkPipelineStageFlags wait_stage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
-    VkSubmitInfo submit { VK_STRUCTURE_TYPE_SUBMIT_INFO };
-    submit.pWaitDstStageMask = &wait_stage;
-    submit.commandBufferCount = 1u;
-    submit.pCommandBuffers = &graph.cmd;
-    if (has_target) {
-        submit.signalSemaphoreCount = 1u; /* Signal when the work completes */
-        submit.pSignalSemaphores = &rt->semaphore();
-        submit.waitSemaphoreCount = 1u; /* Wait for image acquired */
-        submit.pWaitSemaphores = &graph.start_semaphore;
-    }
-
-    /* Submit the graph commands to the queue */
-    if (vkQueueSubmit(gpu->queues.queue_combined, 1u, &submit, graph.flight_fence) != VK_SUCCESS) {
-        return Err("failed to submit graph commands.");
-    }
+    /* Submit the graph commands to the queues */
+    if (Result r = submit_batches(graph, rt); r.is_err()) return r;
 
     /* Present the graph results after rendering completes */
     if (has_target) {
@@ -236,30 +504,388 @@ Result<void> RenderGraph::wait_until_safe() {
     return Ok();
 }
 
-Result<void> RenderGraph::queue_wave(const GraphExecution& graph, u32 start, u32 end) {
-    /* Insert sync barriers for wave descriptors */
-    const Result sync_result = wave_sync_descriptors(*this, start, end);
-    if (sync_result.is_err()) return sync_result;
+Result<void> RenderGraph::open_batch(GraphExecution& graph, bool async, u64 wait_value, u64 staging_wait) {
+    CommandRecorder& recorder = graph.batch_recorders[async ? 1u : 0u];
+
+    /* Allocate a new command buffer if all existing ones are in use */
+    if (recorder.used == recorder.cmds.size()) {
+        VkCommandBufferAllocateInfo cmd_ai { VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO };
+        cmd_ai.commandPool = recorder.pool;
+        cmd_ai.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        cmd_ai.commandBufferCount = 1u;
+
+        VkCommandBuffer new_cmd {};
+        if (vkAllocateCommandBuffers(gpu->logical_device, &cmd_ai, &new_cmd) != VK_SUCCESS) {
+            return Err("failed to allocate queue batch command buffer for graph.");
+        }
+        recorder.cmds.push_back(new_cmd);
+    }
+    const VkCommandBuffer cmd = recorder.cmds[recorder.used++];
+
+    /* Begin recording commands to the batch command buffer */
+    VkCommandBufferBeginInfo cmd_begin { VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO };
+    cmd_begin.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    if (vkBeginCommandBuffer(cmd, &cmd_begin) != VK_SUCCESS) {
+        return Err("failed to begin recording queue batch command buffer for graph.");
+    }
+
+    open_batches[async ? 1u : 0u] = (u32)batches.size();
+    batches.push_back(QueueBatch { async, cmd, wait_value, staging_wait, 0u });
+    return Ok();
+}
+
+u64 RenderGraph::close_batch(bool async) {
+    QueueBatch& batch = batches[open_batches[async ? 1u : 0u]];
+    open_batches[async ? 1u : 0u] = UINT32_MAX;
+    vkEndCommandBuffer(batch.cmd);
+
+    /* Signal the queue timeline, the staging copies of later graphs wait for it */
+    batch.signal_value = ++timelines[async ? 1u : 0u].value;
+    return batch.signal_value;
+}
+
+Result<void> RenderGraph::submit_batches(const GraphExecution& graph, RenderTargetSlot* rt) {
+    /* Submit the staging copies first, they wait for the previous graphs to finish using the buffers */
+    if (staging_value != 0u) {
+        VkSemaphoreSubmitInfo wait { VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO };
+        wait.semaphore = timelines[0].semaphore;
+        wait.value = staging_start_value;
+        wait.stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+        VkSemaphoreSubmitInfo signal { VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO };
+        signal.semaphore = timelines[2].semaphore;
+        signal.value = staging_value;
+        signal.stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+
+        VkCommandBufferSubmitInfo cmd_info { VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO };
+        cmd_info.commandBuffer = graph.staging_cmd;
+        VkSubmitInfo2 submit { VK_STRUCTURE_TYPE_SUBMIT_INFO_2 };
+        submit.waitSemaphoreInfoCount = staging_start_value != 0u ? 1u : 0u;
+        submit.pWaitSemaphoreInfos = &wait;
+        submit.commandBufferInfoCount = 1u;
+        submit.pCommandBufferInfos = &cmd_info;
+        submit.signalSemaphoreInfoCount = 1u;
+        submit.pSignalSemaphoreInfos = &signal;
+        if (vkQueueSubmit2KHR(gpu->queues.queue_transfer, 1u, &submit, VK_NULL_HANDLE) != VK_SUCCESS) {
+            return Err("failed to submit graph staging commands.");
+        }
+    }
+
+    /* The last combined batch signals the render target & the in-flight fence */
+    u32 last_combined = 0u;
+    for (u32 i = 0u; i < batches.size(); ++i) {
+        if (batches[i].async == false) last_combined = i;
+    }
+
+    for (u32 i = 0u; i < batches.size(); ++i) {
+        const QueueBatch& batch = batches[i];
+        const u32 queue = batch.async ? 1u : 0u;
+
+        /* Wait for the render target image to be acquired, the other queue, and the staging copies */
+        VkSemaphoreSubmitInfo waits[3] {};
+        u32 wait_count = 0u;
+        if (i == target_batch && rt != nullptr) {
+            waits[wait_count].sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
+            waits[wait_count].semaphore = graph.start_semaphore;
+            waits[wait_count++].stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+        }
+        if (batch.wait_value != 0u) {
+            waits[wait_count].sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
+            waits[wait_count].semaphore = timelines[1u - queue].semaphore;
+            waits[wait_count].value = batch.wait_value;
+            waits[wait_count++].stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+        }
+        if (batch.staging_value != 0u) {
+            waits[wait_count].sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
+            waits[wait_count].semaphore = timelines[2].semaphore;
+            waits[wait_count].value = batch.staging_value;
+            waits[wait_count++].stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+        }
+
+        /* Signal when the work completes */
+        VkSemaphoreSubmitInfo signals[2] {};
+        u32 signal_count = 0u;
+        if (batch.signal_value != 0u) {
+            signals[signal_count].sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
+            signals[signal_count].semaphore = timelines[queue].semaphore;
+            signals[signal_count].value = batch.signal_value;
+            signals[signal_count++].stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+        }
+        if (i == last_combined && rt != nullptr) {
+            signals[signal_count].sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
+            signals[signal_count].semaphore = rt->semaphore();
+            signals[signal_count++].stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+        }
+
+        /* Batch submission info */
+        VkCommandBufferSubmitInfo cmd_info { VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO };
+        cmd_info.commandBuffer = batch.cmd;
+        VkSubmitInfo2 submit { VK_STRUCTURE_TYPE_SUBMIT_INFO_2 };
+        submit.waitSemaphoreInfoCount = wait_count;
+        submit.pWaitSemaphoreInfos = waits;
+        submit.commandBufferInfoCount = 1u;
+        submit.pCommandBufferInfos = &cmd_info;
+        submit.signalSemaphoreInfoCount = signal_count;
+        submit.pSignalSemaphoreInfos = signals;
+
+        /* Submit the batch to its queue, batches only wait for batches which were submitted before them */
+        const VkQueue vk_queue = batch.async ? gpu->queues.queue_compute : gpu->queues.queue_combined;
+        const VkFence fence = i == last_combined ? graph.flight_fence : VK_NULL_HANDLE;
+        if (vkQueueSubmit2KHR(vk_queue, 1u, &submit, fence) != VK_SUCCESS) {
+            return Err("failed to submit graph commands.");
+        }
+    }
+    return Ok();
+}
+
+Result<void> RenderGraph::queue_waves(GraphExecution& graph) {
+    /* Find the split barriers of all lanes before recording them */
+    const bool split = sync_mode == SyncMode::Events;
+    if (split) {
+        if (Result r = plan_split_barriers(graph); r.is_err()) return r;
+    }
+
+    /* Record the waves on the worker threads */
+    const bool parallel = record_pool.size() > 0u;
+    if (parallel) {
+        if (Result r = record_waves_parallel(graph); r.is_err()) return r;
+    }
+
+    const std::vector<WaveJoin>& joins = compiler.joins();
+    if (joins.empty() == false) {
+        const u32 wave_count = waves.back().wave + 1u;
+        wave_values[0].assign(wave_count, 0u);
+        wave_values[1].assign(wave_count, 0u);
+    }
+
+    /* Process the waves one part at a time, each part is a range of lanes on the same queue */
+    for (u32 s = 0u, t = 0u; s < waves.size();) {
+        const u32 wave = waves[s].wave;
+        const bool async = waves[s].async;
+        const u32 queue = async ? 1u : 0u;
+        u32 e = s + 1u;
+        while (e < waves.size() && waves[e].wave == wave && waves[e].async == async) e++;
+
+        /* Start a new batch if this part waits for the other queue */
+        const WaveJoin join = joins.empty() ? WaveJoin {} : joins[wave];
+        const u32 wait_wave = async ? join.wait_combined : join.wait_async;
+        u64 wait_value = wait_wave == UINT32_MAX ? 0u : wave_values[1u - queue][wait_wave];
+        if (async && async_start_value != 0u) {
+            wait_value = std::max(wait_value, async_start_value);
+            async_start_value = 0u; /* <- only the first async batch has to wait */
+        }
+
+        /* Only the first part on each queue which uses an uploaded buffer waits for the staging copies */
+        u64 staging_wait = 0u;
+        if (staging_value != 0u && staging_waited[queue] == false && lanes_use_staged(s, e)) {
+            staging_wait = staging_value;
+            staging_waited[queue] = true;
+        }
+
+        if (open_batches[queue] == UINT32_MAX || wait_value != 0u || staging_wait != 0u) {
+            if (open_batches[queue] != UINT32_MAX) close_batch(async);
+            if (Result r = open_batch(graph, async, wait_value, staging_wait); r.is_err()) return r;
+        }
+        const VkCommandBuffer cmd = batches[open_batches[queue]].cmd;
+
+        /* The first batch which uses the render target waits for it to be acquired */
+        if (async == false && target_batch == UINT32_MAX && lanes_use_target(s, e)) {
+            target_batch = open_batches[queue];
+        }
+
+        /* Insert sync barriers for wave descriptors (split barriers are queued with the lanes) */
+        if (split == false) {
+            const Result sync_result = wave_sync_descriptors(*this, cmd, s, e, async);
+            if (sync_result.is_err()) return sync_result;
+        }
+
+        if (parallel) {
+            /* Execute the chunks of this part, which were recorded in the same order */
+            record_cmds.clear();
+            for (; t < record_tasks.size() && record_tasks[t].start < e; ++t) {
+                record_cmds.push_back(record_tasks[t].cmd);
+            }
+            vkCmdExecuteCommands(cmd, (u32)record_cmds.size(), record_cmds.data());
+        } else {
+            /* Queue each node in this part */
+            if (Result r = queue_lanes(cmd, s, e); r.is_err()) return r;
+        }
+
+        /* Finish the batch if the other queue waits for this part */
+        if (async ? join.signal_async : join.signal_combined) {
+            wave_values[queue][wave] = close_batch(async);
+        }
+        s = e;
+    }
+    return Ok();
+}
+
+void RenderGraph::target_barrier(VkCommandBuffer cmd, RenderTargetSlot& rt, const ResourceAccess& use, VkImageLayout layout) {
+    BarrierSource src {};
+    const bool transition = rt.old_layout() != layout;
+    if (track_access(rt.state, 0u, use, 0u, transition, src) == false) return;
+
+    /* Render target image barrier */
+    VkImageMemoryBarrier2 barrier { VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2 };
+    barrier.srcStageMask = src.stages;
+    barrier.srcAccessMask = src.access;
+    barrier.dstStageMask = use.stages;
+    barrier.dstAccessMask = use.access;
+    barrier.oldLayout = rt.old_layout();
+    barrier.newLayout = layout;
+    rt.old_layout() = layout;
+    barrier.image = rt.image();
+    barrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0u, 1u, 0u, 1u };
+
+    /* Render target dependency info */
+    VkDependencyInfo dep_info { VK_STRUCTURE_TYPE_DEPENDENCY_INFO };
+    dep_info.imageMemoryBarrierCount = 1u;
+    dep_info.pImageMemoryBarriers = &barrier;
+    vkCmdPipelineBarrier2KHR(cmd, &dep_info);
+}
+
+bool RenderGraph::lanes_use_staged(u32 start, u32 end) const {
+    const auto is_staged = [this](const OpaqueHandle& resource) {
+        return std::binary_search(staged_buffers.begin(), staged_buffers.end(), resource.raw());
+    };
+
+    for (u32 i = start; i < end; ++i) {
+        const Node& node = *nodes[waves[i].lane];
+        for (const Dependency& dep : node.dependencies) {
+            if (is_staged(dep.resource)) return true;
+        }
+
+        /* Indirect argument buffers aren't dependencies */
+        if (node.type == NodeType::Compute) {
+            const ComputeNode& compute = (const ComputeNode&)node;
+            if (compute.indirect_buffer.is_null() == false && is_staged(compute.indirect_buffer)) return true;
+        } else if (node.type == NodeType::Raster) {
+            for (const DrawCall& draw_call : ((const RasterNode&)node).draws) {
+                if (draw_call.indirect_buffer.is_null() == false && is_staged(draw_call.indirect_buffer)) return true;
+            }
+        }
+    }
+    return false;
+}
+
+bool RenderGraph::lanes_use_target(u32 start, u32 end) const {
+    for (u32 i = start; i < end; ++i) {
+        for (const Dependency& dep : nodes[waves[i].lane]->dependencies) {
+            if (dep.resource.get_type() == ResourceType::RenderTarget) return true;
+        }
+    }
+    return false;
+}
+
+Result<void> RenderGraph::plan_split_barriers(GraphExecution& graph) {
+    /* Reset the events of the previous graph of this execution, it has finished */
+    for (u32 i = 0u; i < graph.used_events; ++i) {
+        if (vkResetEvent(gpu->logical_device, graph.events[i]) != VK_SUCCESS) {
+            return Err("failed to reset split barrier event for graph.");
+        }
+    }
+    graph.used_events = 0u;
+
+    /* The lanes of this dispatch get new access indices, accesses with older indices were made by earlier graphs */
+    const u64 base_index = sync_index + 1u;
+    sync_index += waves.size() + 1u;
+
+    lane_syncs.assign(waves.size(), LaneSync {});
+    lane_barriers.buffers.clear();
+    lane_barriers.images.clear();
+    lane_sets.clear();
+
+    /* Event creation info (reset on the host, so it can't be device only) */
+    const VkEventCreateInfo event_ci { VK_STRUCTURE_TYPE_EVENT_CREATE_INFO };
+
+    u32 prev_lanes[2] { UINT32_MAX, UINT32_MAX }; /* <- previous lane on each queue */
+    for (u32 i = 0u, e = 1u; i < waves.size(); i = e++) {
+        /* Merged raster lanes share a rendering scope, so they wait before the first lane & set events after the last */
+        while (e < waves.size() && waves[e].merged) e++;
+        const u32 last = e - 1u;
+
+        const u32 queue = waves[i].async ? 1u : 0u;
+        const u32 prev_lane = prev_lanes[queue];
+        prev_lanes[queue] = last;
+
+        LaneSync& sync = lane_syncs[i];
+        sync.buffer_start = (u32)lane_barriers.buffers.size();
+        sync.image_start = (u32)lane_barriers.images.size();
+        if (Result r = lane_sync_barriers(*this, i, e, waves[i].async, base_index + last, lane_barriers); r.is_err()) return r;
+        sync.buffer_count = (u32)lane_barriers.buffers.size() - sync.buffer_start;
+        sync.image_count = (u32)lane_barriers.images.size() - sync.image_start;
+        stats.barriers += sync.buffer_count + sync.image_count;
+        if (sync.buffer_count + sync.image_count == 0u) continue;
+
+        /* Use a pipeline barrier if the barriers wait for earlier graphs, or for the lane right before this one */
+        if (lane_barriers.min_src < base_index) continue;
+        const u32 set_lane = (u32)(lane_barriers.max_src - base_index);
+        if (set_lane == prev_lane) continue;
+
+        /* Create a new event if all existing ones are in use */
+        if (graph.used_events == graph.events.size()) {
+            VkEvent new_event {};
+            if (vkCreateEvent(gpu->logical_device, &event_ci, nullptr, &new_event) != VK_SUCCESS) {
+                return Err("failed to create split barrier event for graph.");
+            }
+            graph.events.push_back(new_event);
+        }
+        sync.event = graph.used_events++;
+        lane_sets.push_back(((u64)set_lane << 32u) | i);
+        stats.split_barriers += 1u;
+    }
+
+    /* Group the events by the lane which sets them */
+    std::sort(lane_sets.begin(), lane_sets.end());
+    for (u32 i = 0u; i < lane_sets.size(); ++i) {
+        LaneSync& sync = lane_syncs[(u32)(lane_sets[i] >> 32u)];
+        if (sync.set_count == 0u) sync.set_start = i;
+        sync.set_count += 1u;
+    }
+    return Ok();
+}
+
+VkDependencyInfo RenderGraph::lane_dependency(u32 lane) const {
+    const LaneSync& sync = lane_syncs[lane];
+    VkDependencyInfo dep_info { VK_STRUCTURE_TYPE_DEPENDENCY_INFO };
+    dep_info.bufferMemoryBarrierCount = sync.buffer_count;
+    dep_info.pBufferMemoryBarriers = lane_barriers.buffers.data() + sync.buffer_start;
+    dep_info.imageMemoryBarrierCount = sync.image_count;
+    dep_info.pImageMemoryBarriers = lane_barriers.images.data() + sync.image_start;
+    return dep_info;
+}
+
+Result<void> RenderGraph::queue_lanes(VkCommandBuffer cmd, u32 start, u32 end) {
+    const bool split = sync_mode == SyncMode::Events;
+    const std::vector<VkEvent>& events = active_graph().events;
+    BoundState bound {};
 
-    /* Queue each node in the wave */
     for (u32 i = start; i < end; ++i) {
         const Node& node = *nodes[waves[i].lane];
 
+        /* Wait for the split barrier of this lane, or insert it as a pipeline barrier */
+        if (split && lane_syncs[i].buffer_count + lane_syncs[i].image_count > 0u) {
+            const VkDependencyInfo dep_info = lane_dependency(i);
+            if (lane_syncs[i].event == UINT32_MAX) vkCmdPipelineBarrier2KHR(cmd, &dep_info);
+            else vkCmdWaitEvents2KHR(cmd, 1u, &events[lane_syncs[i].event], &dep_info);
+        }
+
         if (gpu->validation) {
             /* Start debug label for this node */
             VkDebugUtilsLabelEXT debug_label { VK_STRUCTURE_TYPE_DEBUG_UTILS_LABEL_EXT };
             debug_label.pLabelName = node.label.data();
-            vkCmdBeginDebugUtilsLabelEXT(graph.cmd, &debug_label);
+            vkCmdBeginDebugUtilsLabelEXT(cmd, &debug_label);
         }
 
         switch (node.type) {
             case NodeType::Compute: {
-                const Result node_result = queue_compute_node(graph, (const ComputeNode&)node);
+                const Result node_result = queue_compute_node(cmd, (const ComputeNode&)node, bound);
                 if (node_result.is_err()) return node_result;
                 break;
             } 
             case NodeType::Raster: {
-                const Result node_result = queue_raster_node(graph, (const RasterNode&)node);
+                /* Merged raster nodes share the rendering scope of the lanes around them */
+                const bool end_scope = i + 1u == waves.size() || waves[i + 1u].merged == false;
+                const Result node_result = queue_raster_node(cmd, (const RasterNode&)node, bound, waves[i].merged == false, end_scope);
                 if (node_result.is_err()) return node_result;
                 break;
             }
@@ -268,64 +894,192 @@ Result<void> RenderGraph::queue_wave(const GraphExecution& graph, u32 start, u32
         }
 
         /* End debug label for this node */
-        if (gpu->validation) vkCmdEndDebugUtilsLabelEXT(graph.cmd);
+        if (gpu->validation) vkCmdEndDebugUtilsLabelEXT(cmd);
+
+        /* Set the events of the lanes which wait for this lane, with the same dependency info they wait with */
+        if (split == false) continue;
+        for (u32 e = 0u; e < lane_syncs[i].set_count; ++e) {
+            const u32 wait_lane = (u32)lane_sets[lane_syncs[i].set_start + e];
+            const VkDependencyInfo dep_info = lane_dependency(wait_lane);
+            vkCmdSetEvent2KHR(cmd, events[lane_syncs[wait_lane].event], &dep_info);
+        }
     }
 
     return Ok();
 }
 
-Result<void> RenderGraph::queue_compute_node(const GraphExecution& graph, const ComputeNode& node) {
+Result<void> RenderGraph::record_waves_parallel(GraphExecution& graph) {
+    /* Reset the recorder command pools, the previous commands of this graph execution have finished */
+    for (CommandRecorder& recorder : graph.recorders) {
+        if (vkResetCommandPool(gpu->logical_device, recorder.pool, 0u) != VK_SUCCESS) {
+            return Err("failed to reset recorder command pool for graph.");
+        }
+        recorder.used = 0u;
+    }
+
+    /* Split each part of a wave into one chunk of lanes per worker thread (lanes of a part run on the same queue) */
+    const u32 thread_count = record_pool.size();
+    record_tasks.clear();
+    for (u32 s = 0u, e = 1u; e <= waves.size(); ++e) {
+        /* If this lane is the end of a part */
+        if (e == waves.size() || waves[e].wave != waves[s].wave || waves[e].async != waves[s].async) {
+            const u32 chunk_size = div_up(e - s, thread_count);
+            for (u32 c = s; c < e;) {
+                /* Merged raster lanes share a rendering scope, so they stay in the same chunk */
+                u32 chunk_end = std::min(c + chunk_size, e);
+                while (chunk_end < e && waves[chunk_end].merged) chunk_end++;
+
+                RecordTask& task = record_tasks.emplace_back();
+                task.wave = waves[s].wave;
+                task.async = waves[s].async;
+                task.start = c;
+                task.end = chunk_end;
+                c = chunk_end;
+            }
+            s = e;
+        }
+    }
+
+    /* Secondary command buffer inheritance info (rendering begins & ends inside each node) */
+    VkCommandBufferInheritanceInfo inheritance { VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO };
+    VkCommandBufferBeginInfo cmd_begin { VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO };
+    cmd_begin.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    cmd_begin.pInheritanceInfo = &inheritance;
+
+    /* Record each chunk into a secondary command buffer on the worker threads */
+    record_pool.parallel_for((u32)record_tasks.size(), [&](u32 t, u32 worker) {
+        RecordTask& task = record_tasks[t];
+
+        /* Secondary command buffers must come from a pool of the queue family which executes them */
+        CommandRecorder& recorder = graph.recorders[task.async ? thread_count + worker : worker];
+
+        /* Allocate a new secondary command buffer if all existing ones are in use */
+        if (recorder.used == recorder.cmds.size()) {
+            VkCommandBufferAllocateInfo cmd_ai { VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO };
+            cmd_ai.commandPool = recorder.pool;
+            cmd_ai.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+            cmd_ai.commandBufferCount = 1u;
+
+            VkCommandBuffer new_cmd {};
+            if (vkAllocateCommandBuffers(gpu->logical_device, &cmd_ai, &new_cmd) != VK_SUCCESS) {
+                task.error = "failed to allocate secondary command buffer for graph.";
+                return;
+            }
+            recorder.cmds.push_back(new_cmd);
+        }
+        task.cmd = recorder.cmds[recorder.used++];
+
+        /* Record the lanes of this chunk */
+        if (vkBeginCommandBuffer(task.cmd, &cmd_begin) != VK_SUCCESS) {
+            task.error = "failed to begin recording secondary command buffer for graph.";
+            return;
+        }
+        const Result lanes_result = queue_lanes(task.cmd, task.start, task.end);
+        if (lanes_result.is_err()) task.error = lanes_result.unwrap_err();
+        vkEndCommandBuffer(task.cmd);
+    });
+
+    /* Make sure all chunks were recorded successfully */
+    for (const RecordTask& task : record_tasks) {
+        if (task.error.empty() == false) return Err(task.error);
+    }
+    return Ok();
+}
+
+Result<void> RenderGraph::queue_compute_node(VkCommandBuffer cmd, const ComputeNode& node, BoundState& bound) {
     /* Try to get the pipeline for this compute node */
     const Result cache_result = pipeline_cache.get_pipeline(shader_path, node);
     if (cache_result.is_err()) return Err(cache_result.unwrap_err());
     const Pipeline pipeline = cache_result.unwrap();
 
-    /* Bind the compute pipeline */
-    vkCmdBindPipeline(graph.cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline.pipeline);
-    const Result push_result = node_push_descriptors(*this, pipeline, node);
+    /* Skip the node while its pipeline compiles in the background */
+    if (pipeline.is_null()) return Ok();
+
+    /* Bind the compute pipeline, or its shader object */
+    if (shader_objects) {
+        const VkShaderStageFlagBits stage = VK_SHADER_STAGE_COMPUTE_BIT;
+        vkCmdBindShadersEXT(cmd, 1u, &stage, &pipeline.shaders[0]);
+    } else {
+        vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline.pipeline);
+    }
+    const Result push_result = node_push_descriptors(*this, cmd, pipeline, node);
     if (push_result.is_err()) return push_result;
-    vkCmdBindDescriptorSets(graph.cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline.layout, 1u, 1u, &gpu->get_vram_bank().bindless_set, 0u, nullptr);
+
+    /* Pipelines with the same (shared) layout keep the bindless set bound */
+    if (bound.compute != pipeline.layout) {
+        vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline.layout, 1u, 1u, &gpu->get_vram_bank().bindless_set, 0u, nullptr);
+        bound.compute = pipeline.layout;
+    }
 
     /* Indirect Dispatch */
     if (!node.indirect_buffer.is_null())
     {
         VRAMBank& bank = gpu->get_vram_bank();
-        vkCmdDispatchIndirect(graph.cmd, bank.buffers.get(node.indirect_buffer).buffer, node.indirect_offset);
+        vkCmdDispatchIndirect(cmd, bank.buffers.get(node.indirect_buffer).buffer, node.indirect_offset);
         return Ok();
     }
 
-    /* Calculate the dispatch size */
-    const u32 dispatch_x = div_up(node.work_x, node.group_x);
-    const u32 dispatch_y = div_up(node.work_y, node.group_y);
-    const u32 dispatch_z = div_up(node.work_z, node.group_z);
+    /* Calculate the dispatch size, using the thread group size reflected from the shader unless the node sets it */
+    const u32 group_x = node.group_x != 0u ? node.group_x : pipeline.group_size[0];
+    const u32 group_y = node.group_y != 0u ? node.group_y : pipeline.group_size[1];
+    const u32 group_z = node.group_z != 0u ? node.group_z : pipeline.group_size[2];
+    if (group_x == 0u || group_y == 0u || group_z == 0u) {
+        const std::string label(node.label);
+        return Err("thread group size of '%s' node is unknown, set it with `group_size(...)`.", label.c_str());
+    }
+    const u32 dispatch_x = div_up(node.work_x, group_x);
+    const u32 dispatch_y = div_up(node.work_y, group_y);
+    const u32 dispatch_z = div_up(node.work_z, group_z);
 
     /* Dispatch the compute pipeline */
-    vkCmdDispatch(graph.cmd, dispatch_x, dispatch_y, dispatch_z);
+    vkCmdDispatch(cmd, dispatch_x, dispatch_y, dispatch_z);
 
     return Ok();
 }
 
-Result<void> RenderGraph::queue_raster_node(const GraphExecution& graph, const RasterNode& node) { 
+Result<void> RenderGraph::queue_raster_node(VkCommandBuffer cmd, const RasterNode& node, BoundState& bound, bool begin, bool end) { 
     /* Try to get the pipeline for this raster node */
     const Result cache_result = pipeline_cache.get_pipeline(shader_path, node);
     if (cache_result.is_err()) return Err(cache_result.unwrap_err());
     const Pipeline pipeline = cache_result.unwrap();
+    const bool skipped = pipeline.is_null(); /* <- while its pipeline compiles in the background */
 
-    /* Bind the pipeline */
-    vkCmdBindPipeline(graph.cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline.pipeline);
-  
-    /* Create and submit push descriptors for this node */
-    const Result push_result = node_push_descriptors(*this, pipeline, node);
-    if (push_result.is_err()) return push_result;
-    vkCmdBindDescriptorSets(
-        graph.cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline.layout, 1u, 1u, &gpu->get_vram_bank().bindless_set, 0u, nullptr
-    );
+    if (skipped == false) {
+        /* Bind the pipeline, or its shader objects */
+        if (shader_objects) {
+            const VkShaderStageFlagBits stages[2] { VK_SHADER_STAGE_VERTEX_BIT, VK_SHADER_STAGE_FRAGMENT_BIT };
+            vkCmdBindShadersEXT(cmd, 2u, stages, pipeline.shaders);
+        } else {
+            vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline.pipeline);
+        }
+
+        /* Create and submit push descriptors for this node */
+        const Result push_result = node_push_descriptors(*this, cmd, pipeline, node);
+        if (push_result.is_err()) return push_result;
+        if (bound.graphics != pipeline.layout) {
+            vkCmdBindDescriptorSets(
+                cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline.layout, 1u, 1u, &gpu->get_vram_bank().bindless_set, 0u, nullptr
+            );
+            bound.graphics = pipeline.layout;
+        }
+    }
+
+    /* Skipped nodes only need a rendering scope if merged nodes continue it */
+    if (skipped && begin && end) return Ok();
     VRAMBank& bank = gpu->get_vram_bank();
 
+    /* Get the render area */
+    VkRect2D render_area {};
+    render_area.offset = {(i32)node.raster_x, (i32)node.raster_y};
+    render_area.extent = {node.raster_w, node.raster_h};
+
     /* Find all attachment resource dependencies to put in the rendering info. */
     std::vector<VkRenderingAttachmentInfo> color_attachments {};
     i32 min_raster_w = INT32_MAX, min_raster_h = INT32_MAX;
     for (const Dependency& dep : node.dependencies) {
+        /* Merged nodes render into the attachments of the scope they continue */
+        if (begin == false) break;
+
         /* Find attachment dependencies */
         if (has_flag(dep.flags, DependencyFlags::Attachment) == false) continue;
 
@@ -349,15 +1103,12 @@ Result<void> RenderGraph::queue_raster_node(const GraphExecution& graph, const R
         VkRenderingAttachmentInfo attachment { VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO };
         attachment.imageView = attachment_view;
         attachment.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-        attachment.loadOp = translate::load_operation(node.pixel_load_op);
+        /* Skipped nodes keep the previous contents of their attachments for the merged nodes, instead of clearing them */
+        attachment.loadOp = skipped ? VK_ATTACHMENT_LOAD_OP_LOAD : translate::load_operation(node.pixel_load_op);
         attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
         color_attachments.emplace_back(attachment);
     }
 
-    /* Get the render area */
-    VkRect2D render_area {};
-    render_area.offset = {(i32)node.raster_x, (i32)node.raster_y};
-    render_area.extent = {node.raster_w, node.raster_h};
     if (min_raster_w < render_area.extent.width || min_raster_h < render_area.extent.height) {
         return Err("attempted to rasterize into attachment smaller than raster extent.");
     }
@@ -370,7 +1121,13 @@ Result<void> RenderGraph::queue_raster_node(const GraphExecution& graph, const R
     rendering.pColorAttachments = color_attachments.data();
 
     /* Begin rendering */
-    vkCmdBeginRenderingKHR(graph.cmd, &rendering);
+    if (begin) vkCmdBeginRenderingKHR(cmd, &rendering);
+
+    /* Skipped nodes still begin & end a rendering scope which merged nodes continue */
+    if (skipped) {
+        if (end) vkCmdEndRenderingKHR(cmd);
+        return Ok();
+    }
 
     VkViewport viewport {};
     viewport.x = (f32)render_area.offset.x;
@@ -383,38 +1140,138 @@ Result<void> RenderGraph::queue_raster_node(const GraphExecution& graph, const R
     const VkRect2D scissor = render_area;
 
     /* Set the viewport and scissor */
-    vkCmdSetViewport(graph.cmd, 0u, 1u, &viewport);
-    vkCmdSetScissor(graph.cmd, 0u, 1u, &scissor);
+    if (shader_objects) {
+        vkCmdSetViewportWithCountEXT(cmd, 1u, &viewport);
+        vkCmdSetScissorWithCountEXT(cmd, 1u, &scissor);
+    } else {
+        vkCmdSetViewport(cmd, 0u, 1u, &viewport);
+        vkCmdSetScissor(cmd, 0u, 1u, &scissor);
+    }
+
+    /* Set the raster state which isn't part of the pipeline */
+    queue_dynamic_state(cmd, node, bound);
 
     /* Loop over all draw calls, bind vertex buffers, draw */
     for (const DrawCall& draw_call : node.draws) {
         /* Bind the vertex buffer for this draw call */
         const BufferSlot& vertex_buffer = bank.buffers.get(draw_call.vertex_buffer);
         const VkDeviceSize offset = 0u;
-        vkCmdBindVertexBuffers(graph.cmd, 0u, 1u, &vertex_buffer.buffer, &offset);
+        vkCmdBindVertexBuffers(cmd, 0u, 1u, &vertex_buffer.buffer, &offset);
 
         /* Check for indirect draw */
         if (!draw_call.indirect_buffer.is_null()) {
             vkCmdDrawIndirect(
-                graph.cmd, bank.buffers.get(draw_call.indirect_buffer).buffer, 0, 1, sizeof(VkDrawIndirectCommand)
+                cmd, bank.buffers.get(draw_call.indirect_buffer).buffer, 0, 1, sizeof(VkDrawIndirectCommand)
             );
         } else {
             /* Execute direct draw */
             vkCmdDraw(
-                graph.cmd, draw_call.vertex_count, draw_call.instance_count, draw_call.vertex_offset, draw_call.instance_offset
+                cmd, draw_call.vertex_count, draw_call.instance_count, draw_call.vertex_offset, draw_call.instance_offset
             );
         }
     }
 
     /* End rendering */
-    vkCmdEndRenderingKHR(graph.cmd);
+    if (end) vkCmdEndRenderingKHR(cmd);
 
     return Ok();
 }
 
-void RenderGraph::queue_staging(const GraphExecution& graph) {
+void RenderGraph::queue_dynamic_state(VkCommandBuffer cmd, const RasterNode& node, BoundState& bound) const {
+    VRAMBank& bank = gpu->get_vram_bank();
+
+    /* Vertex attributes (always interleaved in 1 vertex buffer) */
+    if (shader_objects || gpu->dynamic_vertex_input) {
+        u64 input_hash = hash_mix(node.attributes.size() + 1u);
+        for (const AttrFormat attr : node.attributes) input_hash = hash_combine(input_hash, (u64)attr);
+
+        if (bound.vertex_input != input_hash) {
+            std::vector<VkVertexInputAttributeDescription2EXT> attributes {};
+            u32 vertex_stride = 0u;
+            for (const AttrFormat attr : node.attributes) {
+                VkVertexInputAttributeDescription2EXT attribute { VK_STRUCTURE_TYPE_VERTEX_INPUT_ATTRIBUTE_DESCRIPTION_2_EXT };
+                attribute.location = (u32)attributes.size();
+                attribute.binding = 0u;
+                attribute.format = translate::vertex_format(attr);
+                attribute.offset = vertex_stride;
+                attributes.emplace_back(attribute);
+                vertex_stride += translate::vertex_attribute_size(attr);
+            }
+            VkVertexInputBindingDescription2EXT binding { VK_STRUCTURE_TYPE_VERTEX_INPUT_BINDING_DESCRIPTION_2_EXT };
+            binding.binding = 0u;
+            binding.stride = vertex_stride;
+            binding.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+            binding.divisor = 1u;
+            vkCmdSetVertexInputEXT(cmd, 1u, &binding, (u32)attributes.size(), attributes.data());
+            bound.vertex_input = input_hash;
+        }
+    }
+
+    /* Nothing else is dynamic without extended dynamic state */
+    if (shader_objects == false && gpu->extended_dynamic_state == false) return;
+
+    /* Input assembly */
+    const VkPrimitiveTopology topology = translate::primitive_topology(node.prim_topology);
+    if (bound.topology != topology) {
+        vkCmdSetPrimitiveTopologyEXT(cmd, topology);
+        bound.topology = topology;
+    }
+
+    /* State which is the same for all nodes, only set once per command buffer */
+    if (bound.raster_state == false) {
+        vkCmdSetPrimitiveRestartEnableEXT(cmd, VK_FALSE);
+        vkCmdSetCullModeEXT(cmd, VK_CULL_MODE_NONE);
+        vkCmdSetFrontFaceEXT(cmd, VK_FRONT_FACE_CLOCKWISE);
+
+        if (shader_objects) {
+            /* Rasterizer state */
+            vkCmdSetRasterizerDiscardEnableEXT(cmd, VK_FALSE);
+            vkCmdSetPolygonModeEXT(cmd, VK_POLYGON_MODE_FILL);
+            vkCmdSetLineWidth(cmd, 1.0f);
+            vkCmdSetDepthBiasEnableEXT(cmd, VK_FALSE);
+
+            /* Multisample state */
+            const VkSampleMask sample_mask = 0xFFFFFFFFu;
+            vkCmdSetRasterizationSamplesEXT(cmd, VK_SAMPLE_COUNT_1_BIT);
+            vkCmdSetSampleMaskEXT(cmd, VK_SAMPLE_COUNT_1_BIT, &sample_mask);
+            vkCmdSetAlphaToCoverageEnableEXT(cmd, VK_FALSE);
+
+            /* Depth stencil state */
+            vkCmdSetDepthTestEnableEXT(cmd, VK_FALSE);
+            vkCmdSetDepthWriteEnableEXT(cmd, VK_FALSE);
+            vkCmdSetStencilTestEnableEXT(cmd, VK_FALSE);
+        }
+        bound.raster_state = true;
+    }
+    if (shader_objects == false) return;
+
+    /* Blend state of each color attachment, only has to be set for attachments which didn't have it set yet */
+    u32 color_count = 0u;
+    for (const Dependency& dep : node.dependencies) {
+        if (has_flag(dep.flags, DependencyFlags::Attachment) == false) continue;
+        if (dep.resource.get_type() == ResourceType::RenderTarget) { color_count += 1u; continue; }
+        const TextureSlot& texture = bank.textures.get(bank.images.get(dep.resource).texture);
+        if (has_flag(texture.usage, TextureUsage::ColorAttachment)) color_count += 1u;
+    }
+    if (color_count <= bound.blend_attachments) return;
+    const u32 new_count = color_count - bound.blend_attachments;
+    /* Blending is disabled, like in the color blend state of the pipelines */
+    const std::vector<VkBool32> blend_enables(new_count, VK_FALSE);
+    const std::vector<VkColorComponentFlags> write_masks(
+        new_count, VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT
+    );
+    vkCmdSetColorBlendEnableEXT(cmd, bound.blend_attachments, new_count, blend_enables.data());
+    vkCmdSetColorWriteMaskEXT(cmd, bound.blend_attachments, new_count, write_masks.data());
+    bound.blend_attachments = color_count;
+}
+
+Result<void> RenderGraph::queue_staging(GraphExecution& graph) {
+    staged_buffers.clear();
+    staging_value = 0u;
+    staging_waited[0] = staging_waited[1] = false;
+
     /* Do nothing if there are no staging copies queued */
-    if (graph.staging_commands.empty()) return;
+    if (graph.staging_commands.empty()) return Ok();
 
     /* Compile the staging copy commands */
     std::vector<VkBufferCopy2> regions {};
@@ -443,91 +1300,84 @@ void RenderGraph::queue_staging(const GraphExecution& graph) {
         copy.dstBuffer = bank.buffers.get(cmd.dst_resource).buffer;
         copy.pRegions = &region;
         copy.regionCount = 1u;
+
+        staged_buffers.push_back(cmd.dst_resource.raw());
+    }
+    if (copies.empty()) return Ok();
+
+    /* Sort the staged buffers, so the waves can look them up */
+    std::sort(staged_buffers.begin(), staged_buffers.end());
+    staged_buffers.erase(std::unique(staged_buffers.begin(), staged_buffers.end()), staged_buffers.end());
+
+    /* Begin recording the staging command buffer, the previous staging copies of this graph execution have finished */
+    if (vkResetCommandPool(gpu->logical_device, graph.staging_pool, 0u) != VK_SUCCESS) {
+        return Err("failed to reset staging command pool for graph.");
+    }
+    VkCommandBufferBeginInfo cmd_begin { VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO };
+    cmd_begin.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    if (vkBeginCommandBuffer(graph.staging_cmd, &cmd_begin) != VK_SUCCESS) {
+        return Err("failed to begin recording staging command buffer for graph.");
     }
 
     if (gpu->validation) {
         /* Start debug label for staging */
         VkDebugUtilsLabelEXT debug_label { VK_STRUCTURE_TYPE_DEBUG_UTILS_LABEL_EXT };
         debug_label.pLabelName = "staging";
-        vkCmdBeginDebugUtilsLabelEXT(graph.cmd, &debug_label);
+        vkCmdBeginDebugUtilsLabelEXT(graph.staging_cmd, &debug_label);
     }
 
     /* Queue copy commands */
     for (const VkCopyBufferInfo2& copy : copies) {
-        vkCmdCopyBuffer2KHR(graph.cmd, &copy);
+        vkCmdCopyBuffer2KHR(graph.staging_cmd, &copy);
     }
 
     /* End debug label for this node */
-    if (gpu->validation) vkCmdEndDebugUtilsLabelEXT(graph.cmd);
+    if (gpu->validation) vkCmdEndDebugUtilsLabelEXT(graph.staging_cmd);
+
+    if (vkEndCommandBuffer(graph.staging_cmd) != VK_SUCCESS) {
+        return Err("failed to record staging command buffer for graph.");
+    }
+
+    /* The staging copies signal the transfer timeline, the waves which use the buffers wait for it */
+    staging_value = ++timelines[2].value;
+    return Ok();
 }
 
-void RenderGraph::queue_imgui(const GraphExecution &graph) {
+void RenderGraph::queue_imgui(VkCommandBuffer cmd) {
 #ifdef GRAPHITE_IMGUI
     /* If this graph doesn't have a render target, don't render imgui */
     if (imgui == nullptr || target.is_null()) return;
     RenderTargetSlot& rt = gpu->get_vram_bank().render_targets.get(target);
 
-    /* Transition all imgui images */
+    if (gpu->validation) {
+        /* Start debug label for imgui */
+        VkDebugUtilsLabelEXT debug_label { VK_STRUCTURE_TYPE_DEBUG_UTILS_LABEL_EXT };
+        debug_label.pLabelName = "imgui";
+        vkCmdBeginDebugUtilsLabelEXT(cmd, &debug_label);
+    }
+
+    /* Transition all imgui images, they are sampled by the pixel shader */
+    SyncBarriers barriers {};
+    const ResourceAccess sampled { VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT, false };
     for (const auto& [raw, imgui_image] : imgui->image_map) {
         VRAMBank& bank = gpu->get_vram_bank();
 
         const ImageSlot& image = bank.images.get((Image&)raw);
         TextureSlot& texture = bank.textures.get(image.texture);
-
-        /* Imgui image sync barrier */
-        VkImageMemoryBarrier2 barrier {VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2};
-        barrier.srcStageMask = VK_PIPELINE_STAGE_2_ALL_GRAPHICS_BIT;
-        barrier.srcAccessMask = VK_ACCESS_2_SHADER_READ_BIT | VK_ACCESS_2_SHADER_WRITE_BIT;
-        barrier.dstStageMask = VK_PIPELINE_STAGE_2_ALL_GRAPHICS_BIT;
-        barrier.dstAccessMask = VK_ACCESS_2_SHADER_READ_BIT | VK_ACCESS_2_SHADER_WRITE_BIT;
-        barrier.oldLayout = texture.layout;
-        barrier.newLayout = VK_IMAGE_LAYOUT_READ_ONLY_OPTIMAL;
-        texture.layout = barrier.newLayout;
-        barrier.image = texture.image;
-        barrier.subresourceRange = image.sub_range;
-
-        /* Render target dependency info */
-        VkDependencyInfo viewport_dep_info {VK_STRUCTURE_TYPE_DEPENDENCY_INFO};
-        viewport_dep_info.imageMemoryBarrierCount = 1u;
-        viewport_dep_info.pImageMemoryBarriers = &barrier;
-
-        if (gpu->validation) {
-            /* Start debug label for imgui */
-            VkDebugUtilsLabelEXT debug_label {VK_STRUCTURE_TYPE_DEBUG_UTILS_LABEL_EXT};
-            debug_label.pLabelName = "transition imgui images";
-            vkCmdBeginDebugUtilsLabelEXT(graph.cmd, &debug_label);
-        }
-
-        /* Insert a pipeline barrier for the image */
-        vkCmdPipelineBarrier2KHR(graph.cmd, &viewport_dep_info);
+        track_image_access(texture, image.sub_range, 0u, sampled, VK_IMAGE_LAYOUT_READ_ONLY_OPTIMAL, 0u, barriers);
     }
-
-    /* Make imgui render target sync barrier */
-    VkImageMemoryBarrier2 viewport_barrier { VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2 };
-    viewport_barrier.srcStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
-    viewport_barrier.srcAccessMask = VK_ACCESS_2_SHADER_WRITE_BIT | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT;
-    viewport_barrier.dstStageMask = VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT;
-    viewport_barrier.dstAccessMask = VK_ACCESS_2_SHADER_READ_BIT;
-    viewport_barrier.oldLayout = rt.old_layout();
-    viewport_barrier.newLayout = VK_IMAGE_LAYOUT_READ_ONLY_OPTIMAL;
-    rt.old_layout() = VK_IMAGE_LAYOUT_READ_ONLY_OPTIMAL;
-    viewport_barrier.image = rt.image();
-    viewport_barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0u, 1u, 0u, 1u};
-
-    /* Render target dependency info */
-    VkDependencyInfo viewport_dep_info { VK_STRUCTURE_TYPE_DEPENDENCY_INFO };
-    viewport_dep_info.imageMemoryBarrierCount = 1u;
-    viewport_dep_info.pImageMemoryBarriers = &viewport_barrier;
-
-    if (gpu->validation) {
-        /* Start debug label for imgui */
-        VkDebugUtilsLabelEXT debug_label { VK_STRUCTURE_TYPE_DEBUG_UTILS_LABEL_EXT };
-        debug_label.pLabelName = "imgui";
-        vkCmdBeginDebugUtilsLabelEXT(graph.cmd, &debug_label);
+    if (barriers.images.empty() == false) {
+        VkDependencyInfo images_dep_info { VK_STRUCTURE_TYPE_DEPENDENCY_INFO };
+        images_dep_info.imageMemoryBarrierCount = (u32)barriers.images.size();
+        images_dep_info.pImageMemoryBarriers = barriers.images.data();
+        vkCmdPipelineBarrier2KHR(cmd, &images_dep_info);
     }
 
-    /* Insert a pipeline barrier before rendering the overlay */
-    vkCmdPipelineBarrier2KHR(graph.cmd, &viewport_dep_info);
+    /* The overlay is rendered into the render target as a color attachment */
+    const ResourceAccess attachment {
+        VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT, true
+    };
+    target_barrier(cmd, rt, attachment, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
 
     /* Define the render target attachment */
     VkRenderingAttachmentInfoKHR attachment_info { VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO_KHR };
@@ -545,15 +1395,15 @@ void RenderGraph::queue_imgui(const GraphExecution &graph) {
     rendering_info.layerCount = 1;
 
     /* Begin dynamic rendering */
-    vkCmdBeginRenderingKHR(graph.cmd, &rendering_info);
+    vkCmdBeginRenderingKHR(cmd, &rendering_info);
 
-    imgui->render(graph.cmd);
+    imgui->render(cmd);
 
     /* End dynamic rendering */
-    vkCmdEndRenderingKHR(graph.cmd);
+    vkCmdEndRenderingKHR(cmd);
 
     /* End debug label for this node */
-    if (gpu->validation) vkCmdEndDebugUtilsLabelEXT(graph.cmd);
+    if (gpu->validation) vkCmdEndDebugUtilsLabelEXT(cmd);
 #endif
 }
 
@@ -561,17 +1411,39 @@ Result<void> RenderGraph::deinit() {
     /* Wait for all graph executions to finish */
     flush_graph();
 
-    /* Evict the pipeline cache */
-    pipeline_cache.evict();
+    /* Save & destroy the pipeline cache, the graph resources are destroyed even if saving fails */
+    const Result r_cache = pipeline_cache.deinit();
 
     /* Destroy graph execution resources */
     for (u32 i = 0u; i < max_graphs_in_flight; ++i) {
         vkDestroyFence(gpu->logical_device, graphs[i].flight_fence, nullptr);
         vkDestroySemaphore(gpu->logical_device, graphs[i].start_semaphore, nullptr);
+        if (graphs[i].timestamps != VK_NULL_HANDLE) vkDestroyQueryPool(gpu->logical_device, graphs[i].timestamps, nullptr);
+        for (const VkEvent event : graphs[i].events) vkDestroyEvent(gpu->logical_device, event, nullptr);
         vmaDestroyBuffer(gpu->get_vram_bank().vma_allocator, graphs[i].staging_buffer, graphs[i].staging_alloc);
+        vkDestroyCommandPool(gpu->logical_device, graphs[i].staging_pool, nullptr);
+        for (const CommandRecorder& recorder : graphs[i].recorders) {
+            vkDestroyCommandPool(gpu->logical_device, recorder.pool, nullptr);
+        }
+        for (const CommandRecorder& recorder : graphs[i].batch_recorders) {
+            if (recorder.pool != VK_NULL_HANDLE) vkDestroyCommandPool(gpu->logical_device, recorder.pool, nullptr);
+        }
+        /* Release the transient resources before freeing the heaps they are bound to */
+        for (TransientSlot& slot : graphs[i].transients) {
+            if (slot.resource.is_null() == false) gpu->get_vram_bank().destroy_unbound(slot.resource);
+        }
+        graphs[i].transients.clear();
+        for (const TransientHeap& heap : graphs[i].transient_heaps) {
+            vmaFreeMemory(gpu->get_vram_bank().vma_allocator, heap.alloc);
+        }
     }
+    for (const QueueTimeline& timeline : timelines) {
+        if (timeline.semaphore != VK_NULL_HANDLE) vkDestroySemaphore(gpu->logical_device, timeline.semaphore, nullptr);
+    }
+    record_pool.deinit();
     delete[] resources;
+    delete[] resource_hashes;
     delete[] graphs;
 
-    return Ok();
+    return r_cache;
 }
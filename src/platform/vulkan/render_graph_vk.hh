@@ -1,11 +1,17 @@
 #pragma once
 
+#include <string>
+
 /* Interface header */
 #include "graphite/render_graph.hh"
 
 #include "graphite/utils/types.hh"
+#include "graphite/utils/thread_pool.hh"
 #include "vulkan/api_vk.hh" /* Vulkan API */
 #include "wrapper/pipeline_cache_vk.hh"
+#include "wrapper/barrier_vk.hh"
+
+struct RenderTargetSlot;
 
 /* Staging command for a graph execution. */
 struct StagingCommand {
@@ -15,6 +21,83 @@ struct StagingCommand {
     OpaqueHandle dst_resource {};
 };
 
+/* Per-thread command recorder for a graph execution. */
+struct CommandRecorder {
+    VkCommandPool pool {};
+    /* Secondary command buffers allocated from the pool. */
+    std::vector<VkCommandBuffer> cmds {};
+    /* Number of command buffers in use this execution. */
+    u32 used = 0u;
+};
+
+/* Chunk of lanes to record into a secondary command buffer. */
+struct RecordTask {
+    u32 wave = 0u;
+    bool async = false; /* Whether the lanes run on the async compute queue. */
+    u32 start = 0u, end = 0u;
+    VkCommandBuffer cmd {};
+    /* Error message, empty if recording succeeded. */
+    std::string error {};
+};
+
+/* State last set in a command buffer, so nodes can skip setting the same state again. */
+struct BoundState {
+    /* Pipeline layouts, the bindless set stays bound while the layout doesn't change. */
+    VkPipelineLayout compute {};
+    VkPipelineLayout graphics {};
+
+    /* Dynamic raster state, all raster pipelines have the same dynamic states so it's kept when binding another pipeline. */
+    bool raster_state = false; /* Whether the raster state which is the same for all nodes was set. */
+    u64 vertex_input = 0u; /* Hash of the vertex attributes, 0 if not set yet. */
+    VkPrimitiveTopology topology = VK_PRIMITIVE_TOPOLOGY_MAX_ENUM;
+    u32 blend_attachments = 0u; /* Number of color attachments with their blend state set. (shader objects) */
+};
+
+/* Timeline semaphore of a queue, used to hand off work between the combined, async compute & transfer queue. */
+struct QueueTimeline {
+    VkSemaphore semaphore {};
+    u64 value = 0u; /* Last value signalled by a submitted (or recorded) batch. */
+};
+
+/* Batch of waves submitted to one queue, batches are submitted in the order in which they were opened. */
+struct QueueBatch {
+    bool async = false; /* Whether the batch runs on the async compute queue. */
+    VkCommandBuffer cmd {};
+    u64 wait_value = 0u; /* Timeline value of the other queue to wait for, 0 if none. */
+    u64 staging_value = 0u; /* Transfer timeline value of the staging copies to wait for, 0 if none. */
+    u64 signal_value = 0u; /* Timeline value to signal when done, 0 if none. */
+};
+
+/* Split barrier sync of a lane. (only used with `SyncMode::Events`) */
+struct LaneSync {
+    /* Barriers which the lane waits for. (ranges in the lane barrier lists) */
+    u32 buffer_start = 0u, buffer_count = 0u;
+    u32 image_start = 0u, image_count = 0u;
+    /* Event to wait for before the lane, UINT32_MAX to use a pipeline barrier instead. */
+    u32 event = UINT32_MAX;
+    /* Events to set after the lane. (range in the lane sets) */
+    u32 set_start = 0u, set_count = 0u;
+};
+
+/* Transient resource of a graph execution, re-used by later graphs which create the same resource. */
+struct TransientSlot {
+    BindHandle resource {}; /* Image or Buffer handle. */
+    u64 desc_hash = 0u; /* Hash of the creation parameters. */
+
+    /* Memory binding, heap is UINT32_MAX if the resource was never bound. */
+    u32 heap = UINT32_MAX;
+    u32 heap_generation = 0u;
+    u64 offset = 0u;
+};
+
+/* Memory heap shared by the transient resources of a graph execution. */
+struct TransientHeap {
+    u32 type_bits = 0u; /* Memory types of the resources placed in this heap. */
+    u32 generation = 0u; /* Incremented every time the heap is re-allocated. */
+    VmaAllocation alloc {};
+    u64 size = 0u;
+};
+
 /* The execution data for a graph. */
 struct GraphExecution {
     VkCommandBuffer cmd {};
@@ -29,6 +112,23 @@ struct GraphExecution {
     /* Graph staging copy commands. */
     std::vector<StagingCommand> staging_commands {};
     u64 staging_stack_ptr = 0u;
+    /* Command pool & buffer for the staging copies, submitted to the transfer queue. */
+    VkCommandPool staging_pool {};
+    VkCommandBuffer staging_cmd {};
+    /* Command recorders, one per recording worker thread. (followed by one per thread for the async compute queue) */
+    std::vector<CommandRecorder> recorders {};
+    /* Primary command buffers of the extra queue batches. (combined, async compute) */
+    CommandRecorder batch_recorders[2] {};
+    /* Transient resources, in the order in which they were created. */
+    std::vector<TransientSlot> transients {};
+    /* Transient memory heaps, one per set of memory types. */
+    std::vector<TransientHeap> transient_heaps {};
+    /* Events used for split barriers, and the number set by the last dispatch. */
+    std::vector<VkEvent> events {};
+    u32 used_events = 0u;
+    /* Timestamps written at the start & end of the graph, and whether they were written. */
+    VkQueryPool timestamps {};
+    bool timed = false;
 };
 
 /**
@@ -39,28 +139,133 @@ class RenderGraph : public AgnRenderGraph {
     /* Shader pipeline cache */
     PipelineCache pipeline_cache {};
 
+    /* Worker threads used for recording commands. */
+    ThreadPool record_pool {};
+    /* Chunks of lanes to record this dispatch. */
+    std::vector<RecordTask> record_tasks {};
+    /* Secondary command buffers to execute for a wave. */
+    std::vector<VkCommandBuffer> record_cmds {};
+
+    /* Whether nodes bind shader objects & dynamic state instead of pipelines. (set during init) */
+    bool shader_objects = false;
+
+    /* Alignment between transient buffers & textures sharing memory. (buffer image granularity) */
+    u64 transient_granularity = 1u;
+    /* Nanoseconds per timestamp tick, 0 if the queues don't support timestamps. */
+    f64 timestamp_period = 0.0;
+
+    /* Split barrier sync of each lane this dispatch. */
+    std::vector<LaneSync> lane_syncs {};
+    /* Barriers which the lanes wait for. */
+    SyncBarriers lane_barriers {};
+    /* Events set after each lane, as `(setting lane << 32) | waiting lane` sorted by setting lane. */
+    std::vector<u64> lane_sets {};
+    /* Last access index used by a dispatch, the lanes of each dispatch get new indices. */
+    u64 sync_index = 0u;
+
+    /* Timelines of the combined, async compute & transfer queue. */
+    QueueTimeline timelines[3] {};
+    /* Queue batches of this dispatch, in submission order. */
+    std::vector<QueueBatch> batches {};
+    /* Open batch of each queue, UINT32_MAX if there is none. */
+    u32 open_batches[2] { UINT32_MAX, UINT32_MAX };
+    /* Timeline value signalled after the waves which the other queue waits for. (indexed by queue, then wave) */
+    std::vector<u64> wave_values[2] {};
+    /* Combined queue timeline value which the first async compute batch waits for. */
+    u64 async_start_value = 0u;
+
+    /* Buffers written by the staging copies of this dispatch, sorted by raw handle. */
+    std::vector<u32> staged_buffers {};
+    /* Transfer timeline value signalled by the staging copies of this dispatch, 0 if there are none. */
+    u64 staging_value = 0u;
+    /* Combined queue timeline value which the staging copies wait for. (previous graphs may still use the buffers) */
+    u64 staging_start_value = 0u;
+    /* Whether a batch of each queue already waited for the staging copies. */
+    bool staging_waited[2] {};
+    /* Batch which waits for the render target image to be acquired, UINT32_MAX if none yet. */
+    u32 target_batch = UINT32_MAX;
+
     /* Wait until it's safe to create a new graph. */
     PLATFORM_SPECIFIC Result<void> wait_until_safe();
 
-    /* Queue all lanes for a given wave. */
-    Result<void> queue_wave(const GraphExecution& graph, u32 start, u32 end);
+    /* Place the transient resources of the graph in memory, using their lifetimes. */
+    PLATFORM_SPECIFIC Result<void> alloc_transients();
+
+    /* Get the slot of the next transient resource, it is re-used if the previous graph of the execution created the same resource. */
+    TransientSlot& next_transient(GraphExecution& graph, u64 desc_hash, bool& reused);
+
+    /* Open a new batch on a queue, which waits for a timeline value of the other queue & the staging copies. (0 to not wait) */
+    Result<void> open_batch(GraphExecution& graph, bool async, u64 wait_value, u64 staging_wait = 0u);
+
+    /* Finish the open batch of a queue, returns the timeline value it signals. */
+    u64 close_batch(bool async);
+
+    /* Submit all queue batches of this dispatch. */
+    Result<void> submit_batches(const GraphExecution& graph, RenderTargetSlot* rt);
+
+    /* Queue all waves into the queue batches, the queues wait for each other where the waves join. */
+    Result<void> queue_waves(GraphExecution& graph);
+
+    /* Insert a barrier for an access of the render target, if it needs one. (on the combined queue) */
+    void target_barrier(VkCommandBuffer cmd, RenderTargetSlot& rt, const ResourceAccess& use, VkImageLayout layout);
+
+    /* Check whether a range of lanes uses a buffer written by the staging copies. */
+    bool lanes_use_staged(u32 start, u32 end) const;
+
+    /* Check whether a range of lanes uses the render target. */
+    bool lanes_use_target(u32 start, u32 end) const;
+
+    /* Find the barriers of each lane, and the lanes after which to set their events. (for `SyncMode::Events`) */
+    Result<void> plan_split_barriers(GraphExecution& graph);
+
+    /* Get the dependency info of the barriers a lane waits for. */
+    VkDependencyInfo lane_dependency(u32 lane) const;
+
+    /* Queue commands for a range of lanes, with split barriers when using `SyncMode::Events`. */
+    Result<void> queue_lanes(VkCommandBuffer cmd, u32 start, u32 end);
+
+    /* Record chunks of lanes into secondary command buffers on the worker threads. */
+    Result<void> record_waves_parallel(GraphExecution& graph);
 
     /* Queue commands for a compute node. */
-    Result<void> queue_compute_node(const GraphExecution& graph, const ComputeNode& node);
+    Result<void> queue_compute_node(VkCommandBuffer cmd, const ComputeNode& node, BoundState& bound);
 
-    /* Queue commands for a rasterisation node */
-    Result<void> queue_raster_node(const GraphExecution& graph, const RasterNode& node);
+    /**
+     * @brief Queue commands for a rasterisation node.
+     * @param bound State set by the previous nodes in the command buffer.
+     * @param begin Whether to begin a new rendering scope, otherwise the node continues the scope of the previous node.
+     * @param end Whether to end the rendering scope, otherwise the next node continues it.
+     */
+    Result<void> queue_raster_node(VkCommandBuffer cmd, const RasterNode& node, BoundState& bound, bool begin = true, bool end = true);
 
-    /* Queue commands to stage graph buffers. */
-    void queue_staging(const GraphExecution& graph);
+    /**
+     * @brief Set the dynamic raster state of a node which differs from the state already set, pipelines contain the rest.
+     * Shader objects have no pipeline, so all the fixed function state is set.
+     */
+    void queue_dynamic_state(VkCommandBuffer cmd, const RasterNode& node, BoundState& bound) const;
+
+    /* Record the commands to stage graph buffers, for the transfer queue. */
+    Result<void> queue_staging(GraphExecution& graph);
 
     /* Queue commands to render immediate mode gui. */
-    void queue_imgui(const GraphExecution& graph);
+    void queue_imgui(VkCommandBuffer cmd);
 
 public:
     /* Initialize the Render Graph. */
     PLATFORM_SPECIFIC Result<void> init(GPUAdapter& gpu);
+
+    /* Compile the pipelines listed in a manifest on all cores, so the first graphs don't miss the pipeline cache. */
+    PLATFORM_SPECIFIC Result<void> prewarm(std::string_view manifest_path);
+
+    /* Write a manifest of all pipelines compiled so far, to `prewarm(...)` the next run with. */
+    PLATFORM_SPECIFIC Result<void> save_pipeline_manifest(std::string_view manifest_path);
     
+    /* Create a transient texture, which is only valid for the current graph. */
+    PLATFORM_SPECIFIC Result<Image> create_transient_texture(TextureUsage usage, TextureFormat fmt, Size3D size, TextureMeta meta = TextureMeta());
+
+    /* Create a transient buffer, which is only valid for the current graph. */
+    PLATFORM_SPECIFIC Result<Buffer> create_transient_buffer(BufferUsage usage, u64 count, u64 stride = 0);
+
     /* Upload data to a GPU buffer resource. */
     PLATFORM_SPECIFIC void upload_buffer(Buffer& buffer, const void* data, u64 dst_offset, u64 size);
 
@@ -71,6 +276,7 @@ public:
     PLATFORM_SPECIFIC Result<void> deinit();
 
     /* To access nodes and waves. "./wrapper/descriptor_vk.cc" */
-    friend Result<void> node_push_descriptors(const RenderGraph& rg, const Pipeline& pipeline, const Node& node);
-    friend Result<void> wave_sync_descriptors(const RenderGraph& rg, u32 start, u32 end);
+    friend Result<void> node_push_descriptors(const RenderGraph& rg, VkCommandBuffer cmd, const Pipeline& pipeline, const Node& node);
+    friend Result<void> lane_sync_barriers(RenderGraph& rg, u32 start, u32 end, bool async, u64 index, SyncBarriers& barriers);
+    friend Result<void> wave_sync_descriptors(RenderGraph& rg, VkCommandBuffer cmd, u32 start, u32 end, bool async);
 };
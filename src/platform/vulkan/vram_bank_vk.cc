@@ -1,6 +1,7 @@
 #include "vram_bank_vk.hh"
 
 #include <utility>
+#include <algorithm>
 
 #include "wrapper/translate_vk.hh"
 
@@ -26,6 +27,18 @@ Result<void> VRAMBank::init(GPUAdapter& gpu) {
             return Err("failed to initialise vma.");
     }
 
+    /* Queue families which share resources, the async compute queue only uses them if async compute is enabled */
+    shared_count = 0u;
+    shared_families[shared_count++] = gpu.queue_families.queue_combined;
+    if (gpu.has_async_queue()) shared_families[shared_count++] = gpu.queue_families.queue_compute;
+
+    /* Buffers which are transfer destinations are also shared with the transfer queue, which runs the staging copies */
+    upload_count = shared_count;
+    const u32 transfer_family = gpu.queue_families.queue_transfer;
+    if (std::find(shared_families, shared_families + shared_count, transfer_family) == shared_families + shared_count) {
+        shared_families[upload_count++] = transfer_family;
+    }
+
     /* Initialize the Stack Pools */
     render_targets.init(gpu.get_max_render_targets());
     buffers.init(gpu.get_max_buffers());
@@ -294,18 +307,14 @@ Result<Buffer> VRAMBank::create_buffer(BufferUsage usage, u64 count, u64 stride)
     /* Pop a new buffer off the stock */
     StockPair resource = buffers.pop();
     resource.data.usage = usage;
+    resource.data.state = ResourceState {};
 
     /* Size of the buffer in bytes */
     const u64 size = stride == 0 ? count : count * stride;
     resource.data.size = size;
 
     /* Buffer creation info */
-    VkBufferCreateInfo buffer_ci { VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO };
-    buffer_ci.size = size;
-    buffer_ci.usage = translate::buffer_usage(usage);
-    buffer_ci.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-    buffer_ci.queueFamilyIndexCount = 1u;
-    buffer_ci.pQueueFamilyIndices = &gpu->queue_families.queue_combined;
+    const VkBufferCreateInfo buffer_ci = buffer_create_info(resource.data);
 
     /* Memory allocation info */
     VmaAllocationCreateInfo alloc_ci {};
@@ -317,24 +326,8 @@ Result<Buffer> VRAMBank::create_buffer(BufferUsage usage, u64 count, u64 stride)
         return Err("failed to create buffer.");
     }
 
-    /* Insert only Storage Buffers in the bindless descriptor set */
-    if (has_flag(usage, BufferUsage::Storage)) {
-        /* Create the bindless descriptor write template */
-        VkDescriptorBufferInfo buffer_info {};
-        buffer_info.buffer = resource.data.buffer;
-        buffer_info.offset = 0u;
-        buffer_info.range = size;
-
-        VkWriteDescriptorSet bindless_write { VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET };
-        bindless_write.dstSet = bindless_set;
-        bindless_write.dstArrayElement = resource.handle.get_index() - 1u;
-        bindless_write.descriptorCount = 1u;
-        bindless_write.pBufferInfo = &buffer_info;
-        bindless_write.dstBinding = BINDLESS_BUFFER_SLOT;
-        bindless_write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-
-        vkUpdateDescriptorSets(gpu->logical_device, 1u, &bindless_write, 0u, nullptr);
-    }
+    /* Insert the buffer into the bindless descriptor set */
+    bindless_buffer(resource.handle, resource.data);
 
     return Ok(resource.handle);
 }
@@ -349,20 +342,10 @@ Result<Texture> VRAMBank::create_texture(TextureUsage usage, TextureFormat fmt,
     resource.data.format = fmt;
     resource.data.size = size;
     resource.data.meta = meta;
-
-    const VkFormat format = translate::texture_format(fmt);
+    resource.data.reset_subresources();
 
     /* Image creation info */
-    VkImageCreateInfo texture_ci { VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO };
-    texture_ci.imageType = size.is_2d() ? VK_IMAGE_TYPE_2D : VK_IMAGE_TYPE_3D;
-    texture_ci.format = format;
-    texture_ci.extent = { std::max(size.x, 1u), std::max(size.y, 1u), std::max(size.z, 1u) };
-    texture_ci.mipLevels = std::max(1u, meta.mips);
-    texture_ci.arrayLayers = std::max(1u, meta.arrays);
-    texture_ci.samples = VK_SAMPLE_COUNT_1_BIT; /* No MSAA */
-    texture_ci.tiling = VK_IMAGE_TILING_OPTIMAL;
-    texture_ci.usage = translate::texture_usage(usage);
-    texture_ci.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    const VkImageCreateInfo texture_ci = texture_create_info(resource.data);
 
     /* Memory allocation info */
     VmaAllocationCreateInfo alloc_ci {};
@@ -377,34 +360,49 @@ Result<Texture> VRAMBank::create_texture(TextureUsage usage, TextureFormat fmt,
     return Ok(resource.handle);
 }
 
-Result<Image> VRAMBank::create_image(Texture texture, u32 mip, u32 layer) {
+Result<Image> VRAMBank::create_image(Texture texture, u32 mip, u32 layer, u32 mips) {
     /* Make sure the texture is valid */
     if (texture.is_null()) return Err("cannot create image for texture which is null.");
+    TextureSlot& texture_slot = textures.get(texture);
+
+    /* Make sure the mip levels are inside the texture */
+    const u32 mip_count = std::max(1u, texture_slot.meta.mips);
+    if (mip >= mip_count || mips > mip_count - mip) {
+        return Err("image mip range [%u, %u) is outside of its texture. (%u mips)", mip, mip + std::max(1u, mips), mip_count);
+    }
 
     /* Pop a new image off the stock */
     StockPair resource = images.pop();
     resource.data.texture = texture;
-    TextureSlot& texture_slot = textures.get(texture);
     texture_slot.images.push_back(resource.handle);
     
     /* Image access sub resource range */
     VkImageSubresourceRange sub_range {};
     sub_range.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT; /* Color hardcoded! (might want depth too) */
     sub_range.baseMipLevel = mip;
-    sub_range.levelCount = std::max(1u, texture_slot.meta.mips - mip);
+    sub_range.levelCount = mips == 0u ? mip_count - mip : mips;
     sub_range.baseArrayLayer = layer;
     sub_range.layerCount = std::max(1u, texture_slot.meta.arrays - layer);
     resource.data.sub_range = sub_range;
 
+    /* Create the image view, and insert it into the bindless descriptor set */
+    if (Result r = create_view(resource.handle, resource.data); r.is_err()) return Err(r.unwrap_err());
+
+    return Ok(resource.handle);
+}
+
+Result<void> VRAMBank::create_view(Image image, ImageSlot& slot) {
+    const TextureSlot& texture_slot = textures.get(slot.texture);
+
     /* Image view creation info */
     VkImageViewCreateInfo view_ci { VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO };
     view_ci.image = texture_slot.image;
     view_ci.viewType = texture_slot.size.is_2d() ? VK_IMAGE_VIEW_TYPE_2D : VK_IMAGE_VIEW_TYPE_3D;
     view_ci.format = translate::texture_format(texture_slot.format);
-    view_ci.subresourceRange = sub_range;
+    view_ci.subresourceRange = slot.sub_range;
 
     /* Create the image view */
-    if (vkCreateImageView(gpu->logical_device, &view_ci, nullptr, &resource.data.view) != VK_SUCCESS) {
+    if (vkCreateImageView(gpu->logical_device, &view_ci, nullptr, &slot.view) != VK_SUCCESS) {
         return Err("failed to create image view.");
     }
 
@@ -413,12 +411,12 @@ Result<Image> VRAMBank::create_image(Texture texture, u32 mip, u32 layer) {
         /* Create the bindless descriptor write template */
         VkDescriptorImageInfo image_info {};
         image_info.sampler = VK_NULL_HANDLE;
-        image_info.imageView = resource.data.view;
+        image_info.imageView = slot.view;
         image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 
         VkWriteDescriptorSet bindless_write { VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET };
         bindless_write.dstSet = bindless_set;
-        bindless_write.dstArrayElement = resource.handle.get_index() - 1u;
+        bindless_write.dstArrayElement = image.get_index() - 1u;
         bindless_write.descriptorCount = 1u;
         bindless_write.pImageInfo = &image_info;
         bindless_write.descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
@@ -426,8 +424,54 @@ Result<Image> VRAMBank::create_image(Texture texture, u32 mip, u32 layer) {
 
         vkUpdateDescriptorSets(gpu->logical_device, 1u, &bindless_write, 0u, nullptr);
     }
+    return Ok();
+}
 
-    return Ok(resource.handle);
+void VRAMBank::bindless_buffer(Buffer buffer, const BufferSlot& slot) {
+    /* Insert only Storage Buffers in the bindless descriptor set */
+    if (has_flag(slot.usage, BufferUsage::Storage) == false) return;
+
+    /* Create the bindless descriptor write template */
+    VkDescriptorBufferInfo buffer_info {};
+    buffer_info.buffer = slot.buffer;
+    buffer_info.offset = 0u;
+    buffer_info.range = slot.size;
+
+    VkWriteDescriptorSet bindless_write { VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET };
+    bindless_write.dstSet = bindless_set;
+    bindless_write.dstArrayElement = buffer.get_index() - 1u;
+    bindless_write.descriptorCount = 1u;
+    bindless_write.pBufferInfo = &buffer_info;
+    bindless_write.dstBinding = BINDLESS_BUFFER_SLOT;
+    bindless_write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+
+    vkUpdateDescriptorSets(gpu->logical_device, 1u, &bindless_write, 0u, nullptr);
+}
+
+VkBufferCreateInfo VRAMBank::buffer_create_info(const BufferSlot& slot) const {
+    VkBufferCreateInfo buffer_ci { VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO };
+    buffer_ci.size = slot.size;
+    buffer_ci.usage = translate::buffer_usage(slot.usage);
+    buffer_ci.queueFamilyIndexCount = has_flag(slot.usage, BufferUsage::TransferDst) ? upload_count : shared_count;
+    buffer_ci.sharingMode = buffer_ci.queueFamilyIndexCount > 1u ? VK_SHARING_MODE_CONCURRENT : VK_SHARING_MODE_EXCLUSIVE;
+    buffer_ci.pQueueFamilyIndices = shared_families;
+    return buffer_ci;
+}
+
+VkImageCreateInfo VRAMBank::texture_create_info(const TextureSlot& slot) const {
+    VkImageCreateInfo texture_ci { VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO };
+    texture_ci.imageType = slot.size.is_2d() ? VK_IMAGE_TYPE_2D : VK_IMAGE_TYPE_3D;
+    texture_ci.format = translate::texture_format(slot.format);
+    texture_ci.extent = { std::max(slot.size.x, 1u), std::max(slot.size.y, 1u), std::max(slot.size.z, 1u) };
+    texture_ci.mipLevels = std::max(1u, slot.meta.mips);
+    texture_ci.arrayLayers = std::max(1u, slot.meta.arrays);
+    texture_ci.samples = VK_SAMPLE_COUNT_1_BIT; /* No MSAA */
+    texture_ci.tiling = VK_IMAGE_TILING_OPTIMAL;
+    texture_ci.usage = translate::texture_usage(slot.usage);
+    texture_ci.sharingMode = shared_count > 1u ? VK_SHARING_MODE_CONCURRENT : VK_SHARING_MODE_EXCLUSIVE;
+    texture_ci.queueFamilyIndexCount = shared_count > 1u ? shared_count : 0u;
+    texture_ci.pQueueFamilyIndices = shared_families;
+    return texture_ci;
 }
 
 Result<Sampler> VRAMBank::create_sampler(Filter filter, AddressMode mode, BorderColor border) {
@@ -456,6 +500,117 @@ Result<Sampler> VRAMBank::create_sampler(Filter filter, AddressMode mode, Border
     return Ok(resource.handle);
 }
 
+Result<Image> VRAMBank::create_unbound_texture(TextureUsage usage, TextureFormat fmt, Size3D size, TextureMeta meta) {
+    /* Make sure the texture usage is valid */
+    if (usage == TextureUsage::Invalid) return Err("invalid texture usage.");
+
+    /* Pop a new texture off the stock */
+    StockPair texture = textures.pop();
+    texture.data.usage = usage;
+    texture.data.format = fmt;
+    texture.data.size = size;
+    texture.data.meta = meta;
+    texture.data.alloc = VK_NULL_HANDLE;
+    texture.data.reset_subresources();
+
+    /* Create the texture, without allocating memory for it */
+    const VkImageCreateInfo texture_ci = texture_create_info(texture.data);
+    if (vkCreateImage(gpu->logical_device, &texture_ci, nullptr, &texture.data.image) != VK_SUCCESS) {
+        return Err("failed to create transient image resource.");
+    }
+
+    /* Pop a new image off the stock, its view is created once memory is bound */
+    StockPair image = images.pop();
+    image.data.texture = texture.handle;
+    image.data.view = VK_NULL_HANDLE;
+    image.data.sub_range = { VK_IMAGE_ASPECT_COLOR_BIT, 0u, std::max(1u, meta.mips), 0u, std::max(1u, meta.arrays) };
+    texture.data.images.push_back(image.handle);
+
+    return Ok(image.handle);
+}
+
+Result<Buffer> VRAMBank::create_unbound_buffer(BufferUsage usage, u64 count, u64 stride) {
+    /* Make sure the buffer usage is valid */
+    if (usage == BufferUsage::Invalid) return Err("invalid buffer usage.");
+
+    /* Pop a new buffer off the stock */
+    StockPair resource = buffers.pop();
+    resource.data.usage = usage;
+    resource.data.size = stride == 0 ? count : count * stride;
+    resource.data.alloc = VK_NULL_HANDLE;
+    resource.data.state = ResourceState {};
+
+    /* Create the buffer, without allocating memory for it */
+    const VkBufferCreateInfo buffer_ci = buffer_create_info(resource.data);
+    if (vkCreateBuffer(gpu->logical_device, &buffer_ci, nullptr, &resource.data.buffer) != VK_SUCCESS) {
+        return Err("failed to create transient buffer.");
+    }
+
+    return Ok(resource.handle);
+}
+
+VkMemoryRequirements VRAMBank::unbound_requirements(BindHandle resource) {
+    VkMemoryRequirements requirements {};
+    if (resource.get_type() == ResourceType::Image) {
+        const TextureSlot& texture = textures.get(images.get(resource).texture);
+        vkGetImageMemoryRequirements(gpu->logical_device, texture.image, &requirements);
+    } else {
+        vkGetBufferMemoryRequirements(gpu->logical_device, buffers.get(resource).buffer, &requirements);
+    }
+    return requirements;
+}
+
+Result<void> VRAMBank::bind_unbound(BindHandle resource, VmaAllocation memory, u64 offset, bool rebind) {
+    if (resource.get_type() == ResourceType::Image) {
+        ImageSlot& image = images.get(resource);
+        TextureSlot& texture = textures.get(image.texture);
+
+        /* Resources can only be bound once, so re-create it to move it */
+        if (rebind) {
+            vkDestroyImageView(gpu->logical_device, image.view, nullptr);
+            vkDestroyImage(gpu->logical_device, texture.image, nullptr);
+            image.view = VK_NULL_HANDLE;
+            const VkImageCreateInfo texture_ci = texture_create_info(texture);
+            if (vkCreateImage(gpu->logical_device, &texture_ci, nullptr, &texture.image) != VK_SUCCESS) {
+                return Err("failed to re-create transient image resource.");
+            }
+        }
+
+        /* Bind the memory, and create the image view */
+        if (vmaBindImageMemory2(vma_allocator, memory, offset, texture.image, nullptr) != VK_SUCCESS) {
+            return Err("failed to bind transient image memory.");
+        }
+        return create_view((Image&)resource, image);
+    }
+
+    BufferSlot& buffer = buffers.get(resource);
+
+    /* Resources can only be bound once, so re-create it to move it */
+    if (rebind) {
+        vkDestroyBuffer(gpu->logical_device, buffer.buffer, nullptr);
+        const VkBufferCreateInfo buffer_ci = buffer_create_info(buffer);
+        if (vkCreateBuffer(gpu->logical_device, &buffer_ci, nullptr, &buffer.buffer) != VK_SUCCESS) {
+            return Err("failed to re-create transient buffer.");
+        }
+    }
+
+    /* Bind the memory, and insert the buffer into the bindless descriptor set */
+    if (vmaBindBufferMemory2(vma_allocator, memory, offset, buffer.buffer, nullptr) != VK_SUCCESS) {
+        return Err("failed to bind transient buffer memory.");
+    }
+    bindless_buffer((Buffer&)resource, buffer);
+    return Ok();
+}
+
+void VRAMBank::destroy_unbound(BindHandle& resource) {
+    if (resource.get_type() == ResourceType::Image) {
+        /* Release the texture together with its image */
+        Texture texture = get_texture((Image&)resource);
+        destroy(texture);
+    }
+    destroy(resource);
+}
+
 Result<void> VRAMBank::resize_render_target(RenderTarget &render_target, u32 width, u32 height) {
     /* Wait for the queue to idle */
     vkQueueWaitIdle(gpu->queues.queue_combined);
@@ -535,7 +690,7 @@ Result<void> VRAMBank::resize_texture(Texture& texture, Size3D size) {
 
     TextureSlot& data = textures.get(texture);
     data.size = size;
-    data.layout = VK_IMAGE_LAYOUT_UNDEFINED;
+    data.reset_subresources();
 
     /* Destroy All Image Views */
     for (u32 i = 0; i < data.images.size(); i++) {
@@ -546,20 +701,8 @@ Result<void> VRAMBank::resize_texture(Texture& texture, Size3D size) {
     /* Destroy Image */
     vmaDestroyImage(vma_allocator, data.image, data.alloc);
 
-    VkFormat format = translate::texture_format(data.format);
-
     /* Image creation info */
-    VkImageCreateInfo texture_ci {VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO};
-    texture_ci.imageType = size.is_2d() ? VK_IMAGE_TYPE_2D : VK_IMAGE_TYPE_3D;
-    texture_ci.format = format;
-    texture_ci.extent = {std::max(size.x, 1u), std::max(size.y, 1u), std::max(size.z, 1u)};
-    texture_ci.mipLevels = std::max(1u, data.meta.mips);
-    texture_ci.arrayLayers = std::max(1u, data.meta.arrays);
-    texture_ci.samples = VK_SAMPLE_COUNT_1_BIT; /* No MSAA */
-    texture_ci.tiling = VK_IMAGE_TILING_OPTIMAL;
-    texture_ci.usage = translate::texture_usage(data.usage);
-    texture_ci.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-    texture_ci.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    const VkImageCreateInfo texture_ci = texture_create_info(data);
 
     /* Memory allocation info */
     VmaAllocationCreateInfo alloc_ci {};
@@ -621,17 +764,13 @@ Result<void> VRAMBank::resize_buffer(Buffer& buffer, u64 count, u64 stride) {
     /* Size of the buffer in bytes */
     const u64 size = stride == 0 ? count : count * stride;
     data.size = size;
+    data.state = ResourceState {};
 
     /* Destroy the existing buffer */
     vmaDestroyBuffer(vma_allocator, data.buffer, data.alloc);
 
     /* Buffer creation info */
-    VkBufferCreateInfo buffer_ci { VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO };
-    buffer_ci.size = size;
-    buffer_ci.usage = translate::buffer_usage(data.usage);
-    buffer_ci.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-    buffer_ci.queueFamilyIndexCount = 1u;
-    buffer_ci.pQueueFamilyIndices = &gpu->queue_families.queue_combined;
+    const VkBufferCreateInfo buffer_ci = buffer_create_info(data);
 
     /* Memory allocation info */
     VmaAllocationCreateInfo alloc_ci {};
@@ -706,6 +845,7 @@ Result<void> VRAMBank::upload_buffer(Buffer& buffer, const void* data, u64 dst_o
     if (begin_upload() == false) return Err("failed to begin upload."); /* Begin recording commands */
     vkCmdCopyBuffer(upload_cmd, staging_buffer, slot.buffer, 1u, &copy);
     if (end_upload() == false) return Err("failed to end upload."); /* End recording commands */
+    slot.state = ResourceState {}; /* <- written outside of the graph */
 
     /* Destroy staging buffer */
     vmaDestroyBuffer(vma_allocator, staging_buffer, alloc);
@@ -745,17 +885,18 @@ Result<void> VRAMBank::upload_texture(Texture& texture, const void* data, const
     copy.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0u, 0u, 1u };
     copy.imageExtent = VkExtent3D { std::max(texture_slot.size.x, 1u), std::max(texture_slot.size.y, 1u), std::max(texture_slot.size.z, 1u) };
 
-    /* Create an image layout transition barrier */
+    /* Create an image layout transition barrier (only the first mip & layer is uploaded) */
+    SubresourceState& subresource = texture_slot.subresource(0u, 0u);
     VkImageMemoryBarrier2 image_barrier { VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2 };
     image_barrier.srcStageMask = VK_PIPELINE_STAGE_2_BOTTOM_OF_PIPE_BIT;
     image_barrier.srcAccessMask = VK_ACCESS_2_NONE;
     image_barrier.dstStageMask = VK_PIPELINE_STAGE_2_TOP_OF_PIPE_BIT;
     image_barrier.dstAccessMask = VK_ACCESS_2_NONE;
-    image_barrier.oldLayout = texture_slot.layout;
+    image_barrier.oldLayout = subresource.layout;
     image_barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
     image_barrier.image = texture_slot.image;
     image_barrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0u, 1u, 0u, 1u };
-    texture_slot.layout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    subresource.layout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
 
     /* Render target dependency info */
     VkDependencyInfo dep_info { VK_STRUCTURE_TYPE_DEPENDENCY_INFO };
@@ -766,6 +907,7 @@ Result<void> VRAMBank::upload_texture(Texture& texture, const void* data, const
     vkCmdPipelineBarrier2KHR(upload_cmd, &dep_info);
     vkCmdCopyBufferToImage(upload_cmd, staging_buffer, texture_slot.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1u, &copy);
     if (end_upload() == false) return Err("failed to end upload."); /* End recording commands */
+    subresource.state = ResourceState {}; /* <- written outside of the graph */
 
     vmaDestroyBuffer(vma_allocator, staging_buffer, alloc); /* Destroy staging buffer */
 
@@ -1,12 +1,14 @@
 #pragma once
 
 #include <vector>
+#include <algorithm>
 
 /* Interface header */
 #include "graphite/vram_bank.hh"
 
 #include "graphite/utils/types.hh"
 #include "vulkan/api_vk.hh" /* Vulkan API */
+#include "wrapper/barrier_vk.hh"
 
 class Node;
 
@@ -35,6 +37,11 @@ class VRAMBank : public AgnVRAMBank {
     VkDescriptorSetLayout bindless_layout {};
     VkDescriptorSet bindless_set {};
 
+    /* Queue families which buffers & textures are shared with. (combined, async compute, transfer) */
+    u32 shared_families[3] {};
+    /* Number of shared queue families for all resources, and for buffers which are transfer destinations. */
+    u32 shared_count = 1u, upload_count = 1u;
+
     /* Upload Resources */
     VkCommandPool upload_cmd_pool {};
     VkCommandBuffer upload_cmd {};
@@ -54,6 +61,26 @@ class VRAMBank : public AgnVRAMBank {
     /* Destroy a sampler resource. */
     PLATFORM_SPECIFIC void destroy_sampler(Sampler& sampler);
 
+    /* Create the image view of an image resource, and insert it into the bindless descriptor set. */
+    Result<void> create_view(Image image, ImageSlot& slot);
+    /* Insert a buffer resource into the bindless descriptor set. (only storage buffers) */
+    void bindless_buffer(Buffer buffer, const BufferSlot& slot);
+    /* Get the creation info of a buffer resource. */
+    VkBufferCreateInfo buffer_create_info(const BufferSlot& slot) const;
+    /* Get the creation info of a texture resource. */
+    VkImageCreateInfo texture_create_info(const TextureSlot& slot) const;
+
+    /* Create a texture without memory, and an image of the whole texture. (memory is bound using `bind_unbound()`) */
+    Result<Image> create_unbound_texture(TextureUsage usage, TextureFormat fmt, Size3D size, TextureMeta meta);
+    /* Create a buffer without memory. (memory is bound using `bind_unbound()`) */
+    Result<Buffer> create_unbound_buffer(BufferUsage usage, u64 count, u64 stride);
+    /* Get the memory requirements of an image or buffer created without memory. */
+    VkMemoryRequirements unbound_requirements(BindHandle resource);
+    /* Bind memory to an image or buffer created without memory, `rebind` re-creates a resource which was bound before. */
+    Result<void> bind_unbound(BindHandle resource, VmaAllocation memory, u64 offset, bool rebind);
+    /* Release an image or buffer created without memory. (the texture of an image is released too) */
+    void destroy_unbound(BindHandle& resource);
+
     /* Begin recording immediate commands. */
     bool begin_upload();
     /* End recording immediate commands, submit, and wait for commands to finish. */
@@ -71,8 +98,8 @@ public:
     PLATFORM_SPECIFIC Result<Buffer> create_buffer(BufferUsage usage, u64 count, u64 stride = 0);
     /* Create a new texture resource. */
     PLATFORM_SPECIFIC Result<Texture> create_texture(TextureUsage usage, TextureFormat fmt, Size3D size, TextureMeta meta = TextureMeta());
-    /* Create a new image resource. */
-    PLATFORM_SPECIFIC Result<Image> create_image(Texture texture, u32 mip = 0u, u32 layer = 0u);
+    /* Create a new image resource, covering `mips` mip levels starting at `mip`. (0 covers all remaining mip levels) */
+    PLATFORM_SPECIFIC Result<Image> create_image(Texture texture, u32 mip = 0u, u32 layer = 0u, u32 mips = 0u);
     /* Create a new sampler resource. */
     PLATFORM_SPECIFIC Result<Sampler> create_sampler(Filter filter = Filter::Linear, AddressMode mode = AddressMode::Repeat, BorderColor border = BorderColor::RGB0A0_Float);
 
@@ -95,8 +122,9 @@ public:
     PLATFORM_SPECIFIC Result<void> deinit();
 
     /* To access resource getters. "./wrapper/descriptor_vk.cc" */
-    friend Result<void> node_push_descriptors(const RenderGraph& rg, const Pipeline& pipeline, const Node& node);
-    friend Result<void> wave_sync_descriptors(const RenderGraph& rg, u32 start, u32 end);
+    friend Result<void> node_push_descriptors(const RenderGraph& rg, VkCommandBuffer cmd, const Pipeline& pipeline, const Node& node);
+    friend Result<void> lane_sync_barriers(RenderGraph& rg, u32 start, u32 end, bool async, u64 index, SyncBarriers& barriers);
+    friend Result<void> wave_sync_descriptors(RenderGraph& rg, VkCommandBuffer cmd, u32 start, u32 end, bool async);
     /* To access resource getters. */
     friend class RenderGraph;
     friend class AgnGPUAdapter;
@@ -129,6 +157,9 @@ struct RenderTargetSlot {
     inline VkImageView& view() { return views[current_image]; };
     inline VkSemaphore& semaphore() { return semaphores[current_image]; };
     inline VkImageLayout& old_layout() { return old_layouts[current_image]; };
+
+    /* Access state of the current image. (reset when an image is acquired) */
+    ResourceState state {};
 };
 
 /* Buffer resource slot. */
@@ -142,6 +173,9 @@ struct BufferSlot {
     /* Metadata */
     BufferUsage usage {};
     u64 size = 0u;
+
+    /* Access state, for barriers */
+    ResourceState state {};
 };
 
 /* Texture resource slot. */
@@ -151,7 +185,8 @@ struct TextureSlot {
 
     /* Resource */
     VkImage image {};
-    VkImageLayout layout {};
+    /* Layout & access state of each mip level & array layer, indexed by `mip * layers + layer`. (for barriers) */
+    std::vector<SubresourceState> subresources {};
 
     /* Metadata */
     Size3D size {};
@@ -161,6 +196,13 @@ struct TextureSlot {
 
     /* List of Images created from this Texture */
     std::vector<Image> images {};
+
+    /* Get the number of array layers. */
+    inline u32 layers() const { return std::max(1u, meta.arrays); };
+    /* Get the state of a subresource. */
+    inline SubresourceState& subresource(u32 mip, u32 layer) { return subresources[mip * layers() + layer]; };
+    /* Reset the state of all subresources, should be called when their contents become undefined. */
+    inline void reset_subresources() { subresources.assign(std::max(1u, meta.mips) * layers(), SubresourceState {}); };
 };
 
 /* Image resource slot. */
@@ -0,0 +1,132 @@
+#include "barrier_vk.hh"
+
+#include "vulkan/vram_bank_vk.hh"
+
+#include <algorithm>
+
+/* Accesses which write to memory, only these have to be made available by a barrier. */
+constexpr VkAccessFlags2 WRITE_ACCESS = VK_ACCESS_2_SHADER_WRITE_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT
+    | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_2_TRANSFER_WRITE_BIT | VK_ACCESS_2_MEMORY_WRITE_BIT;
+
+bool track_access(ResourceState& state, u32 queue, const ResourceAccess& use, u64 index, bool transition, BarrierSource& src) {
+    src = BarrierSource {};
+    const bool same_queue = state.write_queue == queue || state.write_queue == ResourceState::ANY_QUEUE;
+    const u64 write_index = state.write_queue == ResourceState::ANY_QUEUE ? 0u : state.write_index;
+    bool unknown = false; /* <- whether the barrier waits for an access without index */
+
+    if (use.write || transition) {
+        /* Write-after-write & write-after-read, a layout transition is a write too */
+        if (same_queue) {
+            src.stages |= state.write_stages;
+            src.access |= state.write_access;
+            src.index = write_index;
+            unknown |= write_index == 0u;
+        }
+        if (state.read_stages[queue] != VK_PIPELINE_STAGE_2_NONE) {
+            src.stages |= state.read_stages[queue];
+            src.index = std::max(src.index, state.read_index[queue]);
+            unknown |= state.read_index[queue] == 0u;
+        }
+    } else if (same_queue) {
+        /* Read-after-write, unless an earlier barrier already made the write visible to these stages */
+        const bool visible = (use.stages & ~state.visible_stages[queue]) == 0u && (use.access & ~state.visible_access[queue]) == 0u;
+        if (visible == false) {
+            src.stages = state.write_stages;
+            src.access = state.write_access;
+            src.index = write_index;
+            unknown |= write_index == 0u;
+        }
+    }
+
+    /* Layout transitions without earlier accesses on this queue still need stages to chain with a queue wait */
+    if (transition && src.stages == VK_PIPELINE_STAGE_2_NONE) {
+        src.stages = use.stages;
+        unknown = true;
+    }
+    if (unknown) src.index = 0u;
+    const bool barrier = src.stages != VK_PIPELINE_STAGE_2_NONE;
+
+    if (use.write || transition) {
+        /* Later accesses wait for this write, or for the layout transition */
+        state.write_stages = use.stages;
+        state.write_access = use.access & WRITE_ACCESS;
+        state.write_queue = queue;
+        state.write_index = index;
+        for (u32 q = 0u; q < 2u; ++q) {
+            state.read_stages[q] = VK_PIPELINE_STAGE_2_NONE;
+            state.visible_stages[q] = VK_PIPELINE_STAGE_2_NONE;
+            state.visible_access[q] = VK_ACCESS_2_NONE;
+            state.read_index[q] = 0u;
+        }
+        if (use.write) return barrier;
+
+        /* The layout transition is visible to the read which caused it */
+        state.read_stages[queue] = use.stages;
+        state.visible_stages[queue] = use.stages;
+        state.visible_access[queue] = use.access;
+        state.read_index[queue] = index;
+        return barrier;
+    }
+
+    state.read_stages[queue] |= use.stages;
+    state.read_index[queue] = std::max(state.read_index[queue], index);
+    if (barrier) {
+        state.visible_stages[queue] |= use.stages;
+        state.visible_access[queue] |= use.access;
+    }
+    return barrier;
+}
+
+/* Check whether two image barriers of the same access have the same source scope, layers & old layout. */
+static bool same_image_barrier(const VkImageMemoryBarrier2& a, const VkImageMemoryBarrier2& b) {
+    return a.srcStageMask == b.srcStageMask && a.srcAccessMask == b.srcAccessMask && a.oldLayout == b.oldLayout
+        && a.subresourceRange.baseArrayLayer == b.subresourceRange.baseArrayLayer && a.subresourceRange.layerCount == b.subresourceRange.layerCount;
+}
+
+void track_image_access(TextureSlot& texture, const VkImageSubresourceRange& range, u32 queue, const ResourceAccess& use, VkImageLayout layout, u64 index, SyncBarriers& barriers) {
+    const size_t first = barriers.images.size(); /* <- only the barriers of this access are merged */
+
+    for (u32 mip = range.baseMipLevel; mip < range.baseMipLevel + range.levelCount; ++mip) {
+        const size_t mip_first = barriers.images.size();
+
+        for (u32 layer = range.baseArrayLayer; layer < range.baseArrayLayer + range.layerCount; ++layer) {
+            SubresourceState& subresource = texture.subresource(mip, layer);
+            const VkImageLayout old_layout = subresource.layout;
+            subresource.layout = layout;
+
+            BarrierSource src {};
+            if (track_access(subresource.state, queue, use, index, old_layout != layout, src) == false) continue;
+            barriers.min_src = std::min(barriers.min_src, src.index);
+            barriers.max_src = std::max(barriers.max_src, src.index);
+
+            /* Extend the barrier of the previous layer if it's in the same state */
+            if (barriers.images.size() > mip_first) {
+                VkImageMemoryBarrier2& last = barriers.images.back();
+                VkImageSubresourceRange& last_range = last.subresourceRange;
+                if (last.srcStageMask == src.stages && last.srcAccessMask == src.access && last.oldLayout == old_layout
+                    && last_range.baseArrayLayer + last_range.layerCount == layer) {
+                    last_range.layerCount += 1u;
+                    continue;
+                }
+            }
+
+            VkImageMemoryBarrier2& barrier = barriers.images.emplace_back(VkImageMemoryBarrier2 { VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2 });
+            barrier.srcStageMask = src.stages;
+            barrier.srcAccessMask = src.access;
+            barrier.dstStageMask = use.stages;
+            barrier.dstAccessMask = use.access;
+            barrier.oldLayout = old_layout;
+            barrier.newLayout = layout;
+            barrier.image = texture.image;
+            barrier.subresourceRange = { range.aspectMask, mip, 1u, layer, 1u };
+        }
+
+        /* Extend the barrier of the previous mip if this mip needs the same single barrier */
+        if (barriers.images.size() != mip_first + 1u || mip_first == first) continue;
+        VkImageMemoryBarrier2& prev = barriers.images[mip_first - 1u];
+        if (same_image_barrier(prev, barriers.images.back()) && prev.subresourceRange.baseMipLevel + prev.subresourceRange.levelCount == mip) {
+            prev.subresourceRange.levelCount += 1u;
+            barriers.images.pop_back();
+        }
+    }
+}
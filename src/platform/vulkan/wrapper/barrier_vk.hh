@@ -0,0 +1,80 @@
+#pragma once
+
+#include <vector>
+
+#include "vulkan/api_vk.hh" /* Vulkan API */
+#include "graphite/utils/types.hh"
+
+struct TextureSlot;
+
+/**
+ * Access state of a buffer or image, used to find the accesses which need a barrier.
+ * The default state is an unknown write, so the first access always waits for all earlier commands.
+ */
+struct ResourceState {
+    /* Queue of an unknown write, it is treated as a write on every queue. */
+    static constexpr u32 ANY_QUEUE = UINT32_MAX;
+
+    /* Stages, accesses & queue of the last write. (or layout transition) */
+    VkPipelineStageFlags2 write_stages = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+    VkAccessFlags2 write_access = VK_ACCESS_2_MEMORY_WRITE_BIT;
+    u32 write_queue = ANY_QUEUE;
+
+    /* Stages which read the resource since the last write, per queue. (combined, async compute) */
+    VkPipelineStageFlags2 read_stages[2] {};
+    /* Stages & accesses which the last write was made visible to, per queue. */
+    VkPipelineStageFlags2 visible_stages[2] {};
+    VkAccessFlags2 visible_access[2] {};
+
+    /* Access index of the last write, and of the last read since then per queue. (0 if unknown) */
+    u64 write_index = 0u;
+    u64 read_index[2] {};
+};
+
+/* Access of a resource by the commands following a barrier. */
+struct ResourceAccess {
+    VkPipelineStageFlags2 stages = VK_PIPELINE_STAGE_2_NONE;
+    VkAccessFlags2 access = VK_ACCESS_2_NONE;
+    bool write = false;
+};
+
+/* Layout & access state of a texture subresource. (one mip level of one array layer) */
+struct SubresourceState {
+    VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+    ResourceState state {};
+};
+
+/* Source scope of a barrier. */
+struct BarrierSource {
+    VkPipelineStageFlags2 stages = VK_PIPELINE_STAGE_2_NONE;
+    VkAccessFlags2 access = VK_ACCESS_2_NONE;
+    /* Highest access index the barrier waits for, 0 if it waits for an unknown access. (on this queue) */
+    u64 index = 0u;
+};
+
+/* Barriers needed by a range of lanes. */
+struct SyncBarriers {
+    std::vector<VkBufferMemoryBarrier2> buffers {};
+    std::vector<VkImageMemoryBarrier2> images {};
+    /* Lowest & highest access index which the last added barriers wait for. */
+    u64 min_src = UINT64_MAX, max_src = 0u;
+};
+
+/**
+ * @brief Track an access of a resource on a queue, and get the source scope of the barrier it needs.
+ * Accesses on the other queue are not waited for, the queues already wait for each other where the graph waves join.
+ *
+ * @param index Access index, increasing in recording order. (0 if the accesses don't need to be told apart)
+ * @param transition Whether the access needs an image layout transition.
+ * @return False if the access needs no barrier. (read-after-read, or the last write is already visible)
+ */
+bool track_access(ResourceState& state, u32 queue, const ResourceAccess& use, u64 index, bool transition, BarrierSource& src);
+
+/**
+ * @brief Track an access of a range of texture subresources, and append the barriers it needs.
+ * Each subresource is tracked on its own, subresources in the same state share a barrier.
+ *
+ * @param layout Layout which the access needs the subresources in.
+ * @param index Access index, see `track_access`.
+ */
+void track_image_access(TextureSlot& texture, const VkImageSubresourceRange& range, u32 queue, const ResourceAccess& use, VkImageLayout layout, u64 index, SyncBarriers& barriers);
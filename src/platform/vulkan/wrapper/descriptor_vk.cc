@@ -3,7 +3,11 @@
 #include "graphite/render_graph.hh"
 #include "graphite/vram_bank.hh"
 #include "graphite/nodes/node.hh"
+#include "graphite/nodes/compute_node.hh"
 #include "translate_vk.hh"
+#include "barrier_vk.hh"
+
+#include <algorithm>
 
 #include "vulkan/wrapper/pipeline_cache_vk.hh"
 
@@ -19,11 +23,8 @@ VkDescriptorSetLayoutBinding image_layout(u32 slot, const Dependency& dep, const
 /* Create a descriptor layout binding for an sampler resource. */
 VkDescriptorSetLayoutBinding sampler_layout(u32 slot, const Dependency& dep);
 
-/* Create the descriptor layout for a render graph node. */
-Result<VkDescriptorSetLayout> node_descriptor_layout(GPUAdapter& gpu, const Node &node) {
-    /* Descriptor bindings */
-    std::vector<VkDescriptorSetLayoutBinding> bindings {};
-
+/* Get the descriptor layout bindings of a render graph node. */
+Result<void> node_descriptor_bindings(GPUAdapter& gpu, const Node& node, std::vector<VkDescriptorSetLayoutBinding>& bindings) {
     /* Create a binding for each dependency */
     for (const Dependency& dep : node.dependencies) {
         const ResourceType rtype = dep.resource.get_type();
@@ -42,7 +43,8 @@ Result<VkDescriptorSetLayout> node_descriptor_layout(GPUAdapter& gpu, const Node
                 break;
             }
             case ResourceType::Image: {
-                const TextureSlot& texture = gpu.get_vram_bank().textures.get(dep.resource);
+                const ImageSlot& image = gpu.get_vram_bank().images.get(dep.resource);
+                const TextureSlot& texture = gpu.get_vram_bank().textures.get(image.texture);
                 bindings.push_back(image_layout(slot, dep, texture.usage));
                 break;
             }
@@ -54,7 +56,10 @@ Result<VkDescriptorSetLayout> node_descriptor_layout(GPUAdapter& gpu, const Node
                 return Err("invalid resource type used in graph.");
         }
     }
+    return Ok();
+}
 
+Result<VkDescriptorSetLayout> descriptor_layout(GPUAdapter& gpu, const std::vector<VkDescriptorSetLayoutBinding>& bindings) {
     /* Descriptor set layout creation info (using push descriptors) */
     VkDescriptorSetLayoutCreateInfo layout_ci { VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO };
     layout_ci.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_PUSH_DESCRIPTOR_BIT_KHR;
@@ -64,7 +69,7 @@ Result<VkDescriptorSetLayout> node_descriptor_layout(GPUAdapter& gpu, const Node
     /* Create the descriptor set layout */
     VkDescriptorSetLayout layout {};
     if (vkCreateDescriptorSetLayout(gpu.logical_device, &layout_ci, nullptr, &layout) != VK_SUCCESS) {
-        return Err("failed to create descriptor set layout for '%s' node.", node.label.data());
+        return Err("failed to create descriptor set layout.");
     }
     return Ok(layout);
 }
@@ -110,7 +115,7 @@ VkDescriptorSetLayoutBinding sampler_layout(u32 slot, const Dependency& dep) {
 }
 
 /* Push all descriptors for a render graph node onto the command buffer. */
-Result<void> node_push_descriptors(const RenderGraph& rg, const Pipeline& pipeline, const Node &node) {
+Result<void> node_push_descriptors(const RenderGraph& rg, VkCommandBuffer cmd, const Pipeline& pipeline, const Node &node) {
     /* Allocate memory for all the write commands and descriptors */
     const u32 binding_count = (u32)node.dependencies.size();
 
@@ -183,84 +188,153 @@ Result<void> node_push_descriptors(const RenderGraph& rg, const Pipeline& pipeli
     /* Push the descriptor writes onto the command buffer */
     const VkPipelineBindPoint bind_point = translate::pipeline_bind_point(node.type);
     if (bind_point == VK_PIPELINE_BIND_POINT_MAX_ENUM) return Err("unknown pipeline bind point from node type.");
-    vkCmdPushDescriptorSetKHR(rg.active_graph().cmd, bind_point, pipeline.layout, 0u, bindings, writes.data());
+    vkCmdPushDescriptorSetKHR(cmd, bind_point, pipeline.layout, 0u, bindings, writes.data());
     return Ok();
 }
 
-/* Synchronize all descriptors for a render graph wave. */
-Result<void> wave_sync_descriptors(const RenderGraph& rg, u32 start, u32 end) {
-    /* Memory barriers */
-    std::vector<VkBufferMemoryBarrier2> buf_barriers {};
-    std::vector<VkImageMemoryBarrier2> tex_barriers {};
+/* Access of a resource by a range of lanes, all dependencies on the same resource share one barrier. */
+struct LaneAccess {
+    BindHandle resource {};
+    ResourceAccess use {};
+    VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+};
+
+/* Merge an access into the accesses of a range of lanes. */
+static void merge_access(std::vector<LaneAccess>& accesses, BindHandle resource, const ResourceAccess& use, VkImageLayout layout) {
+    for (LaneAccess& access : accesses) {
+        if (access.resource.raw() != resource.raw()) continue;
+        access.use.stages |= use.stages;
+        access.use.access |= use.access;
+        /* Writes decide the layout, the other accesses of the lanes use the same layout anyway */
+        if (use.write) access.layout = layout;
+        access.use.write |= use.write;
+        return;
+    }
+    accesses.push_back(LaneAccess { resource, use, layout });
+}
+
+/* Synchronize all descriptors for a range of lanes in a render graph wave, `async` if they run on the async compute queue. */
+Result<void> lane_sync_barriers(RenderGraph& rg, u32 start, u32 end, bool async, u64 index, SyncBarriers& barriers) {
+    std::vector<LaneAccess> accesses {};
+    const u32 queue = async ? 1u : 0u;
 
     /* Get the active VRAM bank */
     VRAMBank& bank = rg.gpu->get_vram_bank();
 
-    /* Gather barrier information */
+    /* Gather the accesses of the lanes, merging duplicate dependencies */
     for (u32 i = start; i < end; ++i) {
         const Node& node = *rg.nodes[rg.waves[i].lane];
 
-        /* Add resource barriers for this execution wave */
         for (const Dependency& dep : node.dependencies) {
             const ResourceType rtype = dep.resource.get_type();
+            const VkPipelineStageFlags2 stages = translate::pipeline_stages(dep.stages, dep.flags);
+            const bool write = has_flag(dep.flags, DependencyFlags::Readonly) == false;
 
             switch (rtype) {
                 case ResourceType::RenderTarget: {
-                    RenderTargetSlot& rt = bank.render_targets.get(rg.target);
-                    VkImageMemoryBarrier2& barrier = tex_barriers.emplace_back(VkImageMemoryBarrier2 { VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2 });
-                    barrier.srcStageMask = VK_PIPELINE_STAGE_2_ALL_GRAPHICS_BIT;
-                    barrier.srcAccessMask = VK_ACCESS_2_SHADER_READ_BIT | VK_ACCESS_2_SHADER_WRITE_BIT;
-                    barrier.dstStageMask = VK_PIPELINE_STAGE_2_ALL_GRAPHICS_BIT;
-                    barrier.dstAccessMask = VK_ACCESS_2_SHADER_READ_BIT | VK_ACCESS_2_SHADER_WRITE_BIT;
-                    barrier.oldLayout = rt.old_layout();
-                    barrier.newLayout = translate::desired_image_layout(TextureUsage::Storage | TextureUsage::Sampled, dep.flags);
-                    rt.old_layout() = barrier.newLayout;
-                    barrier.image = rt.image();
-                    barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0u, 1u, 0u, 1u};
+                    const VkImageLayout layout = translate::desired_image_layout(TextureUsage::Storage | TextureUsage::Sampled, dep.flags);
+                    merge_access(accesses, dep.resource, ResourceAccess { stages, translate::image_access(dep.flags), write }, layout);
                     break;
                 }
                 case ResourceType::Buffer: {
                     const BufferSlot& buffer = bank.buffers.get(dep.resource);
-                    VkBufferMemoryBarrier2& barrier = buf_barriers.emplace_back(VkBufferMemoryBarrier2 { VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2 });
-                    barrier.srcStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
-                    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
-                    barrier.dstStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
-                    barrier.dstAccessMask = VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
-                    barrier.buffer = buffer.buffer;
-                    barrier.offset = 0u;
-                    barrier.size = buffer.size;
+                    const VkAccessFlags2 access = translate::buffer_access(buffer.usage, dep.flags);
+                    merge_access(accesses, dep.resource, ResourceAccess { stages, access, write }, VK_IMAGE_LAYOUT_UNDEFINED);
                     break;
                 }
                 case ResourceType::Image: {
                     const ImageSlot& image = bank.images.get(dep.resource);
-                    TextureSlot& texture = bank.textures.get(image.texture);
-                    VkImageMemoryBarrier2& barrier = tex_barriers.emplace_back(VkImageMemoryBarrier2 { VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2 });
-                    barrier.srcStageMask = VK_PIPELINE_STAGE_2_ALL_GRAPHICS_BIT;
-                    barrier.srcAccessMask = VK_ACCESS_2_SHADER_READ_BIT | VK_ACCESS_2_SHADER_WRITE_BIT;
-                    barrier.dstStageMask = VK_PIPELINE_STAGE_2_ALL_GRAPHICS_BIT;
-                    barrier.dstAccessMask = VK_ACCESS_2_SHADER_READ_BIT | VK_ACCESS_2_SHADER_WRITE_BIT;
-                    barrier.oldLayout = texture.layout;
-                    barrier.newLayout = translate::desired_image_layout(texture.usage, dep.flags);
-                    texture.layout = barrier.newLayout;
-                    barrier.image = texture.image;
-                    barrier.subresourceRange = image.sub_range;
+                    const TextureSlot& texture = bank.textures.get(image.texture);
+                    const VkImageLayout layout = translate::desired_image_layout(texture.usage, dep.flags);
+                    merge_access(accesses, dep.resource, ResourceAccess { stages, translate::image_access(dep.flags), write }, layout);
                     break;
                 }
-                case ResourceType::Sampler: break;
+                case ResourceType::Sampler: continue;
                 default:
                     return Err("unknown resource type for sync barriers.");
             }
+            rg.stats.naive_barriers += 1u;
+        }
+
+        /* Indirect argument buffers are read by the indirect stage (they aren't dependencies) */
+        const ResourceAccess indirect { VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT, VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT, false };
+        if (node.type == NodeType::Compute) {
+            const ComputeNode& compute = (const ComputeNode&)node;
+            if (compute.indirect_buffer.is_null() == false) merge_access(accesses, compute.indirect_buffer, indirect, VK_IMAGE_LAYOUT_UNDEFINED);
+        } else if (node.type == NodeType::Raster) {
+            for (const DrawCall& draw_call : ((const RasterNode&)node).draws) {
+                if (draw_call.indirect_buffer.is_null() == false) merge_access(accesses, draw_call.indirect_buffer, indirect, VK_IMAGE_LAYOUT_UNDEFINED);
+            }
+        }
+    }
+
+    /* Only insert barriers for hazards & layout transitions */
+    barriers.min_src = UINT64_MAX;
+    barriers.max_src = 0u;
+    for (const LaneAccess& access : accesses) {
+        BarrierSource src {};
+
+        switch (access.resource.get_type()) {
+            case ResourceType::RenderTarget: {
+                RenderTargetSlot& rt = bank.render_targets.get(rg.target);
+                const bool transition = rt.old_layout() != access.layout;
+                if (track_access(rt.state, queue, access.use, index, transition, src) == false) continue;
+
+                VkImageMemoryBarrier2& barrier = barriers.images.emplace_back(VkImageMemoryBarrier2 { VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2 });
+                barrier.srcStageMask = src.stages;
+                barrier.srcAccessMask = src.access;
+                barrier.dstStageMask = access.use.stages;
+                barrier.dstAccessMask = access.use.access;
+                barrier.oldLayout = rt.old_layout();
+                barrier.newLayout = access.layout;
+                rt.old_layout() = barrier.newLayout;
+                barrier.image = rt.image();
+                barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0u, 1u, 0u, 1u};
+                break;
+            }
+            case ResourceType::Buffer: {
+                BufferSlot& buffer = bank.buffers.get(access.resource);
+                if (track_access(buffer.state, queue, access.use, index, false, src) == false) continue;
+
+                VkBufferMemoryBarrier2& barrier = barriers.buffers.emplace_back(VkBufferMemoryBarrier2 { VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2 });
+                barrier.srcStageMask = src.stages;
+                barrier.srcAccessMask = src.access;
+                barrier.dstStageMask = access.use.stages;
+                barrier.dstAccessMask = access.use.access;
+                barrier.buffer = buffer.buffer;
+                barrier.offset = 0u;
+                barrier.size = buffer.size;
+                break;
+            }
+            case ResourceType::Image: {
+                /* Only the mips & layers of the image are tracked, other images of the texture don't wait for it */
+                const ImageSlot& image = bank.images.get(access.resource);
+                TextureSlot& texture = bank.textures.get(image.texture);
+                track_image_access(texture, image.sub_range, queue, access.use, access.layout, index, barriers);
+                continue;
+            }
+            default: continue;
         }
+        barriers.min_src = std::min(barriers.min_src, src.index);
+        barriers.max_src = std::max(barriers.max_src, src.index);
     }
+    return Ok();
+}
+
+Result<void> wave_sync_descriptors(RenderGraph& rg, VkCommandBuffer cmd, u32 start, u32 end, bool async) {
+    SyncBarriers barriers {};
+    if (Result r = lane_sync_barriers(rg, start, end, async, 0u, barriers); r.is_err()) return r;
+    rg.stats.barriers += (u32)(barriers.buffers.size() + barriers.images.size());
+    if (barriers.buffers.empty() && barriers.images.empty()) return Ok();
 
     /* Wave dependency info */
     VkDependencyInfo dep_info { VK_STRUCTURE_TYPE_DEPENDENCY_INFO };
-    dep_info.bufferMemoryBarrierCount = (u32)buf_barriers.size();
-    dep_info.pBufferMemoryBarriers = buf_barriers.data();
-    dep_info.imageMemoryBarrierCount = (u32)tex_barriers.size();
-    dep_info.pImageMemoryBarriers = tex_barriers.data();
-    
+    dep_info.bufferMemoryBarrierCount = (u32)barriers.buffers.size();
+    dep_info.pBufferMemoryBarriers = barriers.buffers.data();
+    dep_info.imageMemoryBarrierCount = (u32)barriers.images.size();
+    dep_info.pImageMemoryBarriers = barriers.images.data();
+
     /* Insert the wave sync barrier */
-    vkCmdPipelineBarrier2KHR(rg.active_graph().cmd, &dep_info);
+    vkCmdPipelineBarrier2KHR(cmd, &dep_info);
     return Ok();
 }
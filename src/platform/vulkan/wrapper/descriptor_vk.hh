@@ -4,20 +4,32 @@
 #include "graphite/utils/result.hh"
 #include "graphite/utils/types.hh"
 
+#include <vector>
+
 struct Pipeline;
 struct RenderTarget;
 struct GraphExecution;
+struct SyncBarriers;
 
 class Node;
 class VRAMBank;
 class GPUAdapter;
 class RenderGraph;
 
-/* Create the descriptor layout for a render graph node. */
-Result<VkDescriptorSetLayout> node_descriptor_layout(GPUAdapter& gpu, const Node& node);
+/* Get the descriptor layout bindings of a render graph node. (appended to `bindings`) */
+Result<void> node_descriptor_bindings(GPUAdapter& gpu, const Node& node, std::vector<VkDescriptorSetLayoutBinding>& bindings);
+
+/* Create a push descriptor layout from a list of bindings. */
+Result<VkDescriptorSetLayout> descriptor_layout(GPUAdapter& gpu, const std::vector<VkDescriptorSetLayoutBinding>& bindings);
 
 /* Push all descriptors for a render graph node onto the command buffer. */
-Result<void> node_push_descriptors(const RenderGraph& rg, const Pipeline& pipeline, const Node& node);
+Result<void> node_push_descriptors(const RenderGraph& rg, VkCommandBuffer cmd, const Pipeline& pipeline, const Node& node);
+
+/**
+ * @brief Get the barriers which a range of lanes needs, and track their accesses. (appended to `barriers`)
+ * @param index Access index of the lanes, to find the accesses the barriers wait for. (0 if not needed)
+ */
+Result<void> lane_sync_barriers(RenderGraph& rg, u32 start, u32 end, bool async, u64 index, SyncBarriers& barriers);
 
-/* Synchronize all descriptors for a render graph wave. */
-Result<void> wave_sync_descriptors(const RenderGraph& rg, u32 start, u32 end);
+/* Synchronize all descriptors for a range of lanes in a render graph wave, `async` if they run on the async compute queue. */
+Result<void> wave_sync_descriptors(RenderGraph& rg, VkCommandBuffer cmd, u32 start, u32 end, bool async);
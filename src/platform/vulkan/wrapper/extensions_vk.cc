@@ -92,3 +92,7 @@ Result<void> query_extension_support(const VkPhysicalDevice device, const char*
     delete[] supported_extensions; /* Free the extensions list */
     return Ok();
 }
+
+bool query_optional_extension(const VkPhysicalDevice device, const char* extension) {
+    return query_extension_support(device, &extension, 1u).is_ok();
+}
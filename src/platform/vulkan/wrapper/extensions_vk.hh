@@ -34,3 +34,6 @@ bool query_validation_support(const char* layer_name);
 
 /* Query whether a physical device supports all required extensions. */
 Result<void> query_extension_support(const VkPhysicalDevice device, const char* const* extensions, const u32 count);
+
+/* Query whether a physical device supports an optional extension. */
+bool query_optional_extension(const VkPhysicalDevice device, const char* extension);
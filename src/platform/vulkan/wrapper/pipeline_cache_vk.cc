@@ -5,204 +5,1044 @@
 #include "graphite/nodes/compute_node.hh"
 #include "graphite/nodes/raster_node.hh"
 
+#include "graphite/render_graph.hh"
+#include "graphite/utils/hash.hh"
+#include "graphite/utils/thread_pool.hh"
+
 #include "shader_vk.hh"
+#include "reflect_vk.hh"
 #include "translate_vk.hh"
 #include "descriptor_vk.hh"
 
-void PipelineCache::evict() {
-    for (const auto& [_, pipeline] : cache) {
-        vkDestroyDescriptorSetLayout(gpu->logical_device, pipeline.descriptors, nullptr);
-        vkDestroyPipelineLayout(gpu->logical_device, pipeline.layout, nullptr);
-        vkDestroyPipeline(gpu->logical_device, pipeline.pipeline, nullptr);
+#include <algorithm>
+#include <chrono>
+#include <cstddef> /* offsetof */
+#include <cstdio>
+#include <cstring>
+#include <fstream> /* std::ifstream, std::ofstream */
+
+/* Header of a pipeline cache file, followed by the driver pipeline cache data. */
+struct PipelineCacheFile {
+    u32 magic = 0u;
+    u32 version = 0u;
+    /* Device which saved the file, the data is only valid for the same device & driver. */
+    u32 vendor_id = 0u, device_id = 0u, driver_version = 0u;
+    u8 cache_uuid[VK_UUID_SIZE] {};
+    u64 data_size = 0u;
+    u64 data_hash = 0u; /* To detect truncated or corrupted files. */
+};
+
+/* "GPCF" graphite pipeline cache file. */
+constexpr u32 PIPELINE_CACHE_MAGIC = 0x46435047u;
+constexpr u32 PIPELINE_CACHE_VERSION = 1u;
+
+/* Estimated driver memory used by a pipeline & its layouts, excluding its shader code. */
+constexpr u64 PIPELINE_OVERHEAD = 16384u;
+
+/* "GPMF" graphite pipeline manifest file. */
+constexpr u32 PIPELINE_MANIFEST_MAGIC = 0x464d5047u;
+constexpr u32 PIPELINE_MANIFEST_VERSION = 4u;
+/* Maximum number of pipelines & array items in a manifest file, larger counts are treated as corrupted. */
+constexpr u32 PIPELINE_MANIFEST_MAX_COUNT = 1u << 20u;
+
+/* Descriptor binding in a manifest file, without the pointers of `VkDescriptorSetLayoutBinding`. */
+struct ManifestBinding {
+    u32 binding = 0u;
+    u32 type = 0u;
+    u32 count = 0u;
+    u32 stages = 0u;
+};
+
+/* Write a value to a manifest file. */
+template<typename T>
+static void write_value(std::ofstream& file, const T& value) {
+    file.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+/* Write a length prefixed array to a manifest file. */
+template<typename T>
+static void write_array(std::ofstream& file, const T* data, u32 count) {
+    write_value(file, count);
+    file.write(reinterpret_cast<const char*>(data), sizeof(T) * count);
+}
+
+/* Read a value from a manifest file. */
+template<typename T>
+static bool read_value(std::ifstream& file, T& value) {
+    return (bool)file.read(reinterpret_cast<char*>(&value), sizeof(T));
+}
+
+/* Read a length prefixed array from a manifest file. (`Item` is the element type) */
+template<typename Item, typename Container>
+static bool read_array(std::ifstream& file, Container& array) {
+    u32 count = 0u;
+    if (read_value(file, count) == false || count > PIPELINE_MANIFEST_MAX_COUNT) return false;
+    array.resize(count);
+    return (bool)file.read(reinterpret_cast<char*>(array.data()), sizeof(Item) * count);
+}
+
+/* Write the descriptor bindings of a pipeline to a manifest file. */
+static void write_bindings(std::ofstream& file, const std::vector<VkDescriptorSetLayoutBinding>& bindings) {
+    std::vector<ManifestBinding> items(bindings.size());
+    for (size_t i = 0u; i < bindings.size(); ++i) {
+        items[i].binding = bindings[i].binding;
+        items[i].type = (u32)bindings[i].descriptorType;
+        items[i].count = bindings[i].descriptorCount;
+        items[i].stages = bindings[i].stageFlags;
     }
-    cache.clear();
+    write_array(file, items.data(), (u32)items.size());
 }
 
-Result<Pipeline> PipelineCache::get_pipeline(const std::string_view path, const ComputeNode& node) {
-    if (gpu == nullptr) return Err("tried to get pipeline from cache without gpu.");
+/* Read the descriptor bindings of a pipeline from a manifest file. */
+static bool read_bindings(std::ifstream& file, std::vector<VkDescriptorSetLayoutBinding>& bindings) {
+    std::vector<ManifestBinding> items {};
+    if (read_array<ManifestBinding>(file, items) == false) return false;
+    bindings.resize(items.size());
+    for (size_t i = 0u; i < items.size(); ++i) {
+        bindings[i] = VkDescriptorSetLayoutBinding {};
+        bindings[i].binding = items[i].binding;
+        bindings[i].descriptorType = (VkDescriptorType)items[i].type;
+        bindings[i].descriptorCount = items[i].count;
+        bindings[i].stageFlags = items[i].stages;
+    }
+    return true;
+}
 
-    /* Check the cache for a hit */
-    const std::string key = std::string(node.compute_path);
-    if (cache.count(key) == 1u) return Ok(cache[key]);
+/* Hash a block of bytes. (64 bit FNV-1a) */
+static u64 hash_bytes(const u8* data, u64 size) {
+    return hash_string(std::string_view((const char*)data, size));
+}
 
-    /* Fill in the pipeline struct */
-    Pipeline pipeline {};
+Result<void> PipelineCache::init(GPUAdapter& gpu_adapter, std::string path, u32 threads) {
+    this->gpu = &gpu_adapter;
+    cache_path = path;
 
-    /* Try to load the shader module for the new pipeline */
-    const Result r_shader = shader::from_alias(gpu->logical_device, path, node.compute_path);
-    if (r_shader.is_err()) return Err(r_shader.unwrap_err());
-    const VkShaderModule shader = r_shader.unwrap();
-    
-    /* Create the descriptor layout for the new pipeline */
-    const Result r_layout = node_descriptor_layout(*gpu, node);
+    /* Raster state which is set while recording, shader objects have no pipeline state at all */
+    dynamic_states = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+    if (gpu->extended_dynamic_state) {
+        dynamic_states.push_back(VK_DYNAMIC_STATE_PRIMITIVE_TOPOLOGY_EXT);
+        dynamic_states.push_back(VK_DYNAMIC_STATE_PRIMITIVE_RESTART_ENABLE_EXT);
+        dynamic_states.push_back(VK_DYNAMIC_STATE_CULL_MODE_EXT);
+        dynamic_states.push_back(VK_DYNAMIC_STATE_FRONT_FACE_EXT);
+    }
+    if (gpu->dynamic_vertex_input) dynamic_states.push_back(VK_DYNAMIC_STATE_VERTEX_INPUT_EXT);
+    dynamic_vertex_input = shader_objects || gpu->dynamic_vertex_input;
+    dynamic_topology = shader_objects || gpu->unrestricted_topology;
+
+    /* Load the previous driver pipeline cache, the driver validates the data as well */
+    const std::vector<u8> data = load_file();
+
+    /* Create the driver pipeline cache */
+    VkPipelineCacheCreateInfo cache_ci { VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO };
+    cache_ci.initialDataSize = data.size();
+    cache_ci.pInitialData = data.empty() ? nullptr : data.data();
+    if (vkCreatePipelineCache(gpu->logical_device, &cache_ci, nullptr, &driver_cache) != VK_SUCCESS) {
+        /* Some drivers reject data they can't use, retry with an empty cache */
+        cache_ci.initialDataSize = 0u;
+        cache_ci.pInitialData = nullptr;
+        if (vkCreatePipelineCache(gpu->logical_device, &cache_ci, nullptr, &driver_cache) != VK_SUCCESS) {
+            return Err("failed to create pipeline cache.");
+        }
+    }
+
+    /* Start the background compile workers */
+    stopping = false;
+    compile_workers.reserve(threads);
+    for (u32 i = 0u; i < threads; ++i) {
+        compile_workers.emplace_back(&PipelineCache::compile_worker, this);
+    }
+    return Ok();
+}
+
+std::vector<u8> PipelineCache::load_file() const {
+    if (cache_path.empty()) return {};
+
+    /* Try to open the file, it doesn't exist on the first run */
+    std::ifstream file { cache_path, std::ios::binary | std::ios::ate };
+    if (!file.is_open()) return {};
+    const u64 file_size = (u64)file.tellg();
+    file.seekg(0);
+
+    /* Read the file header */
+    PipelineCacheFile header {};
+    if (!file.read(reinterpret_cast<char*>(&header), sizeof(header))) return {};
+    if (header.magic != PIPELINE_CACHE_MAGIC || header.version != PIPELINE_CACHE_VERSION) {
+        gpu->log(DebugSeverity::Warning, "ignored pipeline cache file with unknown format.");
+        return {};
+    }
+
+    /* The data is only valid for the device & driver which saved it */
+    VkPhysicalDeviceProperties properties {};
+    vkGetPhysicalDeviceProperties(gpu->physical_device, &properties);
+    if (header.vendor_id != properties.vendorID || header.device_id != properties.deviceID ||
+        header.driver_version != properties.driverVersion ||
+        memcmp(header.cache_uuid, properties.pipelineCacheUUID, VK_UUID_SIZE) != 0) {
+        gpu->log(DebugSeverity::Info, "ignored pipeline cache file from a different gpu or driver.");
+        return {};
+    }
+
+    /* Read the driver pipeline cache data, its size must match the file before anything is allocated */
+    if (header.data_size != file_size - sizeof(header)) {
+        gpu->log(DebugSeverity::Warning, "ignored corrupted pipeline cache file.");
+        return {};
+    }
+    std::vector<u8> data(header.data_size);
+    if (!file.read(reinterpret_cast<char*>(data.data()), data.size()) ||
+        hash_bytes(data.data(), data.size()) != header.data_hash) {
+        gpu->log(DebugSeverity::Warning, "ignored corrupted pipeline cache file.");
+        return {};
+    }
+
+    /* Check the driver data header as well, it should match our own header */
+    VkPipelineCacheHeaderVersionOne data_header {};
+    if (data.size() < sizeof(data_header)) return {};
+    memcpy(&data_header, data.data(), sizeof(data_header));
+    if (data_header.headerVersion != VK_PIPELINE_CACHE_HEADER_VERSION_ONE ||
+        data_header.vendorID != properties.vendorID || data_header.deviceID != properties.deviceID ||
+        memcmp(data_header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE) != 0) {
+        gpu->log(DebugSeverity::Warning, "ignored pipeline cache file with mismatching driver data.");
+        return {};
+    }
+    return data;
+}
+
+Result<void> PipelineCache::save() {
+    if (cache_path.empty() || driver_cache == VK_NULL_HANDLE) return Ok();
+
+    /* Get the driver pipeline cache data */
+    size_t size = 0u;
+    if (vkGetPipelineCacheData(gpu->logical_device, driver_cache, &size, nullptr) != VK_SUCCESS) {
+        return Err("failed to get pipeline cache data size.");
+    }
+    std::vector<u8> data(size);
+    if (vkGetPipelineCacheData(gpu->logical_device, driver_cache, &size, data.data()) != VK_SUCCESS) {
+        return Err("failed to get pipeline cache data.");
+    }
+    data.resize(size);
+
+    /* Fill in the file header */
+    VkPhysicalDeviceProperties properties {};
+    vkGetPhysicalDeviceProperties(gpu->physical_device, &properties);
+    PipelineCacheFile header {};
+    header.magic = PIPELINE_CACHE_MAGIC;
+    header.version = PIPELINE_CACHE_VERSION;
+    header.vendor_id = properties.vendorID;
+    header.device_id = properties.deviceID;
+    header.driver_version = properties.driverVersion;
+    memcpy(header.cache_uuid, properties.pipelineCacheUUID, VK_UUID_SIZE);
+    header.data_size = data.size();
+    header.data_hash = hash_bytes(data.data(), data.size());
+
+    /* Write to a temporary file first, so a crash never leaves a half written cache file behind */
+    const std::string temp_path = cache_path + ".tmp";
+    {
+        std::ofstream file { temp_path, std::ios::binary | std::ios::trunc };
+        if (!file.is_open()) return Err("failed to open pipeline cache file for writing.");
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(data.data()), data.size());
+        if (!file) return Err("failed to write pipeline cache file.");
+    }
+
+    /* Replace the previous cache file */
+    std::remove(cache_path.c_str());
+    if (std::rename(temp_path.c_str(), cache_path.c_str()) != 0) {
+        return Err("failed to replace pipeline cache file.");
+    }
+    return Ok();
+}
+
+Result<void> PipelineCache::deinit() {
+    if (gpu == nullptr) return Ok();
+
+    /* Stop the background compile workers, pipelines which didn't start compiling yet are dropped */
+    {
+        std::lock_guard<std::shared_mutex> lock(cache_mutex);
+        stopping = true;
+    }
+    queue_cv.notify_all();
+    for (std::thread& worker : compile_workers) worker.join();
+    compile_workers.clear();
+    compile_queue.clear();
+    compiling.clear();
+
+    /* Save the driver pipeline cache, even if that fails the cache still has to be destroyed */
+    const Result r_save = save();
+
+    evict();
+    if (driver_cache != VK_NULL_HANDLE) vkDestroyPipelineCache(gpu->logical_device, driver_cache, nullptr);
+    driver_cache = VK_NULL_HANDLE;
+    archive.close();
+    return r_save;
+}
+
+void PipelineCache::write_stats(GraphStats& stats) {
+    std::lock_guard<std::shared_mutex> lock(cache_mutex);
+    stats.pipeline_hits = hits;
+    stats.pipeline_misses = misses;
+    stats.pipeline_evictions = evictions;
+    stats.pipelines_cached = used_slots;
+    stats.pipeline_bytes = used_bytes;
+    {
+        std::lock_guard<std::mutex> layout_lock(layout_mutex);
+        stats.pipeline_layouts = (u32)layouts.size();
+    }
+    {
+        std::lock_guard<std::mutex> library_lock(library_mutex);
+        stats.pipeline_libraries = (u32)libraries.size();
+        stats.pipeline_library_hits = library_hits;
+    }
+    {
+        std::lock_guard<std::mutex> shader_lock(shader_mutex);
+        stats.shader_objects = (u32)shaders.size();
+        stats.shader_object_compiles = shader_compiles;
+        stats.shader_object_compile_ms = shader_compile_ms;
+    }
+    stats.pipeline_compiles = compiles;
+    stats.pipeline_disk_hits = disk_hits;
+    stats.pipeline_compile_ms = compile_ms;
+    stats.pipeline_compile_max_ms = compile_max_ms;
+    stats.pipelines_pending = (u32)compiling.size();
+    stats.pipeline_skips = skips;
+    stats.pipeline_latency_ms = latency_ms;
+    stats.pipeline_latency_max_ms = latency_max_ms;
+    stats.pipelines_prewarmed = prewarmed;
+}
+
+void PipelineCache::record_compile(f64 ms, const VkPipelineCreationFeedbackEXT& feedback) {
+    std::lock_guard<std::shared_mutex> lock(cache_mutex); /* <- pipelines are compiled without holding the lock */
+    compiles += 1u;
+    compile_ms += ms;
+    compile_max_ms = std::max(compile_max_ms, ms);
+
+    /* Only valid if the driver filled in the creation feedback */
+    if ((feedback.flags & VK_PIPELINE_CREATION_FEEDBACK_VALID_BIT_EXT) == 0u) return;
+    if (feedback.flags & VK_PIPELINE_CREATION_FEEDBACK_APPLICATION_PIPELINE_CACHE_HIT_BIT_EXT) disk_hits += 1u;
+}
+
+VkResult PipelineCache::create_pipeline(const VkComputePipelineCreateInfo& pipeline_ci, VkPipeline& pipeline) {
+    /* Ask the driver whether the pipeline was found in the driver pipeline cache */
+    VkPipelineCreationFeedbackEXT feedback {};
+    VkPipelineCreationFeedbackCreateInfoEXT feedback_ci { VK_STRUCTURE_TYPE_PIPELINE_CREATION_FEEDBACK_CREATE_INFO_EXT };
+    feedback_ci.pPipelineCreationFeedback = &feedback;
+    VkComputePipelineCreateInfo create_ci = pipeline_ci;
+    if (gpu->creation_feedback) {
+        feedback_ci.pNext = create_ci.pNext;
+        create_ci.pNext = &feedback_ci;
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    const VkResult result = vkCreateComputePipelines(gpu->logical_device, driver_cache, 1u, &create_ci, nullptr, &pipeline);
+    const std::chrono::duration<f64, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+    if (result == VK_SUCCESS) record_compile(elapsed.count(), feedback);
+    return result;
+}
+
+VkResult PipelineCache::create_pipeline(const VkGraphicsPipelineCreateInfo& pipeline_ci, VkPipeline& pipeline) {
+    /* Ask the driver whether the pipeline was found in the driver pipeline cache */
+    VkPipelineCreationFeedbackEXT feedback {};
+    VkPipelineCreationFeedbackCreateInfoEXT feedback_ci { VK_STRUCTURE_TYPE_PIPELINE_CREATION_FEEDBACK_CREATE_INFO_EXT };
+    feedback_ci.pPipelineCreationFeedback = &feedback;
+    VkGraphicsPipelineCreateInfo create_ci = pipeline_ci;
+    if (gpu->creation_feedback) {
+        feedback_ci.pNext = create_ci.pNext;
+        create_ci.pNext = &feedback_ci;
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    const VkResult result = vkCreateGraphicsPipelines(gpu->logical_device, driver_cache, 1u, &create_ci, nullptr, &pipeline);
+    const std::chrono::duration<f64, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+    if (result == VK_SUCCESS) record_compile(elapsed.count(), feedback);
+    return result;
+}
+
+u64 PipelineCache::pipeline_key(const Node& node) const {
+    VRAMBank& bank = gpu->get_vram_bank();
+
+    /* Add the descriptor types & attachment formats, these depend on the resources */
+    u64 key = node.pipeline_hash;
+    for (const Dependency& dep : node.dependencies) {
+        const ResourceType rtype = dep.resource.get_type();
+
+        /* Attachment formats */
+        if (has_flag(dep.flags, DependencyFlags::Attachment)) {
+            if (rtype == ResourceType::RenderTarget) {
+                key = hash_combine(key, (u64)bank.render_targets.get(dep.resource).format);
+            } else {
+                const TextureSlot& texture = bank.textures.get(bank.images.get(dep.resource).texture);
+                key = hash_combine(key, ((u64)texture.usage << 32u) | (u64)texture.format);
+            }
+            continue;
+        }
+
+        /* Skip resources that don't need to be in the descriptor layout (ex: Vertex Buffers) */
+        if (has_flag(dep.flags, DependencyFlags::Unbound)) continue;
+
+        /* Descriptor types */
+        if (rtype == ResourceType::Buffer) {
+            key = hash_combine(key, (u64)translate::buffer_descriptor_type(bank.buffers.get(dep.resource).usage));
+        } else if (rtype == ResourceType::Image) {
+            const TextureSlot& texture = bank.textures.get(bank.images.get(dep.resource).texture);
+            key = hash_combine(key, (u64)translate::image_descriptor_type(texture.usage, dep.flags));
+        }
+    }
+
+    /* Add the specialization constants, they're sorted by id so the order in which they were set doesn't matter */
+    key = hash_combine(key, hash_mix(node.constants.size()));
+    for (const SpecConstant& constant : node.constants) key = hash_combine(key, ((u64)constant.id << 32u) | (u64)constant.value);
+
+    /* Add the raster state which can't be set while recording */
+    if (node.type == NodeType::Raster) {
+        const RasterNode& raster = (const RasterNode&)node;
+        if (dynamic_vertex_input == false) {
+            for (const AttrFormat attr : raster.attributes) key = hash_combine(key, (u64)attr);
+        }
+
+        /* The topology can only change within its topology class, every topology is a class of its own for now */
+        if (dynamic_topology == false) key = hash_combine(key, (u64)raster.prim_topology << 32u); /* <- tagged, so it can't be mistaken for an attribute */
+    }
+
+    /* Key 0 marks empty slots */
+    return key == 0u ? 1u : key;
+}
+
+PipelineSlot* PipelineCache::find(u64 key) {
+    if (slots.empty()) return nullptr;
+
+    /* Linear probing, until the key or an empty slot is found */
+    const u64 mask = slots.size() - 1u;
+    for (u64 i = key & mask;; i = (i + 1u) & mask) {
+        if (slots[i].key == key) return &slots[i];
+        if (slots[i].key == 0u) return nullptr;
+    }
+}
+
+const Pipeline* PipelineCache::use(u64 key) {
+    PipelineSlot* slot = find(key);
+    if (slot == nullptr) return nullptr;
+    slot->last_used.store(frame, std::memory_order_relaxed);
+    hits.fetch_add(1u, std::memory_order_relaxed);
+    return &slot->pipeline;
+}
+
+void PipelineCache::insert(const PipelineSlot& slot) {
+    /* Grow the table once it's 3/4 full, re-inserting all pipelines */
+    if ((used_slots + 1u) * 4u > slots.size() * 3u) {
+        std::vector<PipelineSlot> old_slots(std::max<size_t>(slots.size() * 2u, 64u));
+        old_slots.swap(slots);
+        used_slots = 0u;
+        used_bytes = 0u;
+        for (const PipelineSlot& old_slot : old_slots) {
+            if (old_slot.key != 0u) insert(old_slot);
+        }
+    }
+
+    const u64 mask = slots.size() - 1u;
+    u64 i = slot.key & mask;
+    while (slots[i].key != 0u) i = (i + 1u) & mask;
+    slots[i] = slot;
+    used_slots += 1u;
+    used_bytes += slot.pipeline.size;
+}
+
+void PipelineCache::erase(u64 index) {
+    used_slots -= 1u;
+    used_bytes -= slots[index].pipeline.size;
+
+    /* Shift back later pipelines in the same probe run, which would otherwise become unreachable */
+    const u64 mask = slots.size() - 1u;
+    u64 hole = index;
+    for (u64 i = (index + 1u) & mask; slots[i].key != 0u; i = (i + 1u) & mask) {
+        /* Only move the pipeline if its home slot isn't in between the hole & its current slot */
+        const u64 home = slots[i].key & mask;
+        if (((i - home) & mask) < ((i - hole) & mask)) continue;
+        slots[hole] = slots[i];
+        hole = i;
+    }
+    slots[hole] = PipelineSlot {};
+}
+
+void PipelineCache::destroy(const Pipeline& pipeline) {
+    vkDestroyPipeline(gpu->logical_device, pipeline.pipeline, nullptr);
+    for (const VkPipeline library : pipeline.libraries) release_library(library);
+    for (const VkShaderEXT shader : pipeline.shaders) release_shader(shader);
+    release_layout(pipeline.layout);
+}
+
+/* Get the signature of a set of bindings, pipelines with the same signature can share their layouts. */
+static u64 binding_signature(const std::vector<VkDescriptorSetLayoutBinding>& bindings) {
+    /* The bindless set is the same for all pipelines */
+    u64 signature = hash_mix(bindings.size());
+    for (const VkDescriptorSetLayoutBinding& binding : bindings) {
+        signature = hash_combine(signature, (u64)binding.binding | (u64)binding.descriptorType << 32);
+        signature = hash_combine(signature, (u64)binding.descriptorCount | (u64)binding.stageFlags << 32);
+    }
+    return signature;
+}
+
+/* Get the hash of the specialization constants of a pipeline, for the keys of its shared parts. */
+static u64 constants_hash(const std::vector<SpecConstant>& constants) {
+    u64 hash = hash_mix(constants.size());
+    for (const SpecConstant& constant : constants) hash = hash_combine(hash, ((u64)constant.id << 32u) | (u64)constant.value);
+    return hash;
+}
+
+/* Specialization info of a pipeline, the constant values are read straight from its description. */
+struct Specialization {
+    std::vector<VkSpecializationMapEntry> entries {};
+    VkSpecializationInfo info {};
+
+    Specialization(const PipelineDesc& desc) {
+        entries.reserve(desc.constants.size());
+        for (size_t i = 0u; i < desc.constants.size(); ++i) {
+            const u32 offset = (u32)(i * sizeof(SpecConstant) + offsetof(SpecConstant, value));
+            entries.push_back(VkSpecializationMapEntry { desc.constants[i].id, offset, sizeof(u32) });
+        }
+        info.mapEntryCount = (u32)entries.size();
+        info.pMapEntries = entries.data();
+        info.dataSize = desc.constants.size() * sizeof(SpecConstant);
+        info.pData = desc.constants.data();
+    }
+
+    /* Get the specialization info, nullptr if the pipeline has no constants. */
+    inline const VkSpecializationInfo* get() const { return entries.empty() ? nullptr : &info; }
+};
+
+Result<void> PipelineCache::acquire_layout(const PipelineDesc& desc, Pipeline& pipeline) {
+    const u64 signature = binding_signature(desc.bindings);
+
+    std::lock_guard<std::mutex> lock(layout_mutex);
+
+    /* Share the layouts of another pipeline with the same signature */
+    for (LayoutSlot& slot : layouts) {
+        if (slot.signature != signature) continue;
+        slot.users += 1u;
+        pipeline.descriptors = slot.descriptors;
+        pipeline.layout = slot.layout;
+        return Ok();
+    }
+
+    /* Create the descriptor layout for the new signature */
+    const Result r_layout = descriptor_layout(*gpu, desc.bindings);
     if (r_layout.is_err()) return Err(r_layout.unwrap_err());
-    pipeline.descriptors = r_layout.unwrap();
+    LayoutSlot slot { signature, r_layout.unwrap() };
 
     /* Pipeline layout creation info */
-    const VkDescriptorSetLayout desc_layouts[] {pipeline.descriptors, gpu->get_vram_bank().bindless_layout};
+    const VkDescriptorSetLayout desc_layouts[] {slot.descriptors, gpu->get_vram_bank().bindless_layout};
     VkPipelineLayoutCreateInfo layout_ci {VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO};
     layout_ci.setLayoutCount = sizeof(desc_layouts) / sizeof(VkDescriptorSetLayout);
     layout_ci.pSetLayouts = desc_layouts;
 
     /* Create the pipeline layout */
-    if (vkCreatePipelineLayout(gpu->logical_device, &layout_ci, nullptr, &pipeline.layout) != VK_SUCCESS) {
-        return Err("failed to create pipeline layout for '%s' node.", node.label.data());
+    if (vkCreatePipelineLayout(gpu->logical_device, &layout_ci, nullptr, &slot.layout) != VK_SUCCESS) {
+        vkDestroyDescriptorSetLayout(gpu->logical_device, slot.descriptors, nullptr);
+        return Err("failed to create pipeline layout for '%s' node.", desc.label.c_str());
+    }
+
+    slot.users = 1u;
+    layouts.push_back(slot);
+    pipeline.descriptors = slot.descriptors;
+    pipeline.layout = slot.layout;
+    return Ok();
+}
+
+void PipelineCache::release_layout(VkPipelineLayout layout) {
+    std::lock_guard<std::mutex> lock(layout_mutex);
+    for (size_t i = 0u; i < layouts.size(); ++i) {
+        if (layouts[i].layout != layout) continue;
+        if (--layouts[i].users > 0u) return;
+
+        /* No pipeline uses the layouts anymore */
+        vkDestroyPipelineLayout(gpu->logical_device, layouts[i].layout, nullptr);
+        vkDestroyDescriptorSetLayout(gpu->logical_device, layouts[i].descriptors, nullptr);
+        layouts[i] = layouts.back();
+        layouts.pop_back();
+        return;
+    }
+}
+
+void PipelineCache::next_frame(u32 frames_in_flight) {
+    std::lock_guard<std::shared_mutex> lock(cache_mutex);
+    frame += 1u;
+
+    /* Destroy the evicted pipelines which are no longer used by any frame in flight */
+    const u64 retired = frame > frames_in_flight ? frame - frames_in_flight : 0u;
+    for (size_t i = 0u; i < evicted.size();) {
+        if (evicted[i].last_used > retired) { ++i; continue; }
+        destroy(evicted[i].pipeline);
+        evicted[i] = evicted.back();
+        evicted.pop_back();
+    }
+
+    /* Evict the least recently used pipelines while over budget */
+    const auto over_budget = [this] {
+        return (max_pipelines != 0u && used_slots > max_pipelines) || (max_bytes != 0u && used_bytes > max_bytes);
+    };
+    while (used_slots > 0u && over_budget()) {
+        u64 lru = UINT64_MAX;
+        for (u64 i = 0u; i < slots.size(); ++i) {
+            if (slots[i].key == 0u) continue;
+            if (lru == UINT64_MAX || slots[i].last_used < slots[lru].last_used) lru = i;
+        }
+        evicted.push_back(slots[lru]);
+        erase(lru);
+        evictions += 1u;
+    }
+}
+
+void PipelineCache::evict() {
+    std::lock_guard<std::shared_mutex> lock(cache_mutex);
+    for (const PipelineSlot& slot : slots) {
+        if (slot.key != 0u) destroy(slot.pipeline);
+    }
+    for (const PipelineSlot& slot : evicted) destroy(slot.pipeline);
+    {
+        /* Parts of pipelines which are still compiling, the others were released with their pipelines */
+        std::lock_guard<std::mutex> library_lock(library_mutex);
+        for (const PipelineLibrary& library : libraries) vkDestroyPipeline(gpu->logical_device, library.library, nullptr);
+        libraries.clear();
+    }
+    {
+        /* Shader objects of pipelines which are still compiling, the others were released with their pipelines */
+        std::lock_guard<std::mutex> shader_lock(shader_mutex);
+        for (const ShaderSlot& slot : shaders) vkDestroyShaderEXT(gpu->logical_device, slot.shader, nullptr);
+        shaders.clear();
+    }
+    slots.clear();
+    evicted.clear();
+    used_slots = 0u;
+    used_bytes = 0u;
+}
+
+bool PipelineCache::is_compiling(u64 key) const {
+    return std::find(compiling.begin(), compiling.end(), key) != compiling.end();
+}
+
+void PipelineCache::finish_compile(const PipelineDesc& desc, const Pipeline* pipeline) {
+    compiling.erase(std::find(compiling.begin(), compiling.end(), desc.key));
+    if (pipeline != nullptr) {
+        insert(PipelineSlot { desc.key, frame, *pipeline });
+        if (compiled_keys.insert(desc.key).second) compiled.push_back(desc);
+    }
+    compiled_cv.notify_all();
+}
+
+Result<Pipeline> PipelineCache::get_pipeline(const std::string_view path, const Node& node) {
+    if (gpu == nullptr) return Err("tried to get pipeline from cache without gpu.");
+    const u64 key = pipeline_key(node);
+    const bool skip = node.miss_policy == PipelineMiss::Skip && compile_workers.empty() == false;
+    {
+        /* Hits only read the table, so recording threads only take a shared lock (the counters are atomic) */
+        std::shared_lock<std::shared_mutex> lock(cache_mutex);
+
+        /* Check the cache for a hit */
+        if (const Pipeline* cached = use(key); cached != nullptr) return Ok(*cached);
+        misses.fetch_add(1u, std::memory_order_relaxed);
+
+        /* Keep skipping the node while its pipeline compiles in the background */
+        if (skip && is_compiling(key)) { skips.fetch_add(1u, std::memory_order_relaxed); return Ok(Pipeline {}); }
+    }
+
+    /* Copy the pipeline state of the node, so it can be compiled on any thread */
+    PipelineDesc desc {};
+    if (Result r = describe(node, key, desc); r.is_err()) return Err(r.unwrap_err());
+
+    /* Queue the pipeline to be compiled in the background, and skip the node for now */
+    if (skip) {
+        {
+            std::lock_guard<std::shared_mutex> lock(cache_mutex);
+            if (const Pipeline* cached = use(key); cached != nullptr) return Ok(*cached);
+            skips.fetch_add(1u, std::memory_order_relaxed);
+            if (is_compiling(key)) return Ok(Pipeline {});
+            compiling.push_back(key);
+            compile_queue.push_back(CompileJob { std::move(desc), std::string(path), std::chrono::steady_clock::now() });
+        }
+        queue_cv.notify_one();
+        return Ok(Pipeline {});
+    }
+
+    /* Wait in case the pipeline is already being compiled, by a worker or another recording thread */
+    {
+        std::unique_lock<std::shared_mutex> lock(cache_mutex);
+        compiled_cv.wait(lock, [&] { return is_compiling(key) == false; });
+        if (const Pipeline* cached = use(key); cached != nullptr) return Ok(*cached);
+        compiling.push_back(key);
+    }
+
+    /* Compile the pipeline while recording, without holding the lock */
+    const Result<Pipeline> result = compile(path, desc);
+
+    std::lock_guard<std::shared_mutex> lock(cache_mutex);
+    if (result.is_err()) {
+        finish_compile(desc, nullptr);
+        return Err(result.unwrap_err());
+    }
+    const Pipeline pipeline = result.unwrap();
+    finish_compile(desc, &pipeline);
+    return Ok(pipeline);
+}
+
+void PipelineCache::compile_worker() {
+    for (;;) {
+        /* Wait for a pipeline to compile */
+        CompileJob job {};
+        {
+            std::unique_lock<std::shared_mutex> lock(cache_mutex);
+            queue_cv.wait(lock, [this] { return stopping || compile_queue.empty() == false; });
+            if (stopping) return;
+            job = std::move(compile_queue.front());
+            compile_queue.pop_front();
+        }
+
+        const Result<Pipeline> result = compile(job.shader_path, job.desc);
+        const std::chrono::duration<f64, std::milli> latency = std::chrono::steady_clock::now() - job.requested;
+
+        /* Insert the pipeline, the nodes using it pick it up next time they are recorded */
+        std::lock_guard<std::shared_mutex> lock(cache_mutex);
+        if (result.is_err()) {
+            finish_compile(job.desc, nullptr);
+            if (compile_error.empty()) compile_error = result.unwrap_err();
+            continue;
+        }
+        const Pipeline pipeline = result.unwrap();
+        finish_compile(job.desc, &pipeline);
+        latency_ms += latency.count();
+        latency_max_ms = std::max(latency_max_ms, latency.count());
+    }
+}
+
+Result<void> PipelineCache::compile_errors() {
+    std::lock_guard<std::shared_mutex> lock(cache_mutex);
+    if (compile_error.empty()) return Ok();
+    const std::string error = std::move(compile_error);
+    compile_error.clear();
+    return Err(error);
+}
+
+Result<void> PipelineCache::prewarm(const std::string_view path, const std::string_view manifest_path, ThreadPool& pool) {
+    /* There's no manifest on the first run */
+    std::ifstream file { std::string(manifest_path), std::ios::binary };
+    if (!file.is_open()) return Ok();
+
+    u32 magic = 0u, version = 0u, count = 0u;
+    if (!read_value(file, magic) || !read_value(file, version) || !read_value(file, count) ||
+        magic != PIPELINE_MANIFEST_MAGIC || version != PIPELINE_MANIFEST_VERSION || count > PIPELINE_MANIFEST_MAX_COUNT) {
+        return Err("invalid pipeline manifest file.");
+    }
+
+    /* Read the pipeline descriptions (one by one, so a truncated file fails before the count is allocated) */
+    std::vector<PipelineDesc> descs {};
+    for (u32 i = 0u; i < count; ++i) {
+        PipelineDesc& desc = descs.emplace_back();
+        bool valid = read_value(file, desc.key) && read_value(file, desc.type) && read_value(file, desc.topology);
+        valid = valid && read_array<char>(file, desc.label);
+        valid = valid && read_array<char>(file, desc.shader_paths[0]) && read_array<char>(file, desc.shader_paths[1]);
+        valid = valid && read_bindings(file, desc.bindings);
+        valid = valid && read_array<SpecConstant>(file, desc.constants);
+        valid = valid && read_array<AttrFormat>(file, desc.attributes) && read_array<VkFormat>(file, desc.color_formats);
+        if (valid == false) return Err("truncated pipeline manifest file.");
+        if (desc.type != NodeType::Compute && desc.type != NodeType::Raster) return Err("invalid pipeline manifest file.");
+    }
+
+    /* Skip pipelines which are already cached or compiling */
+    {
+        std::lock_guard<std::shared_mutex> lock(cache_mutex);
+        u32 kept = 0u;
+        for (PipelineDesc& desc : descs) {
+            if (find(desc.key) != nullptr || is_compiling(desc.key)) continue;
+            compiling.push_back(desc.key);
+            descs[kept++] = std::move(desc);
+        }
+        descs.resize(kept);
+    }
+
+    /* Compile the pipelines in parallel (error messages are thread local, so they're copied) */
+    std::vector<Pipeline> pipelines(descs.size());
+    std::vector<std::string> errors(descs.size());
+    pool.parallel_for((u32)descs.size(), [&](u32 task, u32) {
+        const Result<Pipeline> result = compile(path, descs[task]);
+        if (result.is_err()) errors[task] = result.unwrap_err();
+        else pipelines[task] = result.unwrap();
+    });
+
+    /* Insert the compiled pipelines */
+    std::lock_guard<std::shared_mutex> lock(cache_mutex);
+    for (size_t i = 0u; i < descs.size(); ++i) {
+        if (errors[i].empty() == false) {
+            finish_compile(descs[i], nullptr);
+            gpu->log(DebugSeverity::Warning, errors[i].c_str());
+            continue;
+        }
+        finish_compile(descs[i], &pipelines[i]);
+        prewarmed += 1u;
+    }
+    return Ok();
+}
+
+Result<void> PipelineCache::save_manifest(const std::string_view manifest_path) {
+    std::ofstream file { std::string(manifest_path), std::ios::binary | std::ios::trunc };
+    if (!file.is_open()) return Err("failed to open pipeline manifest file for writing.");
+
+    std::lock_guard<std::shared_mutex> lock(cache_mutex);
+    write_value(file, PIPELINE_MANIFEST_MAGIC);
+    write_value(file, PIPELINE_MANIFEST_VERSION);
+    write_value(file, (u32)compiled.size());
+    for (const PipelineDesc& desc : compiled) {
+        write_value(file, desc.key);
+        write_value(file, desc.type);
+        write_value(file, desc.topology);
+        write_array(file, desc.label.data(), (u32)desc.label.size());
+        write_array(file, desc.shader_paths[0].data(), (u32)desc.shader_paths[0].size());
+        write_array(file, desc.shader_paths[1].data(), (u32)desc.shader_paths[1].size());
+        write_bindings(file, desc.bindings);
+        write_array(file, desc.constants.data(), (u32)desc.constants.size());
+        write_array(file, desc.attributes.data(), (u32)desc.attributes.size());
+        write_array(file, desc.color_formats.data(), (u32)desc.color_formats.size());
+    }
+    if (!file) return Err("failed to write pipeline manifest file.");
+    return Ok();
+}
+
+Result<void> PipelineCache::describe(const Node& node, u64 key, PipelineDesc& desc) const {
+    desc.key = key;
+    desc.type = node.type;
+    desc.label = std::string(node.label);
+    if (Result r = node_descriptor_bindings(*gpu, node, desc.bindings); r.is_err()) return r;
+    desc.constants.assign(node.constants.begin(), node.constants.end());
+
+    /* Compute nodes only need their shader */
+    if (node.type == NodeType::Compute) {
+        desc.shader_paths[0] = std::string(static_cast<const ComputeNode&>(node).compute_path);
+        return Ok();
+    }
+    if (node.type != NodeType::Raster) return Err("invalid node type used in graph.");
+
+    const RasterNode& raster = static_cast<const RasterNode&>(node);
+    desc.shader_paths[0] = std::string(raster.vertex_path);
+    desc.shader_paths[1] = std::string(raster.pixel_path);
+    desc.attributes.assign(raster.attributes.begin(), raster.attributes.end());
+    desc.topology = raster.prim_topology;
+
+    /* Find all attachment resource dependencies to put in the rendering info. */
+    VRAMBank& bank = gpu->get_vram_bank();
+    for (const Dependency& dep : node.dependencies) {
+        /* Find attachment dependencies */
+        if (has_flag(dep.flags, DependencyFlags::Attachment) == false) continue;
+
+        /* Get the image format for render target or texture */
+        if (dep.resource.get_type() == ResourceType::RenderTarget) {
+            desc.color_formats.emplace_back(bank.render_targets.get(dep.resource).format);
+        } else {
+            const TextureSlot& texture = bank.textures.get(bank.images.get(dep.resource).texture);
+            if (has_flag(texture.usage, TextureUsage::ColorAttachment) == false) continue;
+            desc.color_formats.emplace_back(translate::texture_format(texture.format));
+        }
+    }
+    return Ok();
+}
+
+Result<Pipeline> PipelineCache::compile(const std::string_view path, const PipelineDesc& desc) {
+    /* Fill in the pipeline struct */
+    Pipeline pipeline {};
+
+    /* Load the shader code once, it's reflected & compiled from the same (memory-mapped) code */
+    shader::Code codes[2] {};
+    for (u32 i = 0u; i < (desc.type == NodeType::Compute ? 1u : 2u); ++i) {
+        if (Result r = shader::load_code(archive, path, desc.shader_paths[i], codes[i]); r.is_err()) return Err(r.unwrap_err());
+    }
+
+    /* Reject shaders which don't match the node before the driver sees them */
+    if (Result r = validate(codes, desc, pipeline); r.is_err()) return Err(r.unwrap_err());
+
+    /* Get the layouts for the new pipeline, shared with other pipelines with the same bindings */
+    if (Result r = acquire_layout(desc, pipeline); r.is_err()) return Err(r.unwrap_err());
+
+    /* Get the shader objects which replace the pipeline, when using the shader object backend */
+    u64 code_size = 0u;
+    if (shader_objects) {
+        const Result r_shaders = compile_shaders(codes, desc, pipeline, code_size);
+        if (r_shaders.is_err()) {
+            release_layout(pipeline.layout);
+            return Err(r_shaders.unwrap_err());
+        }
+        pipeline.size = PIPELINE_OVERHEAD + code_size;
+        return Ok(pipeline);
     }
 
+    /* Create the pipeline itself */
+    const Result r_pipeline = desc.type == NodeType::Compute ? compile_compute(codes, desc, pipeline.layout, code_size) : compile_raster(codes, desc, pipeline.layout, pipeline.libraries, code_size);
+    if (r_pipeline.is_err()) {
+        release_layout(pipeline.layout);
+        return Err(r_pipeline.unwrap_err());
+    }
+    pipeline.pipeline = r_pipeline.unwrap();
+
+    /* The driver doesn't report the memory it uses, so estimate it from the shader code */
+    pipeline.size = PIPELINE_OVERHEAD + code_size;
+    return Ok(pipeline);
+}
+
+Result<void> PipelineCache::validate(const shader::Code* codes, const PipelineDesc& desc, Pipeline& pipeline) const {
+    const bool compute = desc.type == NodeType::Compute;
+    const VkShaderStageFlagBits stages[2] { compute ? VK_SHADER_STAGE_COMPUTE_BIT : VK_SHADER_STAGE_VERTEX_BIT, VK_SHADER_STAGE_FRAGMENT_BIT };
+    for (u32 i = 0u; i < (compute ? 1u : 2u); ++i) {
+        const char* label = desc.label.c_str();
+        const char* alias = desc.shader_paths[i].c_str();
+
+        shader::Reflection reflection {};
+        if (Result r = shader::reflect(codes[i], stages[i], desc.constants, reflection); r.is_err()) {
+            return Err("failed to reflect shader '%s' of '%s' node: %s", alias, label, r.unwrap_err().c_str());
+        }
+        if (reflection.push_constant_size != 0u) {
+            return Err("shader '%s' of '%s' node uses push constants, which aren't supported.", alias, label);
+        }
+
+        /* Every binding the shader uses has to be in the node layout, with the same type & visible to the stage */
+        for (const shader::ReflectedBinding& used : reflection.bindings) {
+            if (used.set == 1u) continue; /* <- bindless set */
+            if (used.set != 0u) {
+                return Err("shader '%s' of '%s' node uses descriptor set %u, only set 0 (node) & 1 (bindless) exist.", alias, label, used.set);
+            }
+
+            const VkDescriptorSetLayoutBinding* binding = nullptr;
+            for (const VkDescriptorSetLayoutBinding& node_binding : desc.bindings) {
+                if (node_binding.binding == used.binding) binding = &node_binding;
+            }
+            if (binding == nullptr) {
+                return Err("shader '%s' of '%s' node uses binding %u, but the node only binds %u resources.", alias, label, used.binding, (u32)desc.bindings.size());
+            }
+            if (binding->descriptorType != used.type) {
+                return Err("binding %u of '%s' node doesn't match the resource type in shader '%s'.", used.binding, label, alias);
+            }
+            if ((binding->stageFlags & stages[i]) == 0u) {
+                return Err("binding %u of '%s' node isn't visible to shader '%s'.", used.binding, label, alias);
+            }
+        }
+
+        if (compute) memcpy(pipeline.group_size, reflection.local_size, sizeof(pipeline.group_size));
+    }
+    return Ok();
+}
+
+Result<VkPipeline> PipelineCache::compile_compute(const shader::Code* codes, const PipelineDesc& desc, VkPipelineLayout layout, u64& code_size) {
+    /* Try to create the shader module for the new pipeline */
+    const Result r_shader = shader::create_module(gpu->logical_device, codes[0]);
+    if (r_shader.is_err()) return Err(r_shader.unwrap_err());
+    const VkShaderModule shader = r_shader.unwrap();
+    code_size += codes[0].size;
+
     /* Pipeline stage creation info */
     VkPipelineShaderStageCreateInfo stage_ci { VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO };
     stage_ci.stage = VK_SHADER_STAGE_COMPUTE_BIT;
     stage_ci.module = shader;
     stage_ci.pName = "main";
+    const Specialization specialization(desc);
+    stage_ci.pSpecializationInfo = specialization.get();
     
     /* Pipeline creation info */
     VkComputePipelineCreateInfo pipeline_ci { VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO };
     pipeline_ci.stage = stage_ci;
-    pipeline_ci.layout = pipeline.layout;
+    pipeline_ci.layout = layout;
 
     /* Create compute pipeline */
-    if (vkCreateComputePipelines(gpu->logical_device, VK_NULL_HANDLE, 1u, &pipeline_ci, nullptr, &pipeline.pipeline) != VK_SUCCESS) {
-        return Err("failed to create pipeline for '%s' node.", node.label.data());
-    }
+    VkPipeline pipeline {};
+    const VkResult result = create_pipeline(pipeline_ci, pipeline);
 
     /* We can free the shader module after compiling the pipeline */
     vkDestroyShaderModule(gpu->logical_device, shader, nullptr);
 
-    /* Save the new pipeline to our cache and return it */
-    cache[key] = pipeline;
+    if (result != VK_SUCCESS) return Err("failed to create pipeline for '%s' node.", desc.label.c_str());
     return Ok(pipeline);
 }
 
-Result<Pipeline> PipelineCache::get_pipeline(const std::string_view path, const RasterNode& node) {
-    if (gpu == nullptr) return Err("tried to get pipeline from cache without gpu.");
-
-    /* Check the cache for a hit */
-    const std::string key = std::string(node.label);
-    if (cache.count(key) == 1u) return Ok(cache[key]);
-
-    /* Fill in the pipeline struct */
-    Pipeline pipeline {};
-
-    /* Try to load the vertex shader module for the new pipeline */
-    const Result r_vert_shader = shader::from_alias(gpu->logical_device, path, node.vertex_path);
-    if (r_vert_shader.is_err()) return Err(r_vert_shader.unwrap_err());
-    const VkShaderModule vert_shader = r_vert_shader.unwrap();
-
-    /* Try to load the pixel shader module for the new pipeline */
-    const Result r_frag_shader = shader::from_alias(gpu->logical_device, path, node.pixel_path);
-    if (r_frag_shader.is_err()) return Err(r_frag_shader.unwrap_err());
-    const VkShaderModule frag_shader = r_frag_shader.unwrap();
+/* Fixed function state of a rasterisation pipeline, shared by monolithic pipelines & pipeline libraries. */
+struct RasterState {
+    /* Vertex input & input assembly */
+    std::vector<VkVertexInputAttributeDescription> vertex_attributes {};
+    VkVertexInputBindingDescription vertex_binding {};
+    VkPipelineVertexInputStateCreateInfo vertex_input { VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO };
+    VkPipelineInputAssemblyStateCreateInfo assembly_input { VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO };
 
-    /* Pipeline shader stages */
-    VkPipelineShaderStageCreateInfo stages[2] {};
-    stages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    stages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
-    stages[0].module = vert_shader;
-    stages[0].pName = "main";
-    stages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    stages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-    stages[1].module = frag_shader;
-    stages[1].pName = "main";
+    /* Pre-rasterization */
+    VkPipelineTessellationStateCreateInfo tessellation_state { VK_STRUCTURE_TYPE_PIPELINE_TESSELLATION_STATE_CREATE_INFO };
+    VkViewport viewport {};
+    VkRect2D scissor {};
+    VkPipelineViewportStateCreateInfo viewport_state { VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO };
+    VkPipelineRasterizationStateCreateInfo raster_state { VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO };
+    std::vector<VkDynamicState> dynamic_states {};
+    VkPipelineDynamicStateCreateInfo dynamic_state { VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO };
 
-    /* Create the descriptor layout for the new pipeline */
-    const Result r_layout = node_descriptor_layout(*gpu, node);
-    if (r_layout.is_err()) return Err(r_layout.unwrap_err());
-    pipeline.descriptors = r_layout.unwrap();
+    /* Fragment shader & output */
+    VkPipelineMultisampleStateCreateInfo multisample_state { VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO };
+    VkPipelineDepthStencilStateCreateInfo depth_stencil_state { VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO };
+    std::vector<VkPipelineColorBlendAttachmentState> blend_attachments {};
+    VkPipelineColorBlendStateCreateInfo color_blend_state { VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO };
+    VkPipelineRenderingCreateInfoKHR dynamic_rendering { VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO_KHR };
 
-    /* Pipeline layout creation info */
-    const VkDescriptorSetLayout desc_layouts[] {pipeline.descriptors, gpu->get_vram_bank().bindless_layout};
-    VkPipelineLayoutCreateInfo layout_ci {VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO};
-    layout_ci.setLayoutCount = sizeof(desc_layouts) / sizeof(VkDescriptorSetLayout);
-    layout_ci.pSetLayouts = desc_layouts;
+    RasterState(const PipelineDesc& desc, const std::vector<VkDynamicState>& dynamic);
 
-    /* Create the pipeline layout */
-    if (vkCreatePipelineLayout(gpu->logical_device, &layout_ci, nullptr, &pipeline.layout) != VK_SUCCESS) {
-        return Err("failed to create pipeline layout for '%s' node.", node.label.data());
-    }
+    /* No copies allowed, the create infos point into the state */
+    RasterState(const RasterState&) = delete;
+    RasterState& operator=(const RasterState&) = delete;
+};
 
+RasterState::RasterState(const PipelineDesc& desc, const std::vector<VkDynamicState>& dynamic) : dynamic_states(dynamic) {
     /* Vertex attributes */
-    std::vector<VkVertexInputAttributeDescription> vertex_attributes {};
     u32 vertex_stride = 0u;
-    for (const AttrFormat attr : node.attributes) {
+    for (const AttrFormat attr : desc.attributes) {
         const u32 size = translate::vertex_attribute_size(attr);
         const VkFormat format = translate::vertex_format(attr);
 
-        VkVertexInputAttributeDescription attr {};
-        attr.location = (u32)vertex_attributes.size();
-        attr.binding = 0u;
-        attr.format = format;
-        attr.offset = vertex_stride;
-        vertex_attributes.emplace_back(attr);
+        VkVertexInputAttributeDescription attribute {};
+        attribute.location = (u32)vertex_attributes.size();
+        attribute.binding = 0u;
+        attribute.format = format;
+        attribute.offset = vertex_stride;
+        vertex_attributes.emplace_back(attribute);
         vertex_stride += size;
     }
 
     /* Vertex binding (always 1, since we don't support non-interleaved vertex attributes) */
-    VkVertexInputBindingDescription vertex_binding {};
     vertex_binding.binding = 0u;
     vertex_binding.stride = vertex_stride;
     vertex_binding.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
 
     /* Pipeline vertex input state */
-    VkPipelineVertexInputStateCreateInfo vertex_input { VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO };
     vertex_input.vertexBindingDescriptionCount = 1u;
     vertex_input.pVertexBindingDescriptions = &vertex_binding;
     vertex_input.vertexAttributeDescriptionCount = (u32)vertex_attributes.size();
     vertex_input.pVertexAttributeDescriptions = vertex_attributes.data();
 
     /* Pipeline input assembly state */
-    VkPipelineInputAssemblyStateCreateInfo assembly_input { VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO };
-    assembly_input.topology = translate::primitive_topology(node.prim_topology);
-
-    /* (placeholder) Pipeline tessellation state */
-    VkPipelineTessellationStateCreateInfo tessellation_state { VK_STRUCTURE_TYPE_PIPELINE_TESSELLATION_STATE_CREATE_INFO };
-
-    const VkViewport viewport {};
-    const VkRect2D scissor {};
+    assembly_input.topology = translate::primitive_topology(desc.topology);
 
     /* Pipeline viewport state */
-    VkPipelineViewportStateCreateInfo viewport_state { VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO };
     viewport_state.viewportCount = 1u;
     viewport_state.pViewports = &viewport;
     viewport_state.scissorCount = 1u;
     viewport_state.pScissors = &scissor;
 
     /* Pipeline rasterizer state */
-    VkPipelineRasterizationStateCreateInfo raster_state { VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO };
     raster_state.polygonMode = VK_POLYGON_MODE_FILL;
     raster_state.cullMode = VK_CULL_MODE_NONE;
     raster_state.frontFace = VK_FRONT_FACE_CLOCKWISE;
     raster_state.lineWidth = 1.0f;
 
+    /* Pipeline dynamic state */
+    dynamic_state.dynamicStateCount = (u32)dynamic_states.size();
+    dynamic_state.pDynamicStates = dynamic_states.data();
+
     /* Pipeline multisample state */
-    VkPipelineMultisampleStateCreateInfo multisample_state { VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO };
     multisample_state.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
 
     /* Pipeline depth stencil state */
-    VkPipelineDepthStencilStateCreateInfo depth_stencil_state { VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO };
     depth_stencil_state.depthTestEnable = false;
     depth_stencil_state.depthWriteEnable = false;
     depth_stencil_state.depthCompareOp = VK_COMPARE_OP_LESS;
 
-    /* Get the active VRAM bank */
-    VRAMBank& bank = gpu->get_vram_bank();
-
-    /* Find all attachment resource dependencies to put in the rendering info. */
-    std::vector<VkFormat> color_attachments {};
-    std::vector<VkPipelineColorBlendAttachmentState> blend_attachments {};
-    for (const Dependency& dep : node.dependencies) {
-        /* Find attachment dependencies */
-        if (has_flag(dep.flags, DependencyFlags::Attachment) == false) continue;
-
-        VkFormat format {}; /* Get the image format for render target or texture */
-        if (dep.resource.get_type() == ResourceType::RenderTarget) {
-            format = bank.render_targets.get(dep.resource).format;
-        } else {
-            const TextureSlot& texture = bank.textures.get(dep.resource);
-            if (has_flag(texture.usage, TextureUsage::ColorAttachment) == false) continue;
-            format = translate::texture_format(texture.format);
-        }
-
-        color_attachments.emplace_back(format);
+    /* Blend state of each color attachment */
+    for (size_t i = 0u; i < desc.color_formats.size(); ++i) {
         VkPipelineColorBlendAttachmentState blend_state {};
         blend_state.blendEnable = /*node.alpha_blend ? VK_TRUE :*/ VK_FALSE /* <- Alpha blending */; // TODO: Implement Alpha Blending
         blend_state.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
@@ -217,50 +1057,339 @@ Result<Pipeline> PipelineCache::get_pipeline(const std::string_view path, const
     }
 
     /* Pipeline color blend state */
-    VkPipelineColorBlendStateCreateInfo color_blend_state { VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO };
     color_blend_state.attachmentCount = (u32)blend_attachments.size();
     color_blend_state.pAttachments = blend_attachments.data();
 
-    /* Pipeline dynamic state */
-    const VkDynamicState dynamic_states[] { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
-    VkPipelineDynamicStateCreateInfo dynamic_state { VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO };
-    dynamic_state.dynamicStateCount = sizeof(dynamic_states) / sizeof(VkDynamicState);
-    dynamic_state.pDynamicStates = dynamic_states;
-
     /* Dynamic rendering info */
-    VkPipelineRenderingCreateInfoKHR dynamic_rendering { VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO_KHR };
-    dynamic_rendering.colorAttachmentCount = (u32)color_attachments.size();
-    dynamic_rendering.pColorAttachmentFormats = color_attachments.data();
+    dynamic_rendering.colorAttachmentCount = (u32)desc.color_formats.size();
+    dynamic_rendering.pColorAttachmentFormats = desc.color_formats.data();
+}
+
+Result<VkPipeline> PipelineCache::compile_raster(const shader::Code* codes, const PipelineDesc& desc, VkPipelineLayout layout, VkPipeline* libraries, u64& code_size) {
+    /* Link the pipeline from separately compiled parts, if the device supports it */
+    if (link_libraries) return link_raster(codes, desc, layout, libraries, code_size);
+
+    /* Try to create the vertex shader module for the new pipeline */
+    const Result r_vert_shader = shader::create_module(gpu->logical_device, codes[0]);
+    if (r_vert_shader.is_err()) return Err(r_vert_shader.unwrap_err());
+    const VkShaderModule vert_shader = r_vert_shader.unwrap();
+
+    /* Try to create the pixel shader module for the new pipeline */
+    const Result r_frag_shader = shader::create_module(gpu->logical_device, codes[1]);
+    if (r_frag_shader.is_err()) {
+        vkDestroyShaderModule(gpu->logical_device, vert_shader, nullptr);
+        return Err(r_frag_shader.unwrap_err());
+    }
+    const VkShaderModule frag_shader = r_frag_shader.unwrap();
+    code_size = codes[0].size + codes[1].size;
+
+    /* Pipeline shader stages */
+    VkPipelineShaderStageCreateInfo stages[2] {};
+    stages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    stages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+    stages[0].module = vert_shader;
+    stages[0].pName = "main";
+    stages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    stages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+    stages[1].module = frag_shader;
+    stages[1].pName = "main";
+
+    /* Both stages use the same constants, ids a stage doesn't declare are ignored */
+    const Specialization specialization(desc);
+    stages[0].pSpecializationInfo = specialization.get();
+    stages[1].pSpecializationInfo = specialization.get();
+
+    /* Pipeline fixed function state */
+    const RasterState state(desc, dynamic_states);
 
     /* Pipeline creation info */
     VkGraphicsPipelineCreateInfo pipeline_ci { VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO };
-    pipeline_ci.pNext = &dynamic_rendering;
+    pipeline_ci.pNext = &state.dynamic_rendering;
     pipeline_ci.stageCount = 2u;
     pipeline_ci.pStages = stages;
-    pipeline_ci.pVertexInputState = &vertex_input;
-    pipeline_ci.pInputAssemblyState = &assembly_input;
-    pipeline_ci.pTessellationState = &tessellation_state;
-    pipeline_ci.pViewportState = &viewport_state;
-    pipeline_ci.pRasterizationState = &raster_state;
-    pipeline_ci.pMultisampleState = &multisample_state;
-    pipeline_ci.pDepthStencilState = &depth_stencil_state;
-    pipeline_ci.pColorBlendState = &color_blend_state;
-    pipeline_ci.pDynamicState = &dynamic_state;
-    pipeline_ci.layout = pipeline.layout;
+    pipeline_ci.pVertexInputState = &state.vertex_input;
+    pipeline_ci.pInputAssemblyState = &state.assembly_input;
+    pipeline_ci.pTessellationState = &state.tessellation_state;
+    pipeline_ci.pViewportState = &state.viewport_state;
+    pipeline_ci.pRasterizationState = &state.raster_state;
+    pipeline_ci.pMultisampleState = &state.multisample_state;
+    pipeline_ci.pDepthStencilState = &state.depth_stencil_state;
+    pipeline_ci.pColorBlendState = &state.color_blend_state;
+    pipeline_ci.pDynamicState = &state.dynamic_state;
+    pipeline_ci.layout = layout;
     pipeline_ci.renderPass = nullptr;
     pipeline_ci.subpass = 0u;
     pipeline_ci.basePipelineHandle = VK_NULL_HANDLE;
     pipeline_ci.basePipelineIndex = -1;
 
-    if (vkCreateGraphicsPipelines(gpu->logical_device, nullptr, 1u, &pipeline_ci, nullptr, &pipeline.pipeline) != VK_SUCCESS) {
-        return Err("failed to create pipeline for '%s' node.", node.label.data());
-    }
+    VkPipeline pipeline {};
+    const VkResult result = create_pipeline(pipeline_ci, pipeline);
 
     /* We can free the shader modules after compiling the pipeline */
     vkDestroyShaderModule(gpu->logical_device, vert_shader, nullptr);
     vkDestroyShaderModule(gpu->logical_device, frag_shader, nullptr);
 
-    /* Save the new pipeline to our cache and return it */
-    cache[key] = pipeline;
+    if (result != VK_SUCCESS) return Err("failed to create pipeline for '%s' node.", desc.label.c_str());
+    return Ok(pipeline);
+}
+
+u64 PipelineCache::library_key(const PipelineDesc& desc, VkGraphicsPipelineLibraryFlagsEXT part) const {
+    u64 key = hash_mix(part);
+    switch (part) {
+        case VK_GRAPHICS_PIPELINE_LIBRARY_VERTEX_INPUT_INTERFACE_BIT_EXT:
+            if (dynamic_vertex_input == false) {
+                for (const AttrFormat attr : desc.attributes) key = hash_combine(key, (u64)attr);
+            }
+            return dynamic_topology ? key : hash_combine(key, (u64)desc.topology << 32u);
+        case VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT:
+            key = hash_combine(hash_combine(key, hash_string(desc.shader_paths[0])), binding_signature(desc.bindings));
+            return hash_combine(key, constants_hash(desc.constants));
+        case VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT:
+            key = hash_combine(hash_combine(key, hash_string(desc.shader_paths[1])), binding_signature(desc.bindings));
+            return hash_combine(key, constants_hash(desc.constants));
+        default: /* Fragment output interface */
+            for (const VkFormat format : desc.color_formats) key = hash_combine(key, (u64)format);
+            return key;
+    }
+}
+
+Result<PipelineLibrary> PipelineCache::get_library(const shader::Code* codes, const PipelineDesc& desc, VkPipelineLayout layout, VkGraphicsPipelineLibraryFlagsEXT part) {
+    const u64 key = library_key(desc, part);
+
+    /* Re-use the part if another pipeline already compiled it */
+    {
+        std::lock_guard<std::mutex> lock(library_mutex);
+        for (PipelineLibrary& library : libraries) {
+            if (library.key != key) continue;
+            library.users += 1u;
+            library_hits += 1u;
+            return Ok(library);
+        }
+    }
+
+    /* Compile the part without holding the lock */
+    PipelineLibrary library { key };
+    library.users = 1u;
+    const Result r_library = compile_library(codes, desc, layout, part, library.code_size);
+    if (r_library.is_err()) return Err(r_library.unwrap_err());
+    library.library = r_library.unwrap();
+
+    /* Another thread may have compiled the same part in the mean time */
+    std::lock_guard<std::mutex> lock(library_mutex);
+    for (PipelineLibrary& other : libraries) {
+        if (other.key != key) continue;
+        vkDestroyPipeline(gpu->logical_device, library.library, nullptr);
+        other.users += 1u;
+        return Ok(other);
+    }
+    libraries.push_back(library);
+    return Ok(library);
+}
+
+void PipelineCache::release_library(VkPipeline library) {
+    if (library == VK_NULL_HANDLE) return;
+    std::lock_guard<std::mutex> lock(library_mutex);
+    for (size_t i = 0u; i < libraries.size(); ++i) {
+        if (libraries[i].library != library) continue;
+        if (--libraries[i].users > 0u) return;
+
+        /* No pipeline is linked from the part anymore */
+        vkDestroyPipeline(gpu->logical_device, libraries[i].library, nullptr);
+        libraries[i] = libraries.back();
+        libraries.pop_back();
+        return;
+    }
+}
+
+Result<VkPipeline> PipelineCache::compile_library(const shader::Code* codes, const PipelineDesc& desc, VkPipelineLayout layout, VkGraphicsPipelineLibraryFlagsEXT part, u64& code_size) {
+    const RasterState state(desc, dynamic_states);
+
+    /* Library creation info, only the state of this part has to be filled in */
+    VkGraphicsPipelineLibraryCreateInfoEXT library_ci { VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_LIBRARY_CREATE_INFO_EXT };
+    library_ci.flags = part;
+    VkGraphicsPipelineCreateInfo pipeline_ci { VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO };
+    pipeline_ci.pNext = &library_ci;
+    pipeline_ci.flags = VK_PIPELINE_CREATE_LIBRARY_BIT_KHR;
+    pipeline_ci.basePipelineIndex = -1;
+
+    /* Shader stage of the part, if it has one */
+    VkPipelineShaderStageCreateInfo stage { VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO };
+    stage.pName = "main";
+    const Specialization specialization(desc);
+    stage.pSpecializationInfo = specialization.get();
+    const shader::Code* code = nullptr;
+
+    switch (part) {
+        case VK_GRAPHICS_PIPELINE_LIBRARY_VERTEX_INPUT_INTERFACE_BIT_EXT:
+            pipeline_ci.pVertexInputState = &state.vertex_input;
+            pipeline_ci.pInputAssemblyState = &state.assembly_input;
+            pipeline_ci.pDynamicState = &state.dynamic_state;
+            break;
+        case VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT:
+            stage.stage = VK_SHADER_STAGE_VERTEX_BIT;
+            code = &codes[0];
+            pipeline_ci.pTessellationState = &state.tessellation_state;
+            pipeline_ci.pViewportState = &state.viewport_state;
+            pipeline_ci.pRasterizationState = &state.raster_state;
+            pipeline_ci.pDynamicState = &state.dynamic_state;
+            pipeline_ci.layout = layout;
+            break;
+        case VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT:
+            stage.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+            code = &codes[1];
+            pipeline_ci.pMultisampleState = &state.multisample_state;
+            pipeline_ci.pDepthStencilState = &state.depth_stencil_state;
+            pipeline_ci.layout = layout;
+            break;
+        default: /* Fragment output interface */
+            library_ci.pNext = &state.dynamic_rendering;
+            pipeline_ci.pMultisampleState = &state.multisample_state;
+            pipeline_ci.pColorBlendState = &state.color_blend_state;
+            break;
+    }
+
+    /* Try to create the shader module of the part */
+    if (code != nullptr) {
+        const Result r_shader = shader::create_module(gpu->logical_device, *code);
+        if (r_shader.is_err()) return Err(r_shader.unwrap_err());
+        stage.module = r_shader.unwrap();
+        code_size = code->size;
+        pipeline_ci.stageCount = 1u;
+        pipeline_ci.pStages = &stage;
+    }
+
+    VkPipeline library {};
+    const VkResult result = vkCreateGraphicsPipelines(gpu->logical_device, driver_cache, 1u, &pipeline_ci, nullptr, &library);
+
+    /* We can free the shader module after compiling the part */
+    if (stage.module != VK_NULL_HANDLE) vkDestroyShaderModule(gpu->logical_device, stage.module, nullptr);
+
+    if (result != VK_SUCCESS) return Err("failed to create pipeline library for '%s' node.", desc.label.c_str());
+    return Ok(library);
+}
+
+Result<VkPipeline> PipelineCache::link_raster(const shader::Code* codes, const PipelineDesc& desc, VkPipelineLayout layout, VkPipeline* libraries, u64& code_size) {
+    constexpr VkGraphicsPipelineLibraryFlagsEXT parts[] {
+        VK_GRAPHICS_PIPELINE_LIBRARY_VERTEX_INPUT_INTERFACE_BIT_EXT,
+        VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT,
+        VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT,
+        VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_OUTPUT_INTERFACE_BIT_EXT,
+    };
+
+    /* Get all parts of the pipeline, compiling the ones no other pipeline shares */
+    const auto release_all = [&] {
+        for (u32 i = 0u; i < 4u; ++i) release_library(libraries[i]);
+        for (u32 i = 0u; i < 4u; ++i) libraries[i] = VK_NULL_HANDLE;
+    };
+    for (u32 i = 0u; i < 4u; ++i) {
+        const Result r_library = get_library(codes, desc, layout, parts[i]);
+        if (r_library.is_err()) {
+            release_all();
+            return Err(r_library.unwrap_err());
+        }
+        libraries[i] = r_library.unwrap().library;
+        code_size += r_library.unwrap().code_size;
+    }
+
+    /* Link the parts without link time optimization, which keeps linking fast */
+    VkPipelineLibraryCreateInfoKHR link_ci { VK_STRUCTURE_TYPE_PIPELINE_LIBRARY_CREATE_INFO_KHR };
+    link_ci.libraryCount = 4u;
+    link_ci.pLibraries = libraries;
+    VkGraphicsPipelineCreateInfo pipeline_ci { VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO };
+    pipeline_ci.pNext = &link_ci;
+    pipeline_ci.layout = layout;
+    pipeline_ci.basePipelineIndex = -1;
+
+    VkPipeline pipeline {};
+    if (create_pipeline(pipeline_ci, pipeline) != VK_SUCCESS) {
+        release_all();
+        return Err("failed to link pipeline for '%s' node.", desc.label.c_str());
+    }
     return Ok(pipeline);
 }
+
+Result<void> PipelineCache::compile_shaders(const shader::Code* codes, const PipelineDesc& desc, Pipeline& pipeline, u64& code_size) {
+    /* Compute shader, or vertex & pixel shader */
+    const bool compute = desc.type == NodeType::Compute;
+    const VkShaderStageFlagBits stages[2] { compute ? VK_SHADER_STAGE_COMPUTE_BIT : VK_SHADER_STAGE_VERTEX_BIT, VK_SHADER_STAGE_FRAGMENT_BIT };
+    for (u32 i = 0u; i < (compute ? 1u : 2u); ++i) {
+        const Result r_shader = get_shader(codes, desc, pipeline, stages[i]);
+        if (r_shader.is_err()) {
+            for (const VkShaderEXT shader : pipeline.shaders) release_shader(shader);
+            return Err(r_shader.unwrap_err());
+        }
+        pipeline.shaders[i] = r_shader.unwrap().shader;
+        code_size += r_shader.unwrap().code_size;
+    }
+    return Ok();
+}
+
+Result<ShaderSlot> PipelineCache::get_shader(const shader::Code* codes, const PipelineDesc& desc, const Pipeline& pipeline, VkShaderStageFlagBits stage) {
+    const u32 index = stage == VK_SHADER_STAGE_FRAGMENT_BIT ? 1u : 0u;
+    const std::string& alias = desc.shader_paths[index];
+    const shader::Code& code = codes[index];
+
+    /* Shader objects include their set layouts & constants, so they can only be shared between pipelines with the same bindings & constants */
+    u64 key = hash_combine(hash_combine(hash_string(alias), (u64)stage), binding_signature(desc.bindings));
+    key = hash_combine(key, constants_hash(desc.constants));
+
+    /* Re-use the shader object if another pipeline already created it */
+    {
+        std::lock_guard<std::mutex> lock(shader_mutex);
+        for (ShaderSlot& slot : shaders) {
+            if (slot.key != key) continue;
+            slot.users += 1u;
+            return Ok(slot);
+        }
+    }
+
+    /* Shader object creation info, not linked so each shader can be shared on its own */
+    const VkDescriptorSetLayout desc_layouts[] {pipeline.descriptors, gpu->get_vram_bank().bindless_layout};
+    VkShaderCreateInfoEXT shader_ci { VK_STRUCTURE_TYPE_SHADER_CREATE_INFO_EXT };
+    shader_ci.stage = stage;
+    shader_ci.nextStage = stage == VK_SHADER_STAGE_VERTEX_BIT ? VK_SHADER_STAGE_FRAGMENT_BIT : 0u;
+    shader_ci.codeType = VK_SHADER_CODE_TYPE_SPIRV_EXT;
+    shader_ci.codeSize = code.size;
+    shader_ci.pCode = code.data;
+    shader_ci.pName = "main";
+    const Specialization specialization(desc);
+    shader_ci.pSpecializationInfo = specialization.get();
+    shader_ci.setLayoutCount = sizeof(desc_layouts) / sizeof(VkDescriptorSetLayout);
+    shader_ci.pSetLayouts = desc_layouts;
+
+    /* Create the shader object, without holding the lock */
+    ShaderSlot slot { key, VK_NULL_HANDLE, code.size, 1u };
+    const auto start = std::chrono::steady_clock::now();
+    if (vkCreateShadersEXT(gpu->logical_device, 1u, &shader_ci, nullptr, &slot.shader) != VK_SUCCESS) {
+        return Err("failed to create shader object for '%s' node.", desc.label.c_str());
+    }
+    const std::chrono::duration<f64, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+    /* Another thread may have created the same shader object in the mean time */
+    std::lock_guard<std::mutex> lock(shader_mutex);
+    shader_compiles += 1u;
+    shader_compile_ms += elapsed.count();
+    for (ShaderSlot& other : shaders) {
+        if (other.key != key) continue;
+        vkDestroyShaderEXT(gpu->logical_device, slot.shader, nullptr);
+        other.users += 1u;
+        return Ok(other);
+    }
+    shaders.push_back(slot);
+    return Ok(slot);
+}
+
+void PipelineCache::release_shader(VkShaderEXT shader) {
+    if (shader == VK_NULL_HANDLE) return;
+    std::lock_guard<std::mutex> lock(shader_mutex);
+    for (size_t i = 0u; i < shaders.size(); ++i) {
+        if (shaders[i].shader != shader) continue;
+        if (--shaders[i].users > 0u) return;
+
+        /* No pipeline uses the shader object anymore */
+        vkDestroyShaderEXT(gpu->logical_device, shaders[i].shader, nullptr);
+        shaders[i] = shaders.back();
+        shaders.pop_back();
+        return;
+    }
+}
@@ -1,41 +1,319 @@
 #pragma once
 
 #include "vulkan/api_vk.hh" /* Vulkan API */
+#include "shader_vk.hh"
+#include "graphite/nodes/raster_node.hh"
 #include "graphite/utils/result.hh"
+#include "graphite/utils/types.hh"
 
-#include <unordered_map>
+#include <condition_variable>
+#include <unordered_set>
+#include <shared_mutex>
+#include <chrono>
 #include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <deque>
+#include <mutex>
 
 class GPUAdapter;
-class ComputeNode;
-class RasterNode;
+class ThreadPool;
+struct GraphStats;
 
-/* Collection of everything that makes up a pipeline. */
+/* Collection of everything that makes up a pipeline, the layouts are shared with other pipelines. */
 struct Pipeline {
     VkDescriptorSetLayout descriptors {};
     VkPipelineLayout layout {};
     VkPipeline pipeline {};
+    /* Compute shader, or vertex & pixel shader. (only used by the shader object backend, instead of the pipeline) */
+    VkShaderEXT shaders[2] {};
+    /* Raster pipeline parts the pipeline was linked from, released when it's destroyed. (only with pipeline libraries) */
+    VkPipeline libraries[4] {};
+    u64 size = 0u; /* Estimated driver memory used by the pipeline. (for the cache budget) */
+    u32 group_size[3] {}; /* Thread group size reflected from the compute shader, 0 if it's unknown. */
+
+    /* Whether the pipeline is missing, because it's still compiling in the background. */
+    inline bool is_null() const { return pipeline == VK_NULL_HANDLE && shaders[0] == VK_NULL_HANDLE; }
+};
+
+/* Pipeline state copied from a node, so the pipeline can be compiled on any thread. */
+struct PipelineDesc {
+    u64 key = 0u; /* Pipeline key. */
+    NodeType type = NodeType::Invalid;
+    std::string label {}; /* Label of the node which requested the pipeline. (for error messages) */
+    std::string shader_paths[2] {}; /* Compute shader, or vertex & pixel shader. */
+    std::vector<VkDescriptorSetLayoutBinding> bindings {};
+    std::vector<SpecConstant> constants {}; /* Specialization constants, for all shader stages. */
+
+    /* Raster state */
+    std::vector<AttrFormat> attributes {};
+    Topology topology = Topology::Invalid;
+    std::vector<VkFormat> color_formats {};
+};
+
+/* Pipeline waiting to be compiled in the background. */
+struct CompileJob {
+    PipelineDesc desc {};
+    std::string shader_path {}; /* Path to load the shaders from. */
+    std::chrono::steady_clock::time_point requested {};
+};
+
+/* Slot in the pipeline hash table. */
+struct PipelineSlot {
+    u64 key = 0u; /* Pipeline key, 0 if the slot is empty. */
+    std::atomic<u64> last_used { 0u }; /* Last frame in which the pipeline was used. (updated by hits under a shared lock) */
+    Pipeline pipeline {};
+
+    PipelineSlot() = default;
+    PipelineSlot(u64 key, u64 last_used, const Pipeline& pipeline) : key(key), last_used(last_used), pipeline(pipeline) {}
+
+    /* Slots are only copied while the cache is locked exclusively. */
+    PipelineSlot(const PipelineSlot& other) : key(other.key), last_used(other.last_used.load(std::memory_order_relaxed)), pipeline(other.pipeline) {}
+    PipelineSlot& operator=(const PipelineSlot& other) {
+        key = other.key;
+        last_used.store(other.last_used.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        pipeline = other.pipeline;
+        return *this;
+    }
+};
+
+/* Descriptor set & pipeline layout, shared by all pipelines with the same binding signature. */
+struct LayoutSlot {
+    u64 signature = 0u; /* Hash of the bindings. (their types, stages & order) */
+    VkDescriptorSetLayout descriptors {};
+    VkPipelineLayout layout {};
+    u32 users = 0u; /* Number of pipelines using the layouts. */
+};
+
+/* Separately compiled part of a rasterisation pipeline, linked into full pipelines. (VK_EXT_graphics_pipeline_library) */
+struct PipelineLibrary {
+    u64 key = 0u; /* Hash of the state in the part. */
+    VkPipeline library {};
+    u64 code_size = 0u; /* Size of the shader code in the part. */
+    u32 users = 0u; /* Number of pipelines linked from the part. */
+};
+
+/* Shader object created from a SPIR-V module, shared by all pipelines using the module with the same bindings. */
+struct ShaderSlot {
+    u64 key = 0u; /* Hash of the shader path, stage & binding signature. */
+    VkShaderEXT shader {};
+    u64 code_size = 0u; /* Size of the shader code. (counted towards the budget of every pipeline using it) */
+    u32 users = 0u; /* Number of pipelines using the shader object. */
 };
 
 /* Vulkan shader pipeline cache. */
 class PipelineCache {
     GPUAdapter* gpu = nullptr;
 
-    /* Hash table with (key: shader_alias, value: pipeline) */
-    std::unordered_map<std::string, Pipeline> cache {};
+    /* Open addressing hash table with (key: pipeline state hash, value: pipeline), its size is a power of 2. */
+    std::vector<PipelineSlot> slots {};
+    u32 used_slots = 0u;
+    u64 used_bytes = 0u;
+
+    /* Budget of the hash table, the least recently used pipelines are evicted once it's exceeded. (0 for no limit) */
+    u32 max_pipelines = 0u;
+    u64 max_bytes = 0u;
+
+    /* Current frame, and the evicted pipelines waiting for the frames which last used them to finish. */
+    u64 frame = 0u;
+    std::vector<PipelineSlot> evicted {};
+
+    /* Layouts shared between pipelines, guarded by their own mutex since they're created by the compile threads. */
+    std::vector<LayoutSlot> layouts {};
+    std::mutex layout_mutex {};
+
+    /* Whether raster pipelines are linked from parts, which are shared by the pipelines linked from them and destroyed with the last one. */
+    bool link_libraries = false;
+    std::vector<PipelineLibrary> libraries {};
+    std::mutex library_mutex {};
+    u64 library_hits = 0u;
+
+    /* Dynamic states of all raster pipelines, and whether the vertex input & topology are left out of the pipeline keys. */
+    std::vector<VkDynamicState> dynamic_states {};
+    bool dynamic_vertex_input = false, dynamic_topology = false;
+
+    /* Whether to create shader objects instead of pipelines, shared by the pipelines using them and destroyed with the last one. */
+    bool shader_objects = false;
+    std::vector<ShaderSlot> shaders {};
+    std::mutex shader_mutex {};
+    u64 shader_compiles = 0u;
+    f64 shader_compile_ms = 0.0;
+    /* Guards the cache, pipelines can be requested from multiple recording threads. (hits only take a shared lock) */
+    std::shared_mutex cache_mutex {};
+
+    /* Keys of the pipelines being compiled, or waiting to be compiled in the background. */
+    std::vector<u64> compiling {};
+    /* Signalled whenever a pipeline finished compiling. */
+    std::condition_variable_any compiled_cv {};
+
+    /* Background compile worker threads, and the pipelines they still have to compile. */
+    std::vector<std::thread> compile_workers {};
+    std::deque<CompileJob> compile_queue {};
+    std::condition_variable_any queue_cv {};
+    bool stopping = false;
+    /* Error of the first failed background compile, returned by `compile_errors()`. */
+    std::string compile_error {};
+
+    /* Descriptions of all compiled pipelines, in the order in which they were first compiled. (for the manifest) */
+    std::vector<PipelineDesc> compiled {};
+    /* Keys of the compiled pipeline descriptions, pipelines compiled again after an eviction are only listed once. */
+    std::unordered_set<u64> compiled_keys {};
+
+    /* Packed shader archive to load shaders from, shaders it doesn't contain are loaded as loose files. */
+    shader::Archive archive {};
+
+    /* Driver pipeline cache, used when creating pipelines. */
+    VkPipelineCache driver_cache {};
+    /* File the driver pipeline cache is loaded from & saved to, empty if it isn't persistent. */
+    std::string cache_path {};
+
+    /* Pipeline creation statistics. */
+    std::atomic<u64> hits { 0u }, misses { 0u }, skips { 0u }; /* <- counted under a shared lock */
+    u64 evictions = 0u, compiles = 0u, disk_hits = 0u;
+    f64 compile_ms = 0.0, compile_max_ms = 0.0;
+    f64 latency_ms = 0.0, latency_max_ms = 0.0;
+    u64 prewarmed = 0u;
+
+    /* Get the key of a node pipeline, the pipeline hash of the node combined with its resource specific state. */
+    u64 pipeline_key(const Node& node) const;
+
+    /* Find a pipeline in the hash table, returns nullptr if it isn't cached. */
+    PipelineSlot* find(u64 key);
+
+    /* Find a pipeline in the hash table, and mark it as used this frame. (counted as a hit, cache mutex must be locked, shared is enough) */
+    const Pipeline* use(u64 key);
+
+    /* Insert a pipeline into the hash table, growing the table if it's getting full. */
+    void insert(const PipelineSlot& slot);
+
+    /* Remove the pipeline in a slot from the hash table, shifting back the pipelines probed past it. */
+    void erase(u64 index);
+
+    /* Destroy a pipeline, and release its layouts & the parts it was linked from. */
+    void destroy(const Pipeline& pipeline);
+
+    /* Get the shared layouts for the bindings of a pipeline, creating them if no other pipeline uses them yet. */
+    Result<void> acquire_layout(const PipelineDesc& desc, Pipeline& pipeline);
+
+    /* Release the shared layouts of a pipeline, destroying them once no pipeline uses them anymore. */
+    void release_layout(VkPipelineLayout layout);
+
+    /* Check whether a pipeline is being compiled. (cache mutex must be locked, shared is enough) */
+    bool is_compiling(u64 key) const;
+
+    /* Remove a pipeline from the pipelines being compiled, and insert it if it compiled. (cache mutex must be locked) */
+    void finish_compile(const PipelineDesc& desc, const Pipeline* pipeline);
+
+    /* Copy the pipeline state of a node. */
+    Result<void> describe(const Node& node, u64 key, PipelineDesc& desc) const;
+
+    /* Compile a pipeline, can be called from any thread. */
+    Result<Pipeline> compile(std::string_view path, const PipelineDesc& desc);
+
+    /* Check the interface of the shaders of a pipeline against its description, and get its thread group size. */
+    Result<void> validate(const shader::Code* codes, const PipelineDesc& desc, Pipeline& pipeline) const;
+
+    /* Compile a compute pipeline, and add the size of its shader code to `code_size`. */
+    Result<VkPipeline> compile_compute(const shader::Code* codes, const PipelineDesc& desc, VkPipelineLayout layout, u64& code_size);
+
+    /* Compile a rasterisation pipeline, and add the size of its shader code to `code_size`. (`libraries` gets the parts it was linked from) */
+    Result<VkPipeline> compile_raster(const shader::Code* codes, const PipelineDesc& desc, VkPipelineLayout layout, VkPipeline* libraries, u64& code_size);
+
+    /* Get the key of a raster pipeline part, the hash of only the state in that part. */
+    u64 library_key(const PipelineDesc& desc, VkGraphicsPipelineLibraryFlagsEXT part) const;
+
+    /* Get a raster pipeline part from the cache, or compile it if no other pipeline compiled it yet. (adds a user to the part) */
+    Result<PipelineLibrary> get_library(const shader::Code* codes, const PipelineDesc& desc, VkPipelineLayout layout, VkGraphicsPipelineLibraryFlagsEXT part);
+
+    /* Compile a raster pipeline part, and add the size of its shader code to `code_size`. */
+    Result<VkPipeline> compile_library(const shader::Code* codes, const PipelineDesc& desc, VkPipelineLayout layout, VkGraphicsPipelineLibraryFlagsEXT part, u64& code_size);
+
+    /* Release a raster pipeline part, destroying it once no pipeline is linked from it anymore. */
+    void release_library(VkPipeline library);
+
+    /* Link a rasterisation pipeline from its parts, and add the size of their shader code to `code_size`. (`libraries` gets the parts) */
+    Result<VkPipeline> link_raster(const shader::Code* codes, const PipelineDesc& desc, VkPipelineLayout layout, VkPipeline* libraries, u64& code_size);
+
+    /* Get the shader objects of a pipeline, creating the ones which aren't cached yet. */
+    Result<void> compile_shaders(const shader::Code* codes, const PipelineDesc& desc, Pipeline& pipeline, u64& code_size);
+
+    /* Get a shader object from the cache, or create it if no other pipeline created it yet. */
+    Result<ShaderSlot> get_shader(const shader::Code* codes, const PipelineDesc& desc, const Pipeline& pipeline, VkShaderStageFlagBits stage);
+
+    /* Release a shader object, destroying it once no pipeline uses it anymore. */
+    void release_shader(VkShaderEXT shader);
+
+    /* Background compile worker thread main loop. */
+    void compile_worker();
+
+    /* Read the driver pipeline cache data from the cache file, empty if it's missing or stale. */
+    std::vector<u8> load_file() const;
+
+    /* Create a compute pipeline using the driver pipeline cache, and record its creation statistics. */
+    VkResult create_pipeline(const VkComputePipelineCreateInfo& pipeline_ci, VkPipeline& pipeline);
+
+    /* Create a graphics pipeline using the driver pipeline cache, and record its creation statistics. */
+    VkResult create_pipeline(const VkGraphicsPipelineCreateInfo& pipeline_ci, VkPipeline& pipeline);
+
+    /* Record the creation statistics of a pipeline. */
+    void record_compile(f64 ms, const VkPipelineCreationFeedbackEXT& feedback);
 
 public:
     PipelineCache() = default;
 
-    /* Initialize the pipeline cache. */
-    void init(GPUAdapter& gpu_adapter) { this->gpu = &gpu_adapter; };
+    /**
+     * @brief Initialize the pipeline cache.
+     * @param path File to load the driver pipeline cache from, empty if it isn't persistent.
+     * @param threads Number of background compile worker threads.
+     */
+    Result<void> init(GPUAdapter& gpu_adapter, std::string path = "", u32 threads = 0u);
+
+    /* Save the driver pipeline cache to the cache file, if it's persistent. */
+    Result<void> save();
 
     /* Evict any pipelines from the pipeline cache. */
     void evict();
 
-    /* Get a pipeline from the cache, or load the pipeline if it's not already cached. */
-    Result<Pipeline> get_pipeline(const std::string_view path, const ComputeNode& node);
+    /* Stop the background compile workers, save & destroy the driver pipeline cache, and evict any pipelines. */
+    Result<void> deinit();
+
+    /* Get the error of the first background compile which failed since the last call, if any. */
+    Result<void> compile_errors();
+
+    /**
+     * @brief Compile the pipelines listed in a manifest file on a thread pool, skipping the ones which are already cached.
+     * Does nothing if the manifest file doesn't exist.
+     */
+    Result<void> prewarm(std::string_view path, std::string_view manifest_path, ThreadPool& pool);
+
+    /* Write the descriptions of all compiled pipelines to a manifest file. */
+    Result<void> save_manifest(std::string_view manifest_path);
+
+    /* Memory-map a packed shader archive to load shaders from, should be called before any pipelines are cached. */
+    Result<void> open_archive(std::string_view path) { return archive.open(path); };
+
+    /* Create shader objects instead of pipelines, should be called before any pipelines are cached. */
+    void set_shader_objects(bool enable) { shader_objects = enable; };
+
+    /* Link raster pipelines from separately compiled parts, should be called before any pipelines are cached. (needs the device extension) */
+    void set_pipeline_libraries(bool enable) { link_libraries = enable; };
+
+    /* Set the budget of the pipeline cache. (0 for no limit) */
+    void set_budget(u32 count, u64 bytes) { max_pipelines = count; max_bytes = bytes; };
+
+    /**
+     * @brief Start a new frame, evicting the least recently used pipelines while the cache is over budget.
+     * Evicted pipelines are destroyed once the frames in flight which used them have finished.
+     */
+    void next_frame(u32 frames_in_flight);
+
+    /* Copy the pipeline creation statistics into the graph statistics. */
+    void write_stats(GraphStats& stats);
 
-    /* Get a pipeline from the cache, or load the pipeline if it's not already cached. */
-    Result<Pipeline> get_pipeline(const std::string_view path, const RasterNode& node);
+    /**
+     * @brief Get a pipeline from the cache, or load the pipeline if it's not already cached.
+     * Nodes which skip on a pipeline miss get a null pipeline while it compiles in the background.
+     */
+    Result<Pipeline> get_pipeline(const std::string_view path, const Node& node);
 };
@@ -0,0 +1,290 @@
+#include "reflect_vk.hh"
+
+#include <algorithm>
+#include <cstring>
+
+namespace shader {
+
+/* SPIR-V module header. */
+constexpr u32 SPIRV_MAGIC = 0x07230203u;
+constexpr u32 SPIRV_HEADER_WORDS = 5u;
+/* First SPIR-V version whose entry points list all global variables they use. */
+constexpr u32 SPIRV_VERSION_1_4 = 0x00010400u;
+/* Maximum number of struct members, an instruction has at most 65535 words. */
+constexpr u32 SPIRV_MAX_MEMBERS = 0xffffu - 2u;
+
+/* SPIR-V opcodes & enumerants used by the reflection. (see the SPIR-V specification) */
+namespace spv {
+    enum Op : u32 {
+        OpEntryPoint = 15u, OpExecutionMode = 16u,
+        OpTypeBool = 20u, OpTypeInt = 21u, OpTypeFloat = 22u, OpTypeVector = 23u, OpTypeMatrix = 24u,
+        OpTypeImage = 25u, OpTypeSampler = 26u, OpTypeSampledImage = 27u, OpTypeArray = 28u, OpTypeRuntimeArray = 29u,
+        OpTypeStruct = 30u, OpTypePointer = 32u,
+        OpConstantTrue = 41u, OpConstantFalse = 42u, OpConstant = 43u, OpConstantComposite = 44u,
+        OpSpecConstantTrue = 48u, OpSpecConstantFalse = 49u, OpSpecConstant = 50u, OpSpecConstantComposite = 51u,
+        OpVariable = 59u, OpDecorate = 71u, OpMemberDecorate = 72u, OpExecutionModeId = 331u,
+    };
+    enum Decoration : u32 {
+        SpecId = 1u, BufferBlock = 3u, ArrayStride = 6u, BuiltIn = 11u, Binding = 33u, DescriptorSet = 34u, Offset = 35u,
+    };
+    enum StorageClass : u32 { UniformConstant = 0u, Uniform = 2u, PushConstant = 9u, StorageBuffer = 12u };
+    enum ExecutionModel : u32 { Vertex = 0u, Fragment = 4u, GLCompute = 5u };
+    constexpr u32 LocalSize = 17u, LocalSizeId = 38u; /* Execution modes */
+    constexpr u32 WorkgroupSize = 25u; /* Built-in */
+    constexpr u32 DimBuffer = 5u, DimSubpassData = 6u; /* Image dimensions */
+}
+
+/* Everything the reflection needs to know about a SPIR-V id. */
+struct SpvId {
+    u32 opcode = 0u; /* Opcode of the instruction which defines the id, 0 if it isn't reflected. */
+    u32 offset = 0u; /* Word offset of the instruction which defines the id. */
+
+    /* Decorations */
+    u32 set = ~0u, binding = ~0u, spec_id = ~0u;
+    u32 array_stride = 0u;
+    bool buffer_block = false, workgroup_size = false;
+    std::vector<u32> member_offsets {};
+};
+
+/* Parsed SPIR-V module. */
+struct Module {
+    const u32* words = nullptr;
+    std::vector<SpvId> ids {};
+
+    /* Get a reflected id, nullptr if it's out of bounds or not reflected. */
+    inline const SpvId* get(u32 id) const { return id < ids.size() && ids[id].opcode != 0u ? &ids[id] : nullptr; }
+    /* Get an operand of the instruction which defines an id. */
+    inline u32 operand(const SpvId& id, u32 index) const { return words[id.offset + index]; }
+};
+
+/* Get the value of a scalar constant, specialization constants are overridden by the node constants. */
+static bool constant_value(const Module& module, u32 id, const std::vector<SpecConstant>& constants, u32& value) {
+    const SpvId* constant = module.get(id);
+    if (constant == nullptr) return false;
+
+    switch (constant->opcode) {
+        case spv::OpConstant: case spv::OpSpecConstant: value = module.operand(*constant, 3u); break;
+        case spv::OpConstantTrue: case spv::OpSpecConstantTrue: value = 1u; break;
+        case spv::OpConstantFalse: case spv::OpSpecConstantFalse: value = 0u; break;
+        default: return false;
+    }
+
+    const bool specializable = constant->opcode == spv::OpSpecConstant || constant->opcode == spv::OpSpecConstantTrue || constant->opcode == spv::OpSpecConstantFalse;
+    if (specializable == false || constant->spec_id == ~0u) return true;
+    for (const SpecConstant& spec : constants) {
+        if (spec.id == constant->spec_id) value = spec.value;
+    }
+    return true;
+}
+
+/* Get the size of a type in bytes, using its explicit layout where it has one. (0 if unknown) */
+static u32 type_size(const Module& module, u32 id, const std::vector<SpecConstant>& constants) {
+    const SpvId* type = module.get(id);
+    if (type == nullptr) return 0u;
+
+    switch (type->opcode) {
+        case spv::OpTypeBool: return 4u;
+        case spv::OpTypeInt: case spv::OpTypeFloat: return module.operand(*type, 2u) / 8u;
+        case spv::OpTypeVector: case spv::OpTypeMatrix: return type_size(module, module.operand(*type, 2u), constants) * module.operand(*type, 3u);
+        case spv::OpTypeArray: {
+            u32 length = 0u;
+            if (constant_value(module, module.operand(*type, 3u), constants, length) == false) return 0u;
+            const u32 stride = type->array_stride != 0u ? type->array_stride : type_size(module, module.operand(*type, 2u), constants);
+            return stride * length;
+        }
+        case spv::OpTypeStruct: {
+            /* Members can be placed in any order, so the size is the end of the last member */
+            const u32 count = (module.operand(*type, 0u) >> 16u) - 2u;
+            u32 size = 0u;
+            for (u32 i = 0u; i < count; ++i) {
+                const u32 offset = i < type->member_offsets.size() ? type->member_offsets[i] : 0u;
+                size = std::max(size, offset + type_size(module, module.operand(*type, 2u + i), constants));
+            }
+            return size;
+        }
+        default: return 0u;
+    }
+}
+
+/* Get the descriptor type of a resource variable, VK_DESCRIPTOR_TYPE_MAX_ENUM if graphite doesn't bind it. */
+static VkDescriptorType descriptor_type(const Module& module, u32 storage, u32 id) {
+    /* Arrays of descriptors have the type of their elements */
+    const SpvId* type = module.get(id);
+    while (type != nullptr && (type->opcode == spv::OpTypeArray || type->opcode == spv::OpTypeRuntimeArray)) {
+        type = module.get(module.operand(*type, 2u));
+    }
+    if (type == nullptr) return VK_DESCRIPTOR_TYPE_MAX_ENUM;
+
+    /* Buffers */
+    if (storage == spv::StorageBuffer) return VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    if (storage == spv::Uniform) return type->buffer_block ? VK_DESCRIPTOR_TYPE_STORAGE_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+
+    /* Images & samplers */
+    switch (type->opcode) {
+        case spv::OpTypeSampler: return VK_DESCRIPTOR_TYPE_SAMPLER;
+        case spv::OpTypeSampledImage: return VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        case spv::OpTypeImage: {
+            const u32 dim = module.operand(*type, 3u);
+            const bool storage_image = module.operand(*type, 7u) == 2u;
+            if (dim == spv::DimBuffer) return storage_image ? VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER;
+            if (dim == spv::DimSubpassData) return VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+            return storage_image ? VK_DESCRIPTOR_TYPE_STORAGE_IMAGE : VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+        }
+        default: return VK_DESCRIPTOR_TYPE_MAX_ENUM;
+    }
+}
+
+Result<void> reflect(const Code& code, VkShaderStageFlagBits stage, const std::vector<SpecConstant>& constants, Reflection& reflection) {
+    const u32* words = (const u32*)code.data;
+    const u32 word_count = (u32)(code.size / sizeof(u32));
+    if (word_count < SPIRV_HEADER_WORDS || words[0] != SPIRV_MAGIC || words[3] > word_count) {
+        return Err("invalid spir-v shader code.");
+    }
+
+    Module module {};
+    module.words = words;
+    module.ids.resize(words[3]); /* <- id bound */
+    const u32 model = stage == VK_SHADER_STAGE_COMPUTE_BIT ? spv::GLCompute : stage == VK_SHADER_STAGE_FRAGMENT_BIT ? spv::Fragment : spv::Vertex;
+
+    /* Entry point, and the execution mode with its thread group size */
+    u32 entry = ~0u, interface_begin = 0u, interface_end = 0u;
+    const u32* local_size = nullptr;
+    bool local_size_ids = false;
+
+    /* Collect the entry point, decorations, types, constants & variables */
+    for (u32 offset = SPIRV_HEADER_WORDS; offset < word_count;) {
+        const u32* op = words + offset;
+        const u32 count = op[0] >> 16u, opcode = op[0] & 0xffffu;
+        if (count == 0u || offset + count > word_count) return Err("invalid spir-v shader code.");
+
+        /* Id defined by the instruction (types define their result first), and the words it needs to be reflected */
+        u32 result = ~0u, min_count = 0u;
+        switch (opcode) {
+            case spv::OpEntryPoint: {
+                if (entry != ~0u || op[1] != model || count < 4u) break;
+                const u32 name_words = (u32)strnlen((const char*)(op + 3u), (count - 3u) * sizeof(u32)) / sizeof(u32) + 1u;
+                if (strncmp((const char*)(op + 3u), "main", (count - 3u) * sizeof(u32)) != 0) break;
+                entry = op[2];
+                interface_begin = offset + 3u + name_words;
+                interface_end = offset + count;
+                break;
+            }
+            case spv::OpExecutionMode: case spv::OpExecutionModeId:
+                if (count < 6u || op[1] != entry || op[2] != (opcode == spv::OpExecutionMode ? spv::LocalSize : spv::LocalSizeId)) break;
+                local_size = op + 3u;
+                local_size_ids = opcode == spv::OpExecutionModeId;
+                break;
+            case spv::OpDecorate: {
+                if (count < 3u || op[1] >= module.ids.size()) break;
+                SpvId& target = module.ids[op[1]];
+                const u32 literal = count > 3u ? op[3] : 0u;
+                switch (op[2]) {
+                    case spv::SpecId: target.spec_id = literal; break;
+                    case spv::BufferBlock: target.buffer_block = true; break;
+                    case spv::ArrayStride: target.array_stride = literal; break;
+                    case spv::BuiltIn: target.workgroup_size = literal == spv::WorkgroupSize; break;
+                    case spv::Binding: target.binding = literal; break;
+                    case spv::DescriptorSet: target.set = literal; break;
+                    default: break;
+                }
+                break;
+            }
+            case spv::OpMemberDecorate: {
+                if (count < 5u || op[1] >= module.ids.size() || op[3] != spv::Offset) break;
+                if (op[2] >= SPIRV_MAX_MEMBERS) return Err("shader decorates struct member %u, which doesn't exist.", op[2]);
+                std::vector<u32>& member_offsets = module.ids[op[1]].member_offsets;
+                if (member_offsets.size() <= op[2]) member_offsets.resize(op[2] + 1u, 0u);
+                member_offsets[op[2]] = op[4];
+                break;
+            }
+            case spv::OpTypeBool: case spv::OpTypeSampler: case spv::OpTypeStruct:
+                result = op[1], min_count = 2u;
+                break;
+            case spv::OpTypeFloat: case spv::OpTypeSampledImage: case spv::OpTypeRuntimeArray:
+                result = op[1], min_count = 3u;
+                break;
+            case spv::OpTypeInt: case spv::OpTypeVector: case spv::OpTypeMatrix: case spv::OpTypeArray: case spv::OpTypePointer:
+                result = op[1], min_count = 4u;
+                break;
+            case spv::OpTypeImage:
+                result = op[1], min_count = 9u;
+                break;
+            case spv::OpConstantTrue: case spv::OpConstantFalse: case spv::OpSpecConstantTrue: case spv::OpSpecConstantFalse:
+            case spv::OpConstantComposite: case spv::OpSpecConstantComposite:
+                result = count > 2u ? op[2] : ~0u, min_count = 3u;
+                break;
+            case spv::OpConstant: case spv::OpSpecConstant: case spv::OpVariable:
+                result = count > 2u ? op[2] : ~0u, min_count = 4u;
+                break;
+            default: break;
+        }
+
+        /* Remember where the id is defined, if the instruction has all the operands the reflection reads */
+        if (result < module.ids.size() && count >= min_count) {
+            module.ids[result].opcode = opcode;
+            module.ids[result].offset = offset;
+        }
+        offset += count;
+    }
+    if (entry == ~0u) return Err("shader has no 'main' entry point for its stage.");
+
+    /* Member decorations come before their struct, so their indices can only be checked once all types are known */
+    for (const SpvId& id : module.ids) {
+        if (id.member_offsets.empty()) continue;
+        const u32 member_count = id.opcode == spv::OpTypeStruct ? (module.operand(id, 0u) >> 16u) - 2u : 0u;
+        if (id.member_offsets.size() > member_count) {
+            return Err("shader decorates struct member %u, which doesn't exist.", (u32)id.member_offsets.size() - 1u);
+        }
+    }
+
+    /* Since SPIR-V 1.4 entry points list all global variables they use, older modules only list their inputs & outputs */
+    std::vector<bool> used(module.ids.size(), words[1] < SPIRV_VERSION_1_4);
+    for (u32 i = interface_begin; i < interface_end; ++i) {
+        if (words[i] < used.size()) used[words[i]] = true;
+    }
+
+    /* Reflect the descriptor bindings & push constants */
+    reflection = Reflection {};
+    for (u32 id = 0u; id < (u32)module.ids.size(); ++id) {
+        const SpvId& variable = module.ids[id];
+        if (variable.opcode != spv::OpVariable || used[id] == false) continue;
+
+        const u32 storage = module.operand(variable, 3u);
+        const SpvId* pointer = module.get(module.operand(variable, 1u));
+        if (pointer == nullptr || pointer->opcode != spv::OpTypePointer) continue;
+        const u32 pointee = module.operand(*pointer, 3u);
+
+        if (storage == spv::PushConstant) {
+            reflection.push_constant_size = std::max(reflection.push_constant_size, type_size(module, pointee, constants));
+            continue;
+        }
+        if (storage != spv::UniformConstant && storage != spv::Uniform && storage != spv::StorageBuffer) continue;
+        if (variable.binding == ~0u) continue;
+
+        const VkDescriptorType type = descriptor_type(module, storage, pointee);
+        if (type == VK_DESCRIPTOR_TYPE_MAX_ENUM) continue;
+        reflection.bindings.push_back(ReflectedBinding { variable.set == ~0u ? 0u : variable.set, variable.binding, type });
+    }
+
+    /* Reflect the thread group size, the WorkgroupSize built-in overrides the execution mode */
+    if (stage != VK_SHADER_STAGE_COMPUTE_BIT) return Ok();
+    for (const SpvId& composite : module.ids) {
+        if (composite.workgroup_size == false) continue;
+        if (composite.opcode != spv::OpConstantComposite && composite.opcode != spv::OpSpecConstantComposite) continue;
+        if ((module.operand(composite, 0u) >> 16u) < 6u) continue;
+        local_size = words + composite.offset + 3u;
+        local_size_ids = true;
+    }
+    if (local_size == nullptr) return Ok();
+    for (u32 i = 0u; i < 3u; ++i) {
+        if (local_size_ids == false) {
+            reflection.local_size[i] = local_size[i];
+        } else if (constant_value(module, local_size[i], constants, reflection.local_size[i]) == false) {
+            reflection.local_size[0] = reflection.local_size[1] = reflection.local_size[2] = 0u;
+            break;
+        }
+    }
+    return Ok();
+}
+
+} /* shader */
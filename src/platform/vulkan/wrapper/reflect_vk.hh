@@ -0,0 +1,33 @@
+#pragma once
+
+#include <vector>
+
+#include "vulkan/api_vk.hh" /* Vulkan API */
+#include "graphite/nodes/node.hh"
+#include "graphite/utils/result.hh"
+#include "graphite/utils/types.hh"
+
+#include "shader_vk.hh"
+
+namespace shader {
+
+/* Descriptor binding declared by a shader. */
+struct ReflectedBinding {
+    u32 set = 0u, binding = 0u;
+    VkDescriptorType type = VK_DESCRIPTOR_TYPE_MAX_ENUM;
+};
+
+/* Interface of a shader entry point, reflected from its SPIR-V code. */
+struct Reflection {
+    std::vector<ReflectedBinding> bindings {};
+    u32 push_constant_size = 0u; /* Size of the push constant block in bytes, 0 if there is none. */
+    u32 local_size[3] {}; /* Thread group size, only for compute shaders. (all 0 if it can't be resolved) */
+};
+
+/**
+ * @brief Reflect the interface of the `main` entry point of a shader for a stage.
+ * Specialization constants are used to resolve a thread group size which depends on them.
+ */
+Result<void> reflect(const Code& code, VkShaderStageFlagBits stage, const std::vector<SpecConstant>& constants, Reflection& reflection);
+
+} /* shader */
@@ -3,6 +3,21 @@
 #include <vector>
 #include <fstream> /* std::ifstream */
 
+#if defined(_WIN32) || defined(_WIN64)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h> /* CreateFileMapping, MapViewOfFile */
+#else
+#include <fcntl.h> /* open */
+#include <unistd.h> /* close */
+#include <sys/mman.h> /* mmap */
+#include <sys/stat.h> /* fstat */
+#endif
+
 namespace shader {
 
 using Bytes = std::vector<char>;
@@ -32,15 +47,126 @@ std::string shader_path(const std::string_view base_path, const std::string_view
     return std::string(base_path) + "/" + std::string(alias) + ".spv";
 }
 
-Result<VkShaderModule> from_alias(const VkDevice device, const std::string_view path, const std::string_view alias) {
-    /* Try to load the shader as binary */
-    const Bytes bytes = read_binary_file(shader_path(path, alias));
-    if (bytes.empty()) return Err("failed to load shader file.");
+Result<void> Archive::open(const std::string_view path) {
+    close();
+    const std::string file_path(path);
+
+    /* Memory-map the whole archive file */
+#if defined(_WIN32) || defined(_WIN64)
+    const HANDLE win_file = CreateFileA(file_path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (win_file == INVALID_HANDLE_VALUE) return Err("failed to open shader archive '%s'.", file_path.c_str());
+    file = win_file;
+
+    LARGE_INTEGER file_size {};
+    GetFileSizeEx(win_file, &file_size);
+    size = (u64)file_size.QuadPart;
+    if (size >= sizeof(ShaderArchiveHeader)) {
+        mapping = CreateFileMappingA(win_file, nullptr, PAGE_READONLY, 0u, 0u, nullptr);
+        if (mapping != nullptr) data = (const u8*)MapViewOfFile(mapping, FILE_MAP_READ, 0u, 0u, 0u);
+    }
+#else
+    const int fd = ::open(file_path.c_str(), O_RDONLY);
+    if (fd < 0) return Err("failed to open shader archive '%s'.", file_path.c_str());
+
+    struct stat file_stat {};
+    fstat(fd, &file_stat);
+    size = (u64)file_stat.st_size;
+    if (size >= sizeof(ShaderArchiveHeader)) {
+        void* view = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (view != MAP_FAILED) data = (const u8*)view;
+    }
+    ::close(fd); /* <- the mapping stays valid */
+#endif
+    if (data == nullptr) {
+        close();
+        return Err("failed to map shader archive '%s'.", file_path.c_str());
+    }
+
+    /* Validate the header, the index & the code of each shader once, the archive is read-only afterwards */
+    const ShaderArchiveHeader& header = *(const ShaderArchiveHeader*)data;
+    const u64 index_size = sizeof(ShaderArchiveHeader) + (u64)header.entry_count * sizeof(ShaderArchiveEntry) + header.names_size;
+    if (header.magic != SHADER_ARCHIVE_MAGIC || header.version != SHADER_ARCHIVE_VERSION || index_size > size) {
+        close();
+        return Err("invalid shader archive '%s'.", file_path.c_str());
+    }
+    entries = (const ShaderArchiveEntry*)(data + sizeof(ShaderArchiveHeader));
+    entry_count = header.entry_count;
+    names = (const char*)(entries + entry_count);
+
+    for (u32 i = 0u; i < entry_count; ++i) {
+        const ShaderArchiveEntry& entry = entries[i];
+        const bool sorted = i == 0u || entries[i - 1u].alias_hash <= entry.alias_hash;
+        /* SPIR-V code is made of 32-bit words, a partial word would be read past the end of the entry */
+        const bool in_bounds = (u64)entry.name_offset + entry.name_size <= header.names_size && entry.offset <= size && entry.size <= size - entry.offset && entry.size % 4u == 0u;
+        if (sorted == false || in_bounds == false || entry.offset % SHADER_ARCHIVE_ALIGN != 0u) {
+            close();
+            return Err("invalid shader archive '%s'.", file_path.c_str());
+        }
+        if (shader_code_hash(data + entry.offset, entry.size) != entry.code_hash) {
+            const std::string name(names + entry.name_offset, entry.name_size);
+            close();
+            return Err("corrupted shader '%s' in shader archive '%s'.", name.c_str(), file_path.c_str());
+        }
+    }
+    return Ok();
+}
+
+void Archive::close() {
+#if defined(_WIN32) || defined(_WIN64)
+    if (data != nullptr) UnmapViewOfFile(data);
+    if (mapping != nullptr) CloseHandle(mapping);
+    if (file != nullptr) CloseHandle(file);
+#else
+    if (data != nullptr) munmap((void*)data, size);
+#endif
+    file = mapping = nullptr;
+    data = nullptr;
+    size = 0u;
+    entries = nullptr;
+    entry_count = 0u;
+    names = nullptr;
+}
+
+const ShaderArchiveEntry* Archive::find(const std::string_view alias) const {
+    if (entry_count == 0u) return nullptr;
+
+    /* Binary search for the first entry with the alias hash */
+    const u64 hash = shader_alias_hash(alias);
+    u32 lo = 0u, hi = entry_count;
+    while (lo < hi) {
+        const u32 mid = lo + (hi - lo) / 2u;
+        if (entries[mid].alias_hash < hash) lo = mid + 1u;
+        else hi = mid;
+    }
+
+    /* Compare the names of all entries with the hash */
+    for (u32 i = lo; i < entry_count && entries[i].alias_hash == hash; ++i) {
+        if (std::string_view(names + entries[i].name_offset, entries[i].name_size) == alias) return &entries[i];
+    }
+    return nullptr;
+}
+
+Result<void> load_code(const Archive& archive, const std::string_view path, const std::string_view alias, Code& code) {
+    /* Use the code straight from the archive mapping if it contains the shader */
+    if (const ShaderArchiveEntry* entry = archive.find(alias); entry != nullptr) {
+        code.data = archive.code(*entry);
+        code.size = entry->size;
+        return Ok();
+    }
+
+    /* Otherwise try to load the shader as a loose file */
+    code.storage = read_binary_file(shader_path(path, alias));
+    if (code.storage.empty()) return Err("failed to load shader file.");
+    code.data = code.storage.data();
+    code.size = code.storage.size();
+    return Ok();
+}
 
+Result<VkShaderModule> create_module(const VkDevice device, const Code& code) {
     /* Shader module create info */
     VkShaderModuleCreateInfo create_info { VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO };
-    create_info.codeSize = bytes.size();
-    create_info.pCode = reinterpret_cast<const uint32_t*>(bytes.data());
+    create_info.codeSize = code.size;
+    create_info.pCode = reinterpret_cast<const uint32_t*>(code.data);
 
     /* Create the shader module */
     VkShaderModule module {};
@@ -1,13 +1,65 @@
 #pragma once
 
 #include <string>
+#include <vector>
 
 #include "vulkan/api_vk.hh" /* Vulkan API */
+#include "graphite/utils/shader_archive.hh"
 #include "graphite/utils/result.hh"
+#include "graphite/utils/types.hh"
 
 namespace shader {
 
-/* Try to load a shader module from its path alias. */
-Result<VkShaderModule> from_alias(const VkDevice device, const std::string_view path, const std::string_view alias);
+/**
+ * Memory-mapped packed shader archive. (see "graphite/utils/shader_archive.hh")
+ * Read-only once opened, so it can be used from multiple threads.
+ */
+class Archive {
+    /* Platform file & mapping handles. */
+    void* file = nullptr;
+    void* mapping = nullptr;
+
+    /* Mapped archive data. */
+    const u8* data = nullptr;
+    u64 size = 0u;
+
+    /* Index of the archive, sorted by alias hash. */
+    const ShaderArchiveEntry* entries = nullptr;
+    u32 entry_count = 0u;
+    const char* names = nullptr;
+
+public:
+    Archive() = default;
+    ~Archive() { close(); }
+
+    /* No copies allowed */
+    Archive(const Archive&) = delete;
+    Archive& operator=(const Archive&) = delete;
+
+    /* Memory-map an archive file, and validate its index & the code of its shaders. */
+    Result<void> open(std::string_view path);
+
+    /* Unmap the archive file, if it's open. */
+    void close();
+
+    /* Find the entry of a shader, returns nullptr if the archive doesn't contain it. */
+    const ShaderArchiveEntry* find(std::string_view alias) const;
+
+    /* Get the code of a shader entry, in the mapped archive data. */
+    inline const u8* code(const ShaderArchiveEntry& entry) const { return data + entry.offset; }
+};
+
+/* Code of a shader, pointing into the mapped archive or into its own storage for loose files. */
+struct Code {
+    const void* data = nullptr;
+    u64 size = 0u;
+    std::vector<char> storage {};
+};
+
+/* Try to load the SPIR-V code of a shader from its path alias, from the archive if it contains the shader. */
+Result<void> load_code(const Archive& archive, const std::string_view path, const std::string_view alias, Code& code);
+
+/* Try to create a shader module from loaded shader code. */
+Result<VkShaderModule> create_module(const VkDevice device, const Code& code);
 
 } /* shader */
@@ -44,6 +44,38 @@ VkDescriptorType desired_image_type(DependencyFlags flags) {
     return VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
 }
 
+/* Convert the platform-agnostic dependency stages & flags to the pipeline stages which access the resource. */
+VkPipelineStageFlags2 pipeline_stages(DependencyStages stages, DependencyFlags flags) {
+    /* Attachments are accessed by the attachment output stage, vertex buffers by the vertex input stage */
+    if (has_flag(flags, DependencyFlags::Attachment)) return VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT;
+    const bool unbound = has_flag(flags, DependencyFlags::Unbound);
+
+    VkPipelineStageFlags2 pipeline_stages = VK_PIPELINE_STAGE_2_NONE;
+    if (has_flag(stages, DependencyStages::Compute)) pipeline_stages |= VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+    if (has_flag(stages, DependencyStages::Vertex)) pipeline_stages |= unbound ? VK_PIPELINE_STAGE_2_VERTEX_ATTRIBUTE_INPUT_BIT : VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT;
+    if (has_flag(stages, DependencyStages::Pixel)) pipeline_stages |= VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT;
+    return pipeline_stages;
+}
+
+/* Convert the platform-agnostic buffer usage & dependency flags to the accesses of a buffer dependency. */
+VkAccessFlags2 buffer_access(BufferUsage usage, DependencyFlags flags) {
+    if (has_flag(flags, DependencyFlags::Unbound)) return VK_ACCESS_2_VERTEX_ATTRIBUTE_READ_BIT;
+    if (has_flag(flags, DependencyFlags::Readonly)) {
+        if (buffer_descriptor_type(usage) == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER) return VK_ACCESS_2_UNIFORM_READ_BIT;
+        return VK_ACCESS_2_SHADER_STORAGE_READ_BIT;
+    }
+    /* Writable buffers can be read by the shader as well */
+    return VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT;
+}
+
+/* Convert the platform-agnostic dependency flags to the accesses of an image dependency. */
+VkAccessFlags2 image_access(DependencyFlags flags) {
+    if (has_flag(flags, DependencyFlags::Attachment)) return VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT;
+    if (has_flag(flags, DependencyFlags::Readonly)) return VK_ACCESS_2_SHADER_READ_BIT;
+    /* Writable images can be read by the shader as well */
+    return VK_ACCESS_2_SHADER_READ_BIT | VK_ACCESS_2_SHADER_WRITE_BIT;
+}
+
 /* Convert the platform-agnostic node type to Vulkan pipeline bind point. */
 VkPipelineBindPoint pipeline_bind_point(NodeType node_type) {
     switch (node_type) {
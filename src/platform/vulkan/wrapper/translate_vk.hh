@@ -24,6 +24,15 @@ VkDescriptorType image_descriptor_type(TextureUsage usage, DependencyFlags flags
 /* Convert the platform-agnostic dependency flags to a desired image descriptor type. */
 VkDescriptorType desired_image_type(DependencyFlags flags);
 
+/* Convert the platform-agnostic dependency stages & flags to the pipeline stages which access the resource. */
+VkPipelineStageFlags2 pipeline_stages(DependencyStages stages, DependencyFlags flags);
+
+/* Convert the platform-agnostic buffer usage & dependency flags to the accesses of a buffer dependency. */
+VkAccessFlags2 buffer_access(BufferUsage usage, DependencyFlags flags);
+
+/* Convert the platform-agnostic dependency flags to the accesses of an image dependency. */
+VkAccessFlags2 image_access(DependencyFlags flags);
+
 /* Convert the platform-agnostic node type to Vulkan pipeline bind point. */
 VkPipelineBindPoint pipeline_bind_point(NodeType node_type);
 
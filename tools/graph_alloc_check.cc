@@ -0,0 +1,124 @@
+/**
+ * Graph allocation check, counts the heap allocations made while building & compiling identical graphs.
+ * Runs on the headless platform, the graphs are built through the render graph without a GPU.
+ * Fails if steady state frames allocate from the heap, with and without the schedule cache. (run by `ctest`)
+ *
+ * Usage: graph_alloc_check
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+#include <graphite/gpu_adapter.hh>
+#include <graphite/vram_bank.hh>
+#include <graphite/render_graph.hh>
+#include <graphite/nodes/compute_node.hh>
+#include <graphite/nodes/raster_node.hh>
+
+/* Number of heap allocations so far, counted by the replaced global `operator new`. */
+static u64 heap_allocs = 0u;
+
+void* operator new(std::size_t size) {
+    heap_allocs += 1u;
+    if (void* memory = std::malloc(size != 0u ? size : 1u)) return memory;
+    throw std::bad_alloc();
+}
+void operator delete(void* memory) noexcept { std::free(memory); }
+void operator delete(void* memory, std::size_t) noexcept { std::free(memory); }
+
+/* Number of frames built before graph building should stop allocating. (the second arena reset merges its blocks) */
+constexpr u32 WARMUP_FRAMES = 2u;
+/* Number of frames which are checked for heap allocations. */
+constexpr u32 CHECKED_FRAMES = 8u;
+/* Number of compute & raster nodes in the graph. */
+constexpr u32 PASS_COUNT = 256u;
+
+/* Resources used by the graph. */
+struct GraphResources {
+    std::vector<Buffer> buffers {};
+    Image attachment {};
+    Buffer vertices {}, indirect {};
+};
+
+/* Build, compile & dispatch a graph, with compute nodes feeding raster nodes with draw calls. */
+static Result<void> frame(RenderGraph& rg, const GraphResources& res) {
+    if (Result r = rg.new_graph(PASS_COUNT * 2u); r.is_err()) return r;
+    for (u32 i = 0u; i < PASS_COUNT; ++i) {
+        const Buffer input = res.buffers[i % res.buffers.size()];
+        const Buffer output = res.buffers[(i + 1u) % res.buffers.size()];
+        rg.add_compute_pass("compute", "compute.spv").read(input).write(output).specialize(0u, i % 4u).work_size(64u);
+
+        RasterNode& raster = rg.add_raster_pass("raster", "vertex.spv", "pixel.spv")
+            .read(output, ShaderStages::Pixel)
+            .attach(res.attachment)
+            .attribute(AttrFormat::XYZW32_SFloat)
+            .topology(Topology::TriangleList);
+        raster.draw(res.vertices, 3u);
+        raster.draw_indirect(res.vertices, res.indirect);
+    }
+    rg.mark_external(res.attachment);
+    if (Result r = rg.end_graph(); r.is_err()) return r;
+    return rg.dispatch();
+}
+
+/* Run a number of frames, returns the number of heap allocations they made. */
+static Result<u64> count_allocs(RenderGraph& rg, const GraphResources& res, u32 frames) {
+    const u64 start = heap_allocs;
+    for (u32 i = 0u; i < frames; ++i) {
+        if (Result r = frame(rg, res); r.is_err()) return Err(r.unwrap_err());
+    }
+    return Ok(heap_allocs - start);
+}
+
+int main() {
+    GPUAdapter gpu = GPUAdapter();
+    if (Result r = gpu.init(); r.is_err()) {
+        fprintf(stderr, "failed to init gpu adapter: %s\n", r.unwrap_err().c_str());
+        return 1;
+    }
+    VRAMBank& bank = gpu.get_vram_bank();
+
+    RenderGraph rg = RenderGraph();
+    rg.set_pass_culling(true);
+    if (Result r = rg.init(gpu); r.is_err()) {
+        fprintf(stderr, "failed to init render graph: %s\n", r.unwrap_err().c_str());
+        return 1;
+    }
+
+    GraphResources res {};
+    for (u32 i = 0u; i < 4u; ++i) res.buffers.push_back(bank.create_buffer(BufferUsage::Storage, 1024u, 4u).unwrap());
+    res.vertices = bank.create_buffer(BufferUsage::Vertex, 1024u, 16u).unwrap();
+    res.indirect = bank.create_buffer(BufferUsage::Indirect, 16u).unwrap();
+    Texture texture = bank.create_texture(TextureUsage::ColorAttachment, TextureFormat::RGBA8Unorm, Size3D { 64u, 64u }).unwrap();
+    res.attachment = bank.create_image(texture).unwrap();
+
+    /* Steady state frames with & without the schedule cache, the compiler re-uses its arrays when it isn't cached */
+    u32 failures = 0u;
+    for (const u32 cache_size : { 4u, 0u }) {
+        rg.set_schedule_cache_size(cache_size);
+        const Result<u64> warmup = count_allocs(rg, res, WARMUP_FRAMES);
+        const Result<u64> steady = count_allocs(rg, res, CHECKED_FRAMES);
+        if (warmup.is_err() || steady.is_err()) {
+            fprintf(stderr, "failed to build graph: %s\n", warmup.is_err() ? warmup.unwrap_err().c_str() : steady.unwrap_err().c_str());
+            return 1;
+        }
+
+        const char* mode = cache_size != 0u ? "cached" : "uncached";
+        printf("%s: %llu heap allocations during warm-up, %llu in %u steady state frames\n", mode, (unsigned long long)warmup.unwrap(), (unsigned long long)steady.unwrap(), CHECKED_FRAMES);
+        if (steady.unwrap() != 0u) {
+            fprintf(stderr, "FAILED: %s graph building allocated from the heap after warm-up.\n", mode);
+            failures += 1u;
+        }
+    }
+
+    rg.deinit();
+    bank.destroy(res.attachment);
+    bank.destroy(texture);
+    bank.destroy(res.indirect);
+    bank.destroy(res.vertices);
+    for (Buffer& buffer : res.buffers) bank.destroy(buffer);
+    gpu.deinit();
+    return failures != 0u ? 1 : 0;
+}
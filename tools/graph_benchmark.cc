@@ -0,0 +1,142 @@
+/**
+ * Graph compile benchmark, builds a large graph of compute nodes and times how long it takes to compile.
+ * Runs on the headless platform, the graph is built & compiled through the render graph without a GPU.
+ * Fails if the compile time doesn't scale linearly with the node count,
+ * or if compiling the graph of a steady state frame (a schedule cache hit) takes longer than the time limit. (run by `ctest`)
+ *
+ * Usage: graph_benchmark [node count] [iterations] [time limit in ms]
+ */
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include <graphite/gpu_adapter.hh>
+#include <graphite/vram_bank.hh>
+#include <graphite/render_graph.hh>
+#include <graphite/nodes/compute_node.hh>
+
+using Clock = std::chrono::steady_clock;
+
+/* Number of buffers the nodes read from & write to. */
+constexpr u32 BUFFER_COUNT = 1024u;
+/* Number of shaders the nodes are spread over. */
+constexpr u32 SHADER_COUNT = 16u;
+/* Factor between the node counts which are compared to check that compiling scales linearly. */
+constexpr u32 SCALE = 8u;
+
+/**
+ * @brief Build a graph in the same way as an application would.
+ * Each node reads the output of a few earlier nodes and writes one buffer, which gives a wide and deep graph.
+ */
+static Result<void> build(RenderGraph& rg, const std::vector<Buffer>& buffers, u32 node_count) {
+    static const char* shaders[SHADER_COUNT] = {
+        "s0", "s1", "s2", "s3", "s4", "s5", "s6", "s7", "s8", "s9", "s10", "s11", "s12", "s13", "s14", "s15",
+    };
+
+    if (Result r = rg.new_graph(node_count); r.is_err()) return r;
+    for (u32 i = 0u; i < node_count; ++i) {
+        rg.add_compute_pass("node", shaders[i % SHADER_COUNT])
+            .read(buffers[(i * 7u + 3u) % BUFFER_COUNT])
+            .read(buffers[(i * 13u + 5u) % BUFFER_COUNT])
+            .write(buffers[i % BUFFER_COUNT]);
+    }
+
+    /* The last written buffer is the output of the graph */
+    rg.mark_external(buffers[(node_count - 1u) % BUFFER_COUNT]);
+    return Ok();
+}
+
+/* Average & fastest time of building a graph, and of compiling it with `end_graph()`. (in milliseconds) */
+struct Timings {
+    double build_ms = 0.0;
+    double compile_ms = 0.0;
+    double compile_min_ms = DBL_MAX;
+};
+
+/* Build, compile & dispatch a graph a number of times, and time each step. */
+static Result<Timings> measure(RenderGraph& rg, const std::vector<Buffer>& buffers, u32 node_count, u32 iterations) {
+    Timings timings {};
+    for (u32 i = 0u; i < iterations; ++i) {
+        const Clock::time_point start = Clock::now();
+        if (Result r = build(rg, buffers, node_count); r.is_err()) return Err(r.unwrap_err());
+        const Clock::time_point built = Clock::now();
+        if (Result r = rg.end_graph(); r.is_err()) return Err(r.unwrap_err());
+        const Clock::time_point compiled = Clock::now();
+        if (Result r = rg.dispatch(); r.is_err()) return Err(r.unwrap_err());
+
+        const std::chrono::duration<double, std::milli> build_ms = built - start, compile_ms = compiled - built;
+        timings.build_ms += build_ms.count() / (double)iterations;
+        timings.compile_ms += compile_ms.count() / (double)iterations;
+        timings.compile_min_ms = std::min(timings.compile_min_ms, compile_ms.count());
+    }
+    return Ok(timings);
+}
+
+int main(int argc, char** argv) {
+    const u32 node_count = argc > 1 ? (u32)std::strtoul(argv[1], nullptr, 10) : 10000u;
+    const u32 iterations = argc > 2 ? (u32)std::strtoul(argv[2], nullptr, 10) : 100u;
+    const double limit_ms = argc > 3 ? std::strtod(argv[3], nullptr) : 0.0;
+    if (node_count < SCALE || iterations == 0u) {
+        fprintf(stderr, "usage: graph_benchmark [node count] [iterations] [time limit in ms]\n");
+        return 1;
+    }
+
+    GPUAdapter gpu = GPUAdapter();
+    gpu.set_max_buffers(BUFFER_COUNT);
+    if (Result r = gpu.init(); r.is_err()) {
+        fprintf(stderr, "failed to init gpu adapter: %s\n", r.unwrap_err().c_str());
+        return 1;
+    }
+    VRAMBank& bank = gpu.get_vram_bank();
+
+    RenderGraph rg = RenderGraph();
+    rg.set_pass_culling(true);
+    if (Result r = rg.init(gpu); r.is_err()) {
+        fprintf(stderr, "failed to init render graph: %s\n", r.unwrap_err().c_str());
+        return 1;
+    }
+
+    std::vector<Buffer> buffers {};
+    for (u32 i = 0u; i < BUFFER_COUNT; ++i) buffers.push_back(bank.create_buffer(BufferUsage::Storage, 1024u, 4u).unwrap());
+
+    /* Compiling without the schedule cache, at an eighth of & the full node count to check that it scales linearly */
+    rg.set_schedule_cache_size(0u);
+    const Result<Timings> part = measure(rg, buffers, node_count / SCALE, iterations);
+    const Result<Timings> full = measure(rg, buffers, node_count, iterations);
+    const GraphStats stats = rg.get_stats();
+
+    /* Compiling with the schedule cache, every compile after the first one is a hit (steady state frames) */
+    rg.set_schedule_cache_size(4u);
+    const Result<Timings> cached = measure(rg, buffers, node_count, iterations);
+
+    rg.deinit();
+    for (Buffer& buffer : buffers) bank.destroy(buffer);
+    gpu.deinit();
+
+    for (const Result<Timings>* r : { &part, &full, &cached }) {
+        if (r->is_ok()) continue;
+        fprintf(stderr, "failed to compile graph: %s\n", r->unwrap_err().c_str());
+        return 1;
+    }
+
+    printf("graph: %u nodes, %u waves, %u culled (%u iterations)\n", stats.nodes, stats.waves, stats.culled, iterations);
+    printf("build:          %8.3f ms\n", full.unwrap().build_ms);
+    printf("compile:        %8.3f ms (%u nodes: %.3f ms)\n", full.unwrap().compile_ms, node_count / SCALE, part.unwrap().compile_ms);
+    printf("compile cached: %8.3f ms\n", cached.unwrap().compile_ms);
+
+    /* Compiling 8x the nodes should take about 8x as long (64x if it was quadratic), with room for cache effects. (fastest compiles leave out outliers) */
+    if (full.unwrap().compile_min_ms > part.unwrap().compile_min_ms * (SCALE * 4u)) {
+        fprintf(stderr, "compile time grows faster than the node count. (%.3f ms -> %.3f ms)\n", part.unwrap().compile_min_ms, full.unwrap().compile_min_ms);
+        return 1;
+    }
+    /* Steady state frames should stay within the time limit */
+    if (limit_ms > 0.0 && cached.unwrap().compile_ms > limit_ms) {
+        fprintf(stderr, "compiling %u nodes took %.3f ms, over the limit of %.3f ms.\n", node_count, cached.unwrap().compile_ms, limit_ms);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,119 @@
+/**
+ * Offline shader packer, packs all `.spv` files in a directory into a single shader archive.
+ * (see "graphite/utils/shader_archive.hh")
+ *
+ * Usage: pack_shaders <output archive> <shader directory>
+ * Shaders are stored under their alias, their path relative to the shader directory without `.spv`.
+ */
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "graphite/utils/shader_archive.hh"
+
+namespace fs = std::filesystem;
+
+/* Shader to pack into the archive. */
+struct Shader {
+    std::string alias {};
+    std::vector<char> code {};
+    u64 alias_hash = 0u;
+};
+
+/* Read the binary data of a file into a vector. */
+static bool read_file(const fs::path& path, std::vector<char>& data) {
+    std::ifstream file { path, std::ios::ate | std::ios::binary };
+    if (!file.is_open()) return false;
+    data.resize((size_t)file.tellg());
+    file.seekg(0);
+    file.read(data.data(), data.size());
+    return (bool)file;
+}
+
+/* Round a value up to a multiple of the archive alignment. */
+static u64 align_up(u64 value) {
+    return (value + SHADER_ARCHIVE_ALIGN - 1u) / SHADER_ARCHIVE_ALIGN * SHADER_ARCHIVE_ALIGN;
+}
+
+int main(int argc, char** argv) {
+    if (argc != 3) {
+        fprintf(stderr, "usage: pack_shaders <output archive> <shader directory>\n");
+        return 1;
+    }
+    const fs::path output = argv[1];
+    const fs::path input = argv[2];
+
+    /* Collect all shaders in the directory */
+    std::vector<Shader> shaders {};
+    std::error_code ec {};
+    for (fs::recursive_directory_iterator it { input, ec }, end {}; it != end && !ec; it.increment(ec)) {
+        if (!it->is_regular_file() || it->path().extension() != ".spv") continue;
+
+        /* Aliases always use forward slashes, the same as the aliases passed to nodes */
+        Shader shader {};
+        shader.alias = fs::relative(it->path(), input).replace_extension().generic_string();
+        shader.alias_hash = shader_alias_hash(shader.alias);
+        if (!read_file(it->path(), shader.code) || shader.code.size() % 4u != 0u) {
+            fprintf(stderr, "error: failed to read shader '%s'.\n", it->path().string().c_str());
+            return 1;
+        }
+        shaders.push_back(std::move(shader));
+    }
+    if (ec) {
+        fprintf(stderr, "error: failed to read shader directory '%s'.\n", input.string().c_str());
+        return 1;
+    }
+
+    /* The index is sorted by alias hash, so shaders can be found with a binary search */
+    std::sort(shaders.begin(), shaders.end(), [](const Shader& a, const Shader& b) {
+        return a.alias_hash != b.alias_hash ? a.alias_hash < b.alias_hash : a.alias < b.alias;
+    });
+
+    /* Build the index */
+    ShaderArchiveHeader header {};
+    header.entry_count = (u32)shaders.size();
+    std::vector<ShaderArchiveEntry> entries(shaders.size());
+    std::string names {};
+    for (size_t i = 0u; i < shaders.size(); ++i) {
+        entries[i].alias_hash = shaders[i].alias_hash;
+        entries[i].name_offset = (u32)names.size();
+        entries[i].name_size = (u32)shaders[i].alias.size();
+        names += shaders[i].alias;
+    }
+    header.names_size = (u32)names.size();
+
+    /* Place the shader code after the index */
+    u64 offset = align_up(sizeof(ShaderArchiveHeader) + entries.size() * sizeof(ShaderArchiveEntry) + names.size());
+    for (size_t i = 0u; i < shaders.size(); ++i) {
+        entries[i].offset = offset;
+        entries[i].size = shaders[i].code.size();
+        entries[i].code_hash = shader_code_hash(shaders[i].code.data(), shaders[i].code.size());
+        offset = align_up(offset + shaders[i].code.size());
+    }
+
+    /* Write the archive */
+    std::ofstream file { output, std::ios::binary | std::ios::trunc };
+    if (!file.is_open()) {
+        fprintf(stderr, "error: failed to open '%s' for writing.\n", output.string().c_str());
+        return 1;
+    }
+    file.write((const char*)&header, sizeof(header));
+    file.write((const char*)entries.data(), entries.size() * sizeof(ShaderArchiveEntry));
+    file.write(names.data(), names.size());
+    const char padding[SHADER_ARCHIVE_ALIGN] {};
+    for (size_t i = 0u; i < shaders.size(); ++i) {
+        file.write(padding, entries[i].offset - (u64)file.tellp());
+        file.write(shaders[i].code.data(), shaders[i].code.size());
+    }
+    if (!file) {
+        fprintf(stderr, "error: failed to write '%s'.\n", output.string().c_str());
+        return 1;
+    }
+
+    printf("packed %u shaders into '%s'.\n", header.entry_count, output.string().c_str());
+    return 0;
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+/* Interface header */
+#include "graphite/gpu_adapter.hh"
+
+#include <vector>
+
+class Node;
+
+/* Named by a friend declaration of the VRAM bank interface, never defined without a Vulkan platform. */
+struct VkDescriptorSetLayoutBinding;
+
+/**
+ * Headless Graphics Processing Unit Adapter.
+ * Stands in for a GPU in the graph checks, so graphs can be built & compiled without one.
+ */
+class GPUAdapter : public AgnGPUAdapter {
+public:
+    /* Initialize the GPU adapter, only creates its VRAM bank. */
+    PLATFORM_SPECIFIC Result<void> init(bool debug_mode = false) { return init_vram_bank(); }
+
+    /* De-initialize the GPU adapter, free all its resources. */
+    PLATFORM_SPECIFIC Result<void> deinit() { deinit_vram_bank(); vram_bank = nullptr; return Ok(); }
+};
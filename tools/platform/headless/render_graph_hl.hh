@@ -0,0 +1,61 @@
+#pragma once
+
+/* Interface header */
+#include "graphite/render_graph.hh"
+
+#include "graphite/gpu_adapter.hh"
+#include "graphite/utils/types.hh"
+
+/* Headless graph executions have no GPU work to wait for. */
+struct GraphExecution {};
+
+/**
+ * Headless Render Graph.
+ * Builds & compiles graphs exactly like a GPU backed render graph, but dispatching them does nothing.
+ */
+class RenderGraph : public AgnRenderGraph {
+    /* Wait until it's safe to create a new graph, headless graphs are always done. */
+    PLATFORM_SPECIFIC Result<void> wait_until_safe() { return Ok(); }
+
+    /* Place the transient resources of the graph in memory, headless graphs have none. */
+    PLATFORM_SPECIFIC Result<void> alloc_transients() { transient_heap_sizes.clear(); return Ok(); }
+
+public:
+    /* Initialize the Render Graph. */
+    PLATFORM_SPECIFIC Result<void> init(GPUAdapter& gpu) {
+        this->gpu = &gpu;
+        graphs = new GraphExecution[max_graphs_in_flight] {};
+        resources = new std::vector<BindHandle>[max_graphs_in_flight] {};
+        resource_hashes = new u64[max_graphs_in_flight] {};
+        active_graph_index = 0u;
+        compiler.init(gpu);
+        return Ok();
+    }
+
+    /* Headless graphs have no pipelines. */
+    PLATFORM_SPECIFIC Result<void> prewarm(std::string_view manifest_path) { return Ok(); }
+    PLATFORM_SPECIFIC Result<void> save_pipeline_manifest(std::string_view manifest_path) { return Ok(); }
+
+    /* Headless graphs have no memory to place transient resources in. */
+    PLATFORM_SPECIFIC Result<Image> create_transient_texture(TextureUsage usage, TextureFormat fmt, Size3D size, TextureMeta meta = TextureMeta()) {
+        return Err("headless render graphs cannot create transient resources.");
+    }
+    PLATFORM_SPECIFIC Result<Buffer> create_transient_buffer(BufferUsage usage, u64 count, u64 stride = 0) {
+        return Err("headless render graphs cannot create transient resources.");
+    }
+
+    /* Upload data to a GPU buffer resource, does nothing. */
+    PLATFORM_SPECIFIC void upload_buffer(Buffer& buffer, const void* data, u64 dst_offset, u64 size) {}
+
+    /* Dispatch the graph, only moves on to the next graph execution. */
+    PLATFORM_SPECIFIC Result<void> dispatch() { next_graph(); return Ok(); }
+
+    /* De-initialize the Render Graph, free all its resources. */
+    PLATFORM_SPECIFIC Result<void> deinit() {
+        flush_graph();
+        delete[] resources;
+        delete[] resource_hashes;
+        delete[] graphs;
+        return Ok();
+    }
+};
@@ -0,0 +1,76 @@
+#pragma once
+
+/* Interface header */
+#include "graphite/vram_bank.hh"
+
+#include "graphite/utils/types.hh"
+
+/* Render target descriptor, headless render targets have no window. */
+struct TargetDesc {};
+
+/* Resource slots, headless resources are only handles without any memory. */
+struct RenderTargetSlot {};
+struct BufferSlot {};
+struct TextureSlot {};
+struct ImageSlot { Texture texture {}; };
+struct SamplerSlot {};
+
+/**
+ * Headless Video Memory Bank.
+ * Hands out resource handles & counts their references, like a GPU backed VRAM bank would.
+ */
+class VRAMBank : public AgnVRAMBank {
+    /* Initialize the VRAM bank. */
+    PLATFORM_SPECIFIC Result<void> init(GPUAdapter& gpu) {
+        this->gpu = &gpu;
+        render_targets.init(gpu.get_max_render_targets());
+        buffers.init(gpu.get_max_buffers());
+        textures.init(gpu.get_max_textures());
+        images.init(gpu.get_max_images());
+        samplers.init(gpu.get_max_samplers());
+        return Ok();
+    }
+
+    /* Destroy resources, handing their handles back to the stocks. */
+    PLATFORM_SPECIFIC void destroy_render_target(RenderTarget& render_target) { render_targets.push(render_target); }
+    PLATFORM_SPECIFIC void destroy_buffer(Buffer& buffer) { buffers.push(buffer); }
+    PLATFORM_SPECIFIC void destroy_texture(Texture& texture) { textures.push(texture); }
+    PLATFORM_SPECIFIC void destroy_image(Image& image) { images.push(image); }
+    PLATFORM_SPECIFIC void destroy_sampler(Sampler& sampler) { samplers.push(sampler); }
+
+public:
+    PLATFORM_SPECIFIC Result<RenderTarget> create_render_target(const TargetDesc& target, bool vsync = true, u32 width = 1440u, u32 height = 810u) {
+        return Ok(render_targets.pop().handle);
+    }
+    PLATFORM_SPECIFIC Result<Buffer> create_buffer(BufferUsage usage, u64 count, u64 stride = 0) {
+        return Ok(buffers.pop().handle);
+    }
+    PLATFORM_SPECIFIC Result<Texture> create_texture(TextureUsage usage, TextureFormat fmt, Size3D size, TextureMeta meta = TextureMeta()) {
+        return Ok(textures.pop().handle);
+    }
+    PLATFORM_SPECIFIC Result<Image> create_image(Texture texture, u32 mip = 0u, u32 layer = 0u, u32 mips = 0u) {
+        if (texture.is_null()) return Err("cannot create image for texture which is null.");
+        StockPair resource = images.pop();
+        resource.data.texture = texture;
+        return Ok(resource.handle);
+    }
+    PLATFORM_SPECIFIC Result<Sampler> create_sampler(Filter filter = Filter::Linear, AddressMode mode = AddressMode::Repeat, BorderColor border = BorderColor::RGB0A0_Float) {
+        return Ok(samplers.pop().handle);
+    }
+
+    /* Headless resources have no size, resizing & uploading does nothing. */
+    PLATFORM_SPECIFIC Result<void> resize_render_target(RenderTarget& render_target, u32 width, u32 height) { return Ok(); }
+    PLATFORM_SPECIFIC Result<void> resize_texture(Texture& texture, Size3D size) { return Ok(); }
+    PLATFORM_SPECIFIC Result<void> resize_buffer(Buffer& buffer, u64 count, u64 stride = 0) { return Ok(); }
+    PLATFORM_SPECIFIC Result<void> upload_buffer(Buffer& buffer, const void* data, u64 dst_offset, u64 size) { return Ok(); }
+    PLATFORM_SPECIFIC Result<void> upload_texture(Texture& texture, const void* data, const u64 size) { return Ok(); }
+
+    /* Get the texture which an image was created from. */
+    PLATFORM_SPECIFIC Texture get_texture(Image image) { return images.get(image).texture; }
+
+    /* De-initialize the VRAM bank, the stocks free their handles when the bank is deleted. */
+    PLATFORM_SPECIFIC Result<void> deinit() { return Ok(); }
+
+    /* To access the init function. */
+    friend class AgnGPUAdapter;
+};
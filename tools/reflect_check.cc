@@ -0,0 +1,141 @@
+/**
+ * Shader reflection check, reflects hand-assembled SPIR-V modules and compares the result with what they declare.
+ * Doesn't need a GPU, the reflection only reads the SPIR-V code.
+ *
+ * Usage: reflect_check
+ */
+
+#include <cstdio>
+#include <vector>
+
+#include <vulkan/wrapper/reflect_vk.hh>
+
+/* First word of a SPIR-V instruction. */
+constexpr u32 op(u32 opcode, u32 count) { return count << 16u | opcode; }
+
+/**
+ * SPIR-V 1.5 compute module, its `main` entry point declares:
+ * - thread group size (spec constant 0 = 8, 4, 1)
+ * - set 0 binding 0: storage buffer
+ * - set 0 binding 1: sampled image
+ * - set 1 binding 0: runtime array of sampled images (bindless)
+ * - 32 byte push constant block
+ * - set 0 binding 5: storage buffer which isn't in the entry point interface (unused)
+ * The module has no functions, the reflection doesn't read them.
+ */
+static const u32 COMPUTE_MODULE[] = {
+    0x07230203u, 0x00010500u, 0u, 30u, 0u,                 /* header: magic, version 1.5, generator, id bound, schema */
+    op(15u, 9u), 5u, 1u, 0x6e69616du, 0u, 12u, 15u, 18u, 22u, /* OpEntryPoint GLCompute %1 "main" %12 %15 %18 %22 */
+    op(331u, 6u), 1u, 38u, 3u, 4u, 5u,                     /* OpExecutionModeId %1 LocalSizeId %3 %4 %5 */
+    op(71u, 4u), 3u, 1u, 0u,                               /* OpDecorate %3 SpecId 0 */
+    op(71u, 4u), 12u, 34u, 0u,                             /* OpDecorate %12 DescriptorSet 0 */
+    op(71u, 4u), 12u, 33u, 0u,                             /* OpDecorate %12 Binding 0 */
+    op(71u, 4u), 15u, 34u, 0u,                             /* OpDecorate %15 DescriptorSet 0 */
+    op(71u, 4u), 15u, 33u, 1u,                             /* OpDecorate %15 Binding 1 */
+    op(71u, 4u), 19u, 34u, 0u,                             /* OpDecorate %19 DescriptorSet 0 */
+    op(71u, 4u), 19u, 33u, 5u,                             /* OpDecorate %19 Binding 5 */
+    op(71u, 4u), 22u, 34u, 1u,                             /* OpDecorate %22 DescriptorSet 1 */
+    op(71u, 4u), 22u, 33u, 0u,                             /* OpDecorate %22 Binding 0 */
+    op(71u, 3u), 9u, 2u,                                   /* OpDecorate %9 Block */
+    op(72u, 5u), 16u, 0u, 35u, 0u,                         /* OpMemberDecorate %16 0 Offset 0 */
+    op(72u, 5u), 16u, 1u, 35u, 16u,                        /* OpMemberDecorate %16 1 Offset 16 */
+    op(71u, 4u), 10u, 6u, 16u,                             /* OpDecorate %10 ArrayStride 16 */
+    op(21u, 4u), 2u, 32u, 0u,                              /* %2 = OpTypeInt 32 0 */
+    op(50u, 4u), 2u, 3u, 8u,                               /* %3 = OpSpecConstant %2 8 */
+    op(43u, 4u), 2u, 4u, 4u,                               /* %4 = OpConstant %2 4 */
+    op(43u, 4u), 2u, 5u, 1u,                               /* %5 = OpConstant %2 1 */
+    op(22u, 3u), 7u, 32u,                                  /* %7 = OpTypeFloat 32 */
+    op(23u, 4u), 8u, 7u, 4u,                               /* %8 = OpTypeVector %7 4 */
+    op(29u, 3u), 10u, 8u,                                  /* %10 = OpTypeRuntimeArray %8 */
+    op(30u, 3u), 9u, 10u,                                  /* %9 = OpTypeStruct %10 */
+    op(32u, 4u), 11u, 12u, 9u,                             /* %11 = OpTypePointer StorageBuffer %9 */
+    op(59u, 4u), 11u, 12u, 12u,                            /* %12 = OpVariable %11 StorageBuffer */
+    op(25u, 9u), 13u, 7u, 1u, 0u, 0u, 0u, 1u, 0u,          /* %13 = OpTypeImage %7 2D 0 0 0 1 Unknown */
+    op(32u, 4u), 14u, 0u, 13u,                             /* %14 = OpTypePointer UniformConstant %13 */
+    op(59u, 4u), 14u, 15u, 0u,                             /* %15 = OpVariable %14 UniformConstant */
+    op(30u, 4u), 16u, 8u, 8u,                              /* %16 = OpTypeStruct %8 %8 */
+    op(32u, 4u), 17u, 9u, 16u,                             /* %17 = OpTypePointer PushConstant %16 */
+    op(59u, 4u), 17u, 18u, 9u,                             /* %18 = OpVariable %17 PushConstant */
+    op(59u, 4u), 11u, 19u, 12u,                            /* %19 = OpVariable %11 StorageBuffer */
+    op(29u, 3u), 20u, 13u,                                 /* %20 = OpTypeRuntimeArray %13 */
+    op(32u, 4u), 21u, 0u, 20u,                             /* %21 = OpTypePointer UniformConstant %20 */
+    op(59u, 4u), 21u, 22u, 0u,                             /* %22 = OpVariable %21 UniformConstant */
+};
+
+/* Word offset of the second member decoration of the push constant block, its member index is at +2. */
+constexpr u32 MEMBER_DECORATE_OFFSET = 5u + 9u + 6u + 4u * 9u + 3u + 5u;
+
+static u32 failures = 0u;
+
+/* Report a failed check. */
+static void check(bool passed, const char* what) {
+    if (passed) return;
+    fprintf(stderr, "FAILED: %s\n", what);
+    failures += 1u;
+}
+
+/* Reflect a module for a stage. */
+static Result<void> reflect(const std::vector<u32>& words, VkShaderStageFlagBits stage, const std::vector<SpecConstant>& constants, shader::Reflection& reflection) {
+    shader::Code code {};
+    code.data = words.data();
+    code.size = words.size() * sizeof(u32);
+    return shader::reflect(code, stage, constants, reflection);
+}
+
+/* Returns true if the reflection has a binding. */
+static bool has_binding(const shader::Reflection& reflection, u32 set, u32 binding, VkDescriptorType type) {
+    for (const shader::ReflectedBinding& reflected : reflection.bindings) {
+        if (reflected.set == set && reflected.binding == binding) return reflected.type == type;
+    }
+    return false;
+}
+
+int main() {
+    const std::vector<u32> module(std::begin(COMPUTE_MODULE), std::end(COMPUTE_MODULE));
+    check(module[MEMBER_DECORATE_OFFSET] == op(72u, 5u) && module[MEMBER_DECORATE_OFFSET + 2u] == 1u, "member decoration offset");
+
+    /* Interface of the entry point */
+    {
+        shader::Reflection reflection {};
+        const Result r = reflect(module, VK_SHADER_STAGE_COMPUTE_BIT, {}, reflection);
+        check(r.is_ok(), "compute module reflects");
+        check(reflection.local_size[0] == 8u && reflection.local_size[1] == 4u && reflection.local_size[2] == 1u, "thread group size");
+        check(reflection.push_constant_size == 32u, "push constant size");
+        check(reflection.bindings.size() == 3u, "unused binding is left out");
+        check(has_binding(reflection, 0u, 0u, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER), "set 0 binding 0 is a storage buffer");
+        check(has_binding(reflection, 0u, 1u, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE), "set 0 binding 1 is a sampled image");
+        check(has_binding(reflection, 1u, 0u, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE), "set 1 binding 0 is a sampled image array");
+    }
+
+    /* Thread group size overridden by a specialization constant */
+    {
+        shader::Reflection reflection {};
+        const Result r = reflect(module, VK_SHADER_STAGE_COMPUTE_BIT, { SpecConstant { 0u, 32u } }, reflection);
+        check(r.is_ok() && reflection.local_size[0] == 32u && reflection.local_size[1] == 4u, "specialized thread group size");
+    }
+
+    /* The module has no vertex entry point */
+    {
+        shader::Reflection reflection {};
+        check(reflect(module, VK_SHADER_STAGE_VERTEX_BIT, {}, reflection).is_err(), "missing entry point is rejected");
+    }
+
+    /* Member decorations past the end of their struct */
+    for (const u32 member : { 2u, 0xffffffffu }) {
+        std::vector<u32> invalid = module;
+        invalid[MEMBER_DECORATE_OFFSET + 2u] = member;
+        shader::Reflection reflection {};
+        check(reflect(invalid, VK_SHADER_STAGE_COMPUTE_BIT, {}, reflection).is_err(), "out of range member decoration is rejected");
+    }
+
+    /* Truncated module */
+    {
+        const std::vector<u32> truncated(module.begin(), module.end() - 2u);
+        shader::Reflection reflection {};
+        check(reflect(truncated, VK_SHADER_STAGE_COMPUTE_BIT, {}, reflection).is_err(), "truncated module is rejected");
+    }
+
+    if (failures != 0u) return 1;
+    printf("reflection checks passed.\n");
+    return 0;
+}